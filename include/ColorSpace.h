@@ -0,0 +1,141 @@
+// Colour conversions for the light channels, in integer arithmetic and small tables so that a ramp
+// can convert on every tick.
+//
+// Channel values are perceived brightness: 0-255, or 0-0xFF00 in 8.8 fixed point, whose light
+// output is GAMMA of them. HSV is over those values, with the hue in HUE_RANGE steps (six sectors
+// of 256, red at 0, green at 512, blue at 1024) and the saturation 0-255. The white channel is
+// taken to emit what red, green and blue do together at the same value.
+
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <Arduino.h>
+
+namespace ColorSpace
+{
+  static const int HUE_RANGE = 6 * 256;
+  static const int KELVIN_MIN = 1000, KELVIN_MAX = 10000, KELVIN_STEP = 250;   // K
+
+  // Perceived brightness (0-255) to light output, as a 16-bit fraction of full (gamma 2.2)
+  static const uint16_t GAMMA[256] PROGMEM = {
+        0,     0,     2,     4,     7,    11,    17,    24,    32,    42,    53,    65,    79,    94,   111,   129,
+      148,   169,   192,   216,   242,   270,   299,   330,   362,   396,   432,   469,   508,   549,   591,   635,
+      681,   729,   779,   830,   883,   938,   995,  1053,  1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+     1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,  2334,  2427,  2521,  2618,  2717,  2817,  2920,  3024,
+     3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,  4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,
+     5115,  5257,  5401,  5547,  5695,  5845,  5998,  6152,  6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+     7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,  9111,  9305,  9501,  9699,  9900, 10102, 10307, 10515,
+    10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254, 12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140,
+    14386, 14635, 14885, 15138, 15394, 15652, 15912, 16174, 16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694, 20996, 21301, 21609, 21919, 22231, 22546, 22863, 23182,
+    23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826, 26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627,
+    28988, 29351, 29717, 30086, 30457, 30830, 31206, 31585, 31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981, 38402, 38825, 39252, 39680, 40112, 40546, 40982, 41421,
+    41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025, 45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793,
+    49275, 49761, 50249, 50739, 51232, 51728, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295, 63851, 64410, 64971, 65535
+  };
+
+  // Black body colour, perceived red, green, blue, from KELVIN_MIN to KELVIN_MAX by KELVIN_STEP
+  static const uint8_t KELVIN[][3] PROGMEM = {
+    { 255,  68,   0 }, { 255,  90,   0 }, { 255, 108,   0 }, { 255, 124,   0 }, { 255, 137,  14 }, { 255, 149,  45 },
+    { 255, 159,  70 }, { 255, 169,  91 }, { 255, 177, 110 }, { 255, 185, 126 }, { 255, 193, 141 }, { 255, 199, 154 },
+    { 255, 206, 166 }, { 255, 212, 177 }, { 255, 218, 187 }, { 255, 223, 197 }, { 255, 228, 206 }, { 255, 233, 214 },
+    { 255, 237, 222 }, { 255, 242, 230 }, { 255, 246, 237 }, { 255, 250, 244 }, { 255, 254, 250 }, { 252, 247, 255 },
+    { 243, 242, 255 }, { 236, 238, 255 }, { 230, 235, 255 }, { 225, 232, 255 }, { 221, 230, 255 }, { 218, 228, 255 },
+    { 215, 226, 255 }, { 212, 224, 255 }, { 210, 223, 255 }, { 207, 222, 255 }, { 205, 220, 255 }, { 203, 219, 255 },
+    { 202, 218, 255 },
+  };
+
+  // Light output (0-65535) of a perceived value
+  inline uint16_t linear(uint8_t value) { return pgm_read_word(&GAMMA[value]); }
+
+  // Perceived value of a light output, the nearest one, by bisection of GAMMA
+  inline uint8_t perceived(uint16_t output)
+  {
+    uint8_t low = 0;
+    for (uint8_t step = 128; step; step >>= 1) {
+      if (pgm_read_word(&GAMMA[low + step - 1]) < output) low += step;
+    }
+    // GAMMA[low] >= output > GAMMA[low - 1]
+    return low > 0 && output - pgm_read_word(&GAMMA[low - 1]) < pgm_read_word(&GAMMA[low]) - output ? low - 1 : low;
+  }
+
+  // 'value' and 'rgb' in 8.8 fixed point
+  inline void hsvToRgb(uint16_t hue, uint8_t saturation, uint16_t value, uint16_t rgb[3])
+  {
+    uint32_t fraction = hue & 0xFF;
+    uint16_t p = (uint32_t)value * (255 - saturation) / 255;
+    uint16_t q = (uint32_t)value * (255 * 255 - saturation * fraction) / (255 * 255);
+    uint16_t t = (uint32_t)value * (255 * 255 - saturation * (255 - fraction)) / (255 * 255);
+    switch (hue >> 8) {
+      case 0:  rgb[0] = value; rgb[1] = t; rgb[2] = p; break;
+      case 1:  rgb[0] = q; rgb[1] = value; rgb[2] = p; break;
+      case 2:  rgb[0] = p; rgb[1] = value; rgb[2] = t; break;
+      case 3:  rgb[0] = p; rgb[1] = q; rgb[2] = value; break;
+      case 4:  rgb[0] = t; rgb[1] = p; rgb[2] = value; break;
+      default: rgb[0] = value; rgb[1] = p; rgb[2] = q; break;
+    }
+  }
+
+  // 'rgb' and 'value' in 8.8 fixed point; the hue of a grey is 0
+  inline void rgbToHsv(const uint16_t rgb[3], uint16_t& hue, uint8_t& saturation, uint16_t& value)
+  {
+    uint16_t max = rgb[0] > rgb[1] ? rgb[0] : rgb[1], min = rgb[0] < rgb[1] ? rgb[0] : rgb[1];
+    if (rgb[2] > max) max = rgb[2];
+    if (rgb[2] < min) min = rgb[2];
+    int32_t delta = max - min;
+    value = max;
+    hue = 0;
+    saturation = max ? (delta * 255 + max / 2) / max : 0;
+    if (!delta) return;
+    int32_t h = max == rgb[0] ? 256 * (int32_t)(rgb[1] - rgb[2]) / delta
+              : max == rgb[1] ? 512 + 256 * (int32_t)(rgb[2] - rgb[0]) / delta
+              : 1024 + 256 * (int32_t)(rgb[0] - rgb[1]) / delta;
+    hue = h < 0 ? h + HUE_RANGE : h;
+  }
+
+  // Colour temperature, interpolated between KELVIN entries
+  inline void kelvinToRgb(uint16_t kelvin, uint8_t rgb[3])
+  {
+    kelvin = kelvin < KELVIN_MIN ? KELVIN_MIN : kelvin > KELVIN_MAX ? KELVIN_MAX : kelvin;
+    size_t index = (kelvin - KELVIN_MIN) / KELVIN_STEP;
+    uint32_t fraction = (kelvin - KELVIN_MIN) % KELVIN_STEP;
+    for (int k = 0; k < 3; ++k) {
+      int low = pgm_read_byte(&KELVIN[index][k]);
+      int high = fraction ? pgm_read_byte(&KELVIN[index + 1][k]) : low;
+      rgb[k] = low + ((high - low) * (int32_t)fraction + KELVIN_STEP / 2) / KELVIN_STEP;
+    }
+  }
+
+  // CIE 1931 chromaticity (x, y in 1/10000) at full brightness, through the sRGB primaries;
+  // a colour outside of them is clipped to the nearest they make
+  inline void xyToRgb(uint16_t x, uint16_t y, uint8_t rgb[3])
+  {
+    static const int16_t XYZ_TO_RGB[3][3] PROGMEM = {   // x 1024
+      { 3318, -1574, -511 }, { -992, 1921, 42 }, { 57, -209, 1082 } };
+    if (y < 100) y = 100;
+    int32_t xyz[3] = { (int32_t)(1024L * x / y), 1024, (int32_t)(1024L * (10000 - x - y) / y) };
+    int32_t linear[3], max = 1;
+    for (int k = 0; k < 3; ++k) {
+      linear[k] = 0;
+      for (int j = 0; j < 3; ++j) linear[k] += (int32_t)(int16_t)pgm_read_word(&XYZ_TO_RGB[k][j]) * xyz[j];
+      if (linear[k] < 0) linear[k] = 0;
+      if (linear[k] > max) max = linear[k];
+    }
+    for (int k = 0; k < 3; ++k) rgb[k] = perceived((uint16_t)((int64_t)linear[k] * 65535 / max));
+  }
+
+  // Moves the white common to red, green and blue to the white channel, whose value is returned:
+  // the same light output with the white LED doing what it can
+  inline uint8_t extractWhite(uint8_t rgb[3])
+  {
+    uint16_t output[3] = { linear(rgb[0]), linear(rgb[1]), linear(rgb[2]) };
+    uint16_t white = output[0] < output[1] ? output[0] : output[1];
+    if (output[2] < white) white = output[2];
+    for (int k = 0; k < 3; ++k) rgb[k] = perceived(output[k] - white);
+    return perceived(white);
+  }
+}
+
+#endif
@@ -0,0 +1,266 @@
+// Firmware update pipeline over the core Updater: SHA-256 checked while streaming, boot-confirm
+// or rollback.
+//
+// start() / write() / end() stream an image to the spare flash while hashing it, and end()
+// commits it (eboot installs it at the next boot) only when the digest is the expected one.
+// Images are raw (0xE9) or gzip: the core Updater accepts both and eboot inflates a gzip image
+// while installing it, so it is hashed and staged compressed. An image written by another
+// uploader (ArduinoOTA, checked with MD5 by espota) is followed with started() / progress() /
+// installed() / failed().
+//
+// Before an image is committed the running sketch is copied to the spare flash, out of reach of
+// eboot installing the new image at offset 0 (see backupOffset()), and the new image boots on
+// trial with a record in RTC user memory: begin(), first thing in setup(), counts its boots and
+// after 'attempts' of them without confirm() has eboot copy the previous sketch back. A power
+// loss clears RTC memory and with it the trial: the new image is then kept.
+
+#ifndef FIRMWAREUPDATE_H
+#define FIRMWAREUPDATE_H
+
+#include <Arduino.h>
+#include <Updater.h>
+#include <eboot_command.h>
+#include <flash_hal.h>
+#include "FlashLog.h"   // crc32()
+#include "Sha256.h"
+
+class FirmwareUpdate
+{
+  public:
+    enum State { IDLE, RECEIVING, INSTALLED, FAILED };
+    enum Boot { NORMAL, TRIAL, CONFIRMED, ROLLED_BACK };
+
+    // 'block': RTC user memory block of the boot record, after the eboot command (blocks 0..31)
+    FirmwareUpdate(uint32_t block, uint8_t attempts) : m_block(block), m_attempts(attempts) {}
+
+    State state() const { return m_state; }
+    Boot boot() const { return m_boot; }
+    const char* error() const { return m_error; }      // why the last update failed
+    size_t progress() const { return m_progress; }     // bytes received
+    size_t size() const { return m_size; }             // bytes announced, 0 when unknown
+    static const char* stateName(State state)
+    {
+      static const char* const names[] = { "idle", "receiving", "installed", "failed" };
+      return names[state];
+    }
+    static const char* bootName(Boot boot)
+    {
+      static const char* const names[] = { "normal", "trial", "confirmed", "rolled back" };
+      return names[boot];
+    }
+
+    // Count this boot if the image is on trial; once out of attempts, restart into the previous one
+    void begin()
+    {
+      Record record;
+      if (!readRecord(record)) return;
+      if (record.stage == Record::ROLLBACK) {
+        clearRecord();
+        m_boot = ROLLED_BACK;
+        return;
+      }
+      if (++record.boots > m_attempts) {
+        eboot_command command;
+        memset(&command, 0, sizeof(command));
+        command.action = ACTION_COPY_RAW;
+        command.args[0] = record.backup;
+        command.args[1] = 0;
+        command.args[2] = record.size;
+        eboot_command_write(&command);
+        record.stage = Record::ROLLBACK;
+        writeRecord(record);
+        ESP.restart();
+        return;
+      }
+      writeRecord(record);
+      m_boot = TRIAL;
+    }
+
+    // The image on trial works: keep it
+    void confirm()
+    {
+      if (m_boot != TRIAL) return;
+      clearRecord();
+      m_boot = CONFIRMED;
+    }
+
+    // Stream an image whose SHA-256 is 'sha256' (64 hex digits)
+    bool start(const char* sha256)
+    {
+      if (m_state == RECEIVING) abort("superseded");
+      started();
+      if (!parseDigest(sha256, m_expected)) return fail("missing or malformed sha256");
+      // the size is not known yet: the whole free space, the Updater stages the image at its start
+      uint32_t space = ESP.getFreeSketchSpace();
+      if (!Update.begin(space)) return fail("not enough space");
+      m_stage = sectors(ESP.getSketchSize());
+      m_sha.reset();
+      m_hashed = true;
+      return true;
+    }
+
+    bool write(const uint8_t* data, size_t length)
+    {
+      if (m_state != RECEIVING || !m_hashed) return false;
+      // the Updater also refuses a first chunk that is neither a raw nor a gzip image
+      if (Update.write((uint8_t*)data, length) != length) return abort("not an image or flash error");
+      m_sha.update(data, length);
+      m_progress += length;
+      return true;
+    }
+
+    bool end()
+    {
+      if (m_state != RECEIVING || !m_hashed) return false;
+      uint8_t digest[Sha256::DIGEST_SIZE];
+      m_sha.finish(digest);
+      if (memcmp(digest, m_expected, sizeof(digest)) != 0) return abort("SHA-256 mismatch");
+      uint32_t backup = backupOffset(m_stage, m_progress);
+      if (backup && !backupSketch(backup)) backup = 0;
+      if (!Update.end(true)) return fail("commit failed");
+      m_size = m_progress;
+      installed(backup);
+      return true;
+    }
+
+    // Stop an update in progress: the Updater is ended unfinished, nothing is committed
+    bool abort(const char* reason)
+    {
+      if (m_state == RECEIVING && m_hashed) Update.end(false);
+      return fail(reason);
+    }
+
+    // An image written by another uploader
+    void started()
+    {
+      m_state = RECEIVING;
+      m_error = "";
+      m_progress = 0;
+      m_size = 0;
+      m_hashed = false;
+    }
+    void progress(size_t received, size_t size)
+    {
+      m_progress = received;
+      m_size = size;
+    }
+    // It is committed: copy the running sketch aside if there is room. The Updater was begun with
+    // the announced size and staged the image at the end of the free space.
+    void installed()
+    {
+      uint32_t end = sectors(ESP.getSketchSize()) + ESP.getFreeSketchSpace();
+      uint32_t backup = backupOffset(end - sectors(m_size), m_size);
+      installed(backup && backupSketch(backup) ? backup : 0);
+    }
+    bool failed(const char* reason) { return fail(reason); }
+
+  protected:
+    struct Record
+    {
+      enum { MAGIC = 0xF1A5B007, TRIAL = 1, ROLLBACK = 2 };
+      uint32_t magic;
+      uint32_t stage;     // TRIAL, or ROLLBACK requested (reported by the previous image)
+      uint32_t boots;     // boots of the image on trial
+      uint32_t backup;    // flash offset of the copy of the previous sketch
+      uint32_t size;      // bytes
+      uint32_t crc;       // CRC-32 of the fields above
+    };
+
+    static uint32_t sectors(uint32_t bytes) { return (bytes + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1); }
+
+    // Flash offset for the copy of the running sketch with an image of 'size' bytes staged at
+    // 'stage', 0 if there is no room. It must stay clear of the running sketch, of the staged image
+    // and of the new image once eboot has copied it to offset 0, which may be larger than the
+    // running sketch: preferably at the end of the free space, above the staged image, else right
+    // below it.
+    static uint32_t backupOffset(uint32_t stage, uint32_t size)
+    {
+      uint32_t sketch = sectors(ESP.getSketchSize()), image = sectors(size);
+      uint32_t end = sketch + ESP.getFreeSketchSpace();
+      uint32_t lowest = sketch > image ? sketch : image;
+      if (end - sketch >= stage + image && end - sketch >= lowest) return end - sketch;
+      if (stage >= sketch + lowest) return stage - sketch;
+      return 0;
+    }
+
+    static bool parseDigest(const char* hex, uint8_t* digest)
+    {
+      for (size_t i = 0; i < 2 * Sha256::DIGEST_SIZE; ++i) {
+        char c = hex[i];
+        int nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (nibble < 0) return false;
+        digest[i / 2] = (i % 2) ? (digest[i / 2] | nibble) : nibble << 4;
+      }
+      return hex[2 * Sha256::DIGEST_SIZE] == '\0';
+    }
+
+    // Copy the running sketch to flash offset 'to', 256 bytes at a time (the stack is 4 KB)
+    static bool backupSketch(uint32_t to)
+    {
+      uint32_t buffer[64];
+      uint32_t size = sectors(ESP.getSketchSize());
+      for (uint32_t offset = 0; offset < size; offset += sizeof(buffer)) {
+        if (offset % FLASH_SECTOR_SIZE == 0) {
+          if (flash_hal_erase(to + offset, FLASH_SECTOR_SIZE) != FLASH_HAL_OK) return false;
+          yield();
+        }
+        if (flash_hal_read(offset, sizeof(buffer), (uint8_t*)buffer) != FLASH_HAL_OK ||
+            flash_hal_write(to + offset, sizeof(buffer), (const uint8_t*)buffer) != FLASH_HAL_OK) return false;
+      }
+      return true;
+    }
+
+    // 'backup': flash offset of the copy of the running sketch, 0 if none
+    void installed(uint32_t backup)
+    {
+      m_state = INSTALLED;
+      if (!backup) return;   // installed without a way back
+      Record record;
+      record.stage = Record::TRIAL;
+      record.boots = 0;
+      record.backup = backup;
+      record.size = ESP.getSketchSize();
+      writeRecord(record);
+    }
+
+    bool fail(const char* reason)
+    {
+      m_state = FAILED;
+      m_error = reason;
+      return false;
+    }
+
+    bool readRecord(Record& record) const
+    {
+      return ESP.rtcUserMemoryRead(m_block, (uint32_t*)&record, sizeof(record)) && record.magic == Record::MAGIC &&
+             record.crc == crc32(&record, offsetof(Record, crc));
+    }
+
+    void writeRecord(Record& record) const
+    {
+      record.magic = Record::MAGIC;
+      record.crc = crc32(&record, offsetof(Record, crc));
+      ESP.rtcUserMemoryWrite(m_block, (uint32_t*)&record, sizeof(record));
+    }
+
+    void clearRecord() const
+    {
+      Record record;
+      memset(&record, 0, sizeof(record));
+      ESP.rtcUserMemoryWrite(m_block, (uint32_t*)&record, sizeof(record));
+    }
+
+    uint32_t m_block;
+    uint8_t m_attempts;
+    State m_state = IDLE;
+    Boot m_boot = NORMAL;
+    const char* m_error = "";
+    size_t m_progress = 0;
+    size_t m_size = 0;
+    bool m_hashed = false;          // streamed through start() / write() / end()
+    uint32_t m_stage = 0;           // flash offset where the Updater stages the streamed image
+    uint8_t m_expected[Sha256::DIGEST_SIZE];
+    Sha256 m_sha;
+};
+
+#endif
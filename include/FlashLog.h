@@ -0,0 +1,157 @@
+// Append-only log of CRC-checked records over a few raw flash sectors.
+//
+// Each write appends a new record (fixed size slot) after the latest one; a sector is only
+// erased when the log wraps into it, so a sector sees one erase per (slots per sector x sectors)
+// writes. The latest valid record (highest sequence number) wins at boot: a record torn by a
+// power loss fails its CRC and the previous one is used, and the sector being erased is never
+// the one holding the latest record.
+
+#ifndef FLASHLOG_H
+#define FLASHLOG_H
+
+#include <Arduino.h>
+#include <flash_hal.h>
+
+#ifndef FLASH_SECTOR_SIZE
+# define FLASH_SECTOR_SIZE 0x1000
+#endif
+
+static uint32_t crc32(const void* data, size_t length, uint32_t crc = 0)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  crc = ~crc;
+  while (length--) {
+    crc ^= *bytes++;
+    for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// SLOT_SIZE (header + payload) must be a multiple of 4 and divide FLASH_SECTOR_SIZE
+template<uint16_t SLOT_SIZE>
+class FlashLog
+{
+  public:
+    enum { MAGIC = 0xA1D5 };
+    struct Header
+    {
+      uint16_t magic;
+      uint16_t version;     // payload format, belongs to the user of the log
+      uint32_t sequence;
+      uint16_t length;      // payload bytes
+      uint16_t reserved;
+      uint32_t crc;         // CRC-32 of the header (crc = 0) and the payload
+    };
+
+    // Locate the latest record in 'sectors' sectors starting at flash offset 'address'
+    bool begin(uint32_t address, uint32_t sectors)
+    {
+      m_address = address;
+      m_sectors = sectors;
+      m_latest = NONE;
+      m_sequence = 0;
+      if (sectors < 2) return false;
+      Header header;
+      for (uint32_t slot = 0; slot < slots(); ++slot) {
+        if (!readHeader(slot, header) || header.sequence < m_sequence) continue;
+        m_latest = slot;
+        m_sequence = header.sequence;
+      }
+      m_next = m_latest == NONE ? 0 : (m_latest + 1) % slots();
+      return true;
+    }
+
+    bool valid() const { return m_latest != NONE; }
+    uint32_t sequence() const { return m_sequence; }
+    unsigned long writes() const { return m_writes; }
+    unsigned long erases() const { return m_erases; }
+
+    // Payload of the latest record, returns its length (0 if none) and format version
+    size_t read(void* data, size_t size, uint16_t& version) const
+    {
+      Header header;
+      if (m_latest == NONE || !readHeader(m_latest, header)) return 0;
+      size_t length = header.length < size ? header.length : size;
+      flash_hal_read(slotAddress(m_latest) + sizeof(Header), length, (uint8_t*)data);
+      version = header.version;
+      return length;
+    }
+
+    bool write(const void* data, size_t length, uint16_t version)
+    {
+      if (m_sectors < 2 || sizeof(Header) + length > SLOT_SIZE) return false;
+      uint8_t buffer[SLOT_SIZE];
+      memset(buffer, 0xFF, sizeof(buffer));
+      Header header;
+      header.magic = MAGIC;
+      header.version = version;
+      header.sequence = m_sequence + 1;
+      header.length = length;
+      header.reserved = 0xFFFF;
+      header.crc = 0;
+      header.crc = crc32(data, length, crc32(&header, sizeof(header)));
+
+      // skip slots that are not blank (torn writes), at most one full turn
+      for (uint32_t attempt = 0; attempt < slots(); ++attempt) {
+        uint32_t slot = m_next;
+        m_next = (m_next + 1) % slots();
+        if (slot % slotsPerSector() == 0) {
+          if (flash_hal_erase(slotAddress(slot), FLASH_SECTOR_SIZE) != FLASH_HAL_OK) continue;
+          ++m_erases;
+        }
+        else if (!blank(slot)) {
+          continue;
+        }
+        memcpy(buffer, &header, sizeof(header));
+        memcpy(buffer + sizeof(header), data, length);
+        ++m_writes;
+        if (flash_hal_write(slotAddress(slot), (sizeof(header) + length + 3) & ~3, buffer) != FLASH_HAL_OK) continue;
+        Header check;
+        if (!readHeader(slot, check) || check.sequence != header.sequence) continue;
+        m_latest = slot;
+        m_sequence = header.sequence;
+        return true;
+      }
+      return false;
+    }
+
+  protected:
+    enum { NONE = 0xFFFFFFFF };
+    uint32_t slotsPerSector() const { return FLASH_SECTOR_SIZE / SLOT_SIZE; }
+    uint32_t slots() const { return m_sectors * slotsPerSector(); }
+    uint32_t slotAddress(uint32_t slot) const
+    {
+      return m_address + (slot / slotsPerSector()) * FLASH_SECTOR_SIZE + (slot % slotsPerSector()) * SLOT_SIZE;
+    }
+    bool blank(uint32_t slot) const
+    {
+      uint32_t word;
+      for (uint32_t offset = 0; offset < SLOT_SIZE; offset += sizeof(word)) {
+        if (flash_hal_read(slotAddress(slot) + offset, sizeof(word), (uint8_t*)&word) != FLASH_HAL_OK || word != 0xFFFFFFFF) return false;
+      }
+      return true;
+    }
+    // Header of a slot holding a complete, CRC-valid record
+    bool readHeader(uint32_t slot, Header& header) const
+    {
+      if (flash_hal_read(slotAddress(slot), sizeof(header), (uint8_t*)&header) != FLASH_HAL_OK) return false;
+      if (header.magic != MAGIC || sizeof(Header) + header.length > SLOT_SIZE) return false;
+      uint8_t payload[SLOT_SIZE];
+      if (flash_hal_read(slotAddress(slot) + sizeof(header), header.length, payload) != FLASH_HAL_OK) return false;
+      uint32_t crc = header.crc;
+      header.crc = 0;
+      bool valid = crc32(payload, header.length, crc32(&header, sizeof(header))) == crc;
+      header.crc = crc;
+      return valid;
+    }
+
+    uint32_t m_address = 0;
+    uint32_t m_sectors = 0;
+    uint32_t m_latest = NONE;
+    uint32_t m_next = 0;
+    uint32_t m_sequence = 0;
+    unsigned long m_writes = 0;
+    unsigned long m_erases = 0;
+};
+
+#endif
@@ -0,0 +1,209 @@
+// Minimal MQTT 3.1.1 client over a WiFiClient: QoS 0 publish and subscribe, retained messages,
+// a retained last will, keep-alive pings.
+//
+// Nothing waits for the broker: connect() opens the TCP connection to an address, resolved by the
+// caller (a name would block in WiFi.hostByName() for seconds), blocking for the client timeout at
+// most, the only step that does, and sends CONNECT; poll() reads whatever arrived and is CONNECTED
+// once the broker accepted. Packets are assembled in a BUFFER byte buffer, larger ones are dropped.
+// No heap.
+
+#ifndef MQTTCLIENT_H
+#define MQTTCLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <limits.h>
+
+template<size_t BUFFER>
+class MqttClient
+{
+  public:
+    enum State { DISCONNECTED, CONNECTING, CONNECTED };
+    // 'topic' and 'payload' are NUL terminated
+    typedef void (*Callback)(const char* topic, const char* payload, size_t length);
+
+    // 'timeout': ms - TCP connection
+    MqttClient(uint16_t timeout) : m_timeout(timeout) {}
+
+    State state() const { return m_state; }
+    static const char* stateName(State state)
+    {
+      static const char* const names[] = { "disconnected", "connecting", "connected" };
+      return names[state];
+    }
+    int available() { return m_state != DISCONNECTED ? m_client.available() : 0; }
+
+    bool connect(const IPAddress& address, uint16_t port, const char* clientId, const char* willTopic, const char* willMessage,
+                 uint16_t keepAlive, unsigned long currentTime)
+    {
+      disconnect();
+      uint8_t packet[BUFFER];
+      if (10 + 6 + strlen(clientId) + strlen(willTopic) + strlen(willMessage) > sizeof(packet)) return false;
+      m_client.setTimeout(m_timeout);
+      if (!m_client.connect(address, port)) return false;
+      size_t length = putString(packet, "MQTT");
+      packet[length++] = 4;                        // protocol level 3.1.1
+      packet[length++] = 0x02 | 0x04 | 0x20;       // clean session, will, will retained
+      packet[length++] = keepAlive >> 8;
+      packet[length++] = keepAlive;
+      length += putString(packet + length, clientId);
+      length += putString(packet + length, willTopic);
+      length += putString(packet + length, willMessage);
+      m_state = CONNECTING;
+      m_keepAlive = keepAlive * 1000UL;
+      m_opened = m_received = m_pinged = currentTime;
+      m_phase = HEADER;
+      return send(CONNECT, packet, length, NULL, 0) || fail();
+    }
+
+    // Closes the connection cleanly: the broker does not publish the will
+    void disconnect()
+    {
+      if (m_state == CONNECTED) send(DISCONNECT, NULL, 0, NULL, 0);
+      m_client.stop();
+      m_state = DISCONNECTED;
+    }
+
+    // False if the packet does not fit in the TCP window now
+    bool publish(const char* topic, const char* payload, bool retain)
+    {
+      uint8_t head[BUFFER];
+      if (m_state != CONNECTED || strlen(topic) + 2 > sizeof(head)) return false;
+      return send(PUBLISH | (retain ? 0x01 : 0), head, putString(head, topic), payload, strlen(payload));
+    }
+
+    bool subscribe(const char* topic)
+    {
+      uint8_t packet[BUFFER];
+      if (m_state != CONNECTED || strlen(topic) + 5 > sizeof(packet)) return false;
+      ++m_packetId;
+      packet[0] = m_packetId >> 8;
+      packet[1] = m_packetId;
+      size_t length = 2 + putString(packet + 2, topic);
+      packet[length++] = 0;                        // QoS 0
+      return send(SUBSCRIBE, packet, length, NULL, 0);
+    }
+
+    // Reads what arrived, runs 'callback' for each message, pings; false once disconnected
+    bool poll(unsigned long currentTime, Callback callback)
+    {
+      if (m_state == DISCONNECTED) return false;
+      if (!m_client.connected()) return fail();
+      for (int byte; (byte = m_client.read()) >= 0;) {
+        m_received = currentTime;
+        if (!receive(byte, callback)) return fail();
+      }
+      if (m_state == CONNECTING && currentTime - m_opened >= m_keepAlive) return fail();
+      // any packet, PINGRESP at least, must come back within 1.5 keep-alive
+      if (currentTime - m_received >= m_keepAlive + m_keepAlive / 2) return fail();
+      if (m_state == CONNECTED && currentTime - m_pinged >= m_keepAlive / 2) {
+        send(PINGREQ, NULL, 0, NULL, 0);
+        m_pinged = currentTime;
+      }
+      return true;
+    }
+
+    // Time (ms) until poll() has something to do besides reading: ping or timeout
+    unsigned long nextUpdate(unsigned long currentTime) const
+    {
+      if (m_state == DISCONNECTED) return ULONG_MAX;
+      unsigned long deadline = m_state == CONNECTED ? m_pinged + m_keepAlive / 2 : m_opened + m_keepAlive;
+      int32_t left = (int32_t)(deadline - currentTime);
+      return left > 0 ? left : 0;
+    }
+
+  protected:
+    enum Type { CONNECT = 0x10, CONNACK = 0x20, PUBLISH = 0x30, SUBSCRIBE = 0x82, PINGREQ = 0xC0, DISCONNECT = 0xE0 };
+    enum Phase { HEADER, LENGTH, BODY };
+
+    static size_t putString(uint8_t* out, const char* string)
+    {
+      size_t length = strlen(string);
+      out[0] = length >> 8;
+      out[1] = length;
+      memcpy(out + 2, string, length);
+      return length + 2;
+    }
+
+    bool send(uint8_t type, const uint8_t* head, size_t headLength, const char* body, size_t bodyLength)
+    {
+      uint8_t header[5] = { type };
+      size_t length = headLength + bodyLength, count = 1;
+      do {
+        header[count++] = (length & 0x7F) | (length > 0x7F ? 0x80 : 0);
+        length >>= 7;
+      } while (length);
+      if (m_client.availableForWrite() < int(count + headLength + bodyLength)) return false;
+      return m_client.write(header, count) == count && (!headLength || m_client.write(head, headLength) == headLength) &&
+             (!bodyLength || m_client.write((const uint8_t*)body, bodyLength) == bodyLength);
+    }
+
+    // One received byte: fixed header, remaining length, then the packet
+    bool receive(uint8_t byte, Callback callback)
+    {
+      switch (m_phase) {
+        case HEADER:
+          m_type = byte;
+          m_length = 0;
+          m_shift = 0;
+          m_phase = LENGTH;
+          return true;
+        case LENGTH:
+          m_length |= (uint32_t)(byte & 0x7F) << m_shift;
+          m_shift += 7;
+          if (byte & 0x80) return m_shift < 28;
+          m_count = 0;
+          m_phase = BODY;
+          return m_length > 0 || handle(callback);
+        case BODY:
+          if (m_count < BUFFER) m_buffer[m_count] = byte;
+          return ++m_count < m_length || handle(callback);
+      }
+      return true;
+    }
+
+    // A whole packet is in m_buffer, unless it was too large
+    bool handle(Callback callback)
+    {
+      m_phase = HEADER;
+      if (m_length > BUFFER) return true;
+      if (m_type == CONNACK) {
+        if (m_length < 2 || m_buffer[1] != 0) return false;   // refused
+        m_state = CONNECTED;
+      }
+      else if ((m_type & 0xF0) == PUBLISH && m_state == CONNECTED) {
+        size_t topic = (size_t)m_buffer[0] << 8 | m_buffer[1];
+        size_t payload = 2 + topic + ((m_type & 0x06) ? 2 : 0);   // a packet id above QoS 0
+        if (m_length < 2 || payload > m_length) return true;
+        memmove(m_buffer, m_buffer + 2, topic);
+        m_buffer[topic] = '\0';
+        m_buffer[m_length] = '\0';
+        callback((const char*)m_buffer, (const char*)m_buffer + payload, m_length - payload);
+      }
+      return true;
+    }
+
+    bool fail()
+    {
+      m_client.stop();
+      m_state = DISCONNECTED;
+      return false;
+    }
+
+    WiFiClient m_client;
+    uint16_t m_timeout;
+    State m_state = DISCONNECTED;
+    uint32_t m_keepAlive = 0;        // ms
+    unsigned long m_opened = 0;      // millis() of the connection
+    unsigned long m_received = 0;    // millis() of the last byte received
+    unsigned long m_pinged = 0;      // millis() of the last PINGREQ
+    uint16_t m_packetId = 0;
+    uint8_t m_phase = HEADER;
+    uint8_t m_type = 0;
+    uint8_t m_shift = 0;
+    uint32_t m_length = 0;           // remaining length of the packet received
+    uint32_t m_count = 0;            // bytes of it received
+    uint8_t m_buffer[BUFFER + 1];    // + the NUL ending the payload
+};
+
+#endif
@@ -0,0 +1,101 @@
+// Incremental SHA-256 (FIPS 180-4): update() with data as it arrives, finish() once.
+//
+// 112 bytes of state and no heap, so an image can be hashed chunk by chunk while it is streamed.
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <Arduino.h>
+
+class Sha256
+{
+  public:
+    enum { DIGEST_SIZE = 32, BLOCK_SIZE = 64 };
+
+    Sha256() { reset(); }
+
+    void reset()
+    {
+      static const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                           0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+      memcpy(m_state, initial, sizeof(m_state));
+      m_length = 0;
+      m_used = 0;
+    }
+
+    void update(const void* data, size_t length)
+    {
+      const uint8_t* bytes = (const uint8_t*)data;
+      m_length += length;
+      if (m_used > 0) {
+        size_t count = BLOCK_SIZE - m_used < length ? BLOCK_SIZE - m_used : length;
+        memcpy(m_buffer + m_used, bytes, count);
+        m_used += count;
+        bytes += count;
+        length -= count;
+        if (m_used < BLOCK_SIZE) return;
+        block(m_buffer);
+        m_used = 0;
+      }
+      for (; length >= BLOCK_SIZE; bytes += BLOCK_SIZE, length -= BLOCK_SIZE) block(bytes);
+      memcpy(m_buffer, bytes, length);
+      m_used = length;
+    }
+
+    void finish(uint8_t digest[DIGEST_SIZE])
+    {
+      uint64_t bits = m_length * 8;
+      uint8_t padding = 0x80;
+      update(&padding, 1);
+      padding = 0;
+      while (m_used != BLOCK_SIZE - 8) update(&padding, 1);
+      uint8_t length[8];
+      for (int i = 0; i < 8; ++i) length[i] = uint8_t(bits >> (56 - 8 * i));
+      update(length, 8);
+      for (int i = 0; i < DIGEST_SIZE; ++i) digest[i] = uint8_t(m_state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+
+  protected:
+    static uint32_t rotate(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void block(const uint8_t* data)
+    {
+      static const uint32_t K[64] PROGMEM = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+      // message schedule kept as a 16 word ring
+      uint32_t w[16];
+      for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 | (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+      }
+      uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+      uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+      for (int i = 0; i < 64; ++i) {
+        if (i >= 16) {
+          uint32_t w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+          w[i & 15] += (rotate(w15, 7) ^ rotate(w15, 18) ^ (w15 >> 3)) + w[(i - 7) & 15] +
+                       (rotate(w2, 17) ^ rotate(w2, 19) ^ (w2 >> 10));
+        }
+        uint32_t t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + pgm_read_dword(&K[i]) + w[i & 15];
+        uint32_t t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+      }
+      m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+      m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+    }
+
+    uint32_t m_state[8];
+    uint64_t m_length;     // bytes hashed
+    uint8_t m_buffer[BLOCK_SIZE];
+    size_t m_used;         // bytes waiting in m_buffer
+};
+
+#endif
@@ -0,0 +1,198 @@
+// Generated by tools/web_assets.py from web/ - do not edit
+
+#ifndef WEBASSETS_H
+#define WEBASSETS_H
+
+// help.html: 3060 bytes, 1590 gzipped
+#define WEB_HELP_ETAG "\"25ac60fdfbcca725\""
+static const uint8_t WEB_HELP[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8d, 0x56, 0x6b, 0x6f, 0xdb, 0x36,
+  0x14, 0xfd, 0x2b, 0x17, 0xc6, 0x50, 0xd8, 0x9b, 0xfc, 0x4a, 0xd3, 0x14, 0x75, 0xe2, 0xb4, 0x69,
+  0xd7, 0xb4, 0x1b, 0xb6, 0x25, 0x6b, 0x52, 0xf4, 0x83, 0x20, 0x04, 0x94, 0x44, 0x4b, 0x44, 0x24,
+  0x51, 0x23, 0x29, 0x3b, 0x5e, 0xd5, 0xff, 0xbe, 0x73, 0x29, 0xd9, 0x49, 0xba, 0x0e, 0x5d, 0x10,
+  0x88, 0xe6, 0xe3, 0xf2, 0xbe, 0xce, 0xb9, 0x97, 0x27, 0xb9, 0x2b, 0x8b, 0xd3, 0x93, 0x5c, 0x8a,
+  0xf4, 0xf4, 0xc4, 0x29, 0x57, 0xc8, 0xd3, 0xb3, 0xaa, 0x12, 0xef, 0x45, 0x95, 0xd2, 0x98, 0xce,
+  0x2e, 0x7f, 0x39, 0x99, 0x76, 0xab, 0x27, 0xd6, 0x6d, 0x79, 0x98, 0xee, 0xc6, 0x4e, 0x24, 0xd6,
+  0xe9, 0x16, 0xe2, 0xf3, 0xbd, 0xd4, 0x89, 0xad, 0x45, 0x45, 0x2a, 0x5d, 0x0e, 0xd6, 0xd2, 0x58,
+  0xa5, 0xab, 0xc1, 0x29, 0x0d, 0xd7, 0xf3, 0xc9, 0x6c, 0x3e, 0xea, 0x2e, 0xa4, 0x8f, 0x56, 0x64,
+  0x12, 0xf7, 0xe0, 0x1c, 0x5f, 0x33, 0x3f, 0x3d, 0x69, 0x60, 0x41, 0xa1, 0x4e, 0x3f, 0xc8, 0x58,
+  0x6b, 0xb7, 0xa0, 0xa9, 0xf1, 0x3f, 0x4e, 0xa6, 0x58, 0xeb, 0xd6, 0xad, 0x74, 0xf4, 0x49, 0xad,
+  0x94, 0xdf, 0xc3, 0x64, 0xbf, 0x75, 0x71, 0x7d, 0x46, 0xba, 0x9a, 0xea, 0xd5, 0x6a, 0xea, 0x74,
+  0x96, 0x15, 0x12, 0x27, 0xb4, 0x13, 0x2f, 0x45, 0xe2, 0xa0, 0x7a, 0x19, 0xea, 0xaa, 0xc5, 0x5e,
+  0xdb, 0xed, 0x45, 0x7b, 0xb1, 0x73, 0x65, 0xca, 0x8d, 0x30, 0x92, 0x9a, 0x3a, 0x15, 0x4e, 0xd2,
+  0xd0, 0x88, 0x0d, 0x69, 0x43, 0x93, 0x58, 0x55, 0x93, 0xec, 0x6f, 0x52, 0x25, 0x4c, 0x0c, 0x28,
+  0xd1, 0x65, 0xa9, 0x9c, 0x93, 0x29, 0xa9, 0x15, 0x29, 0x67, 0xe9, 0xea, 0xfd, 0xd9, 0xf8, 0xe0,
+  0xd9, 0x11, 0x95, 0xc2, 0x25, 0xb9, 0xb4, 0x01, 0xdd, 0xca, 0xda, 0xc1, 0x80, 0x44, 0x62, 0x9b,
+  0x0c, 0x1c, 0x3f, 0x9a, 0xe1, 0x8f, 0x4a, 0x0b, 0xd9, 0xaa, 0x92, 0x09, 0x64, 0x03, 0xbe, 0xd8,
+  0x2f, 0xfb, 0xf5, 0x8d, 0x72, 0xb9, 0x6e, 0xd8, 0x9d, 0xf1, 0xb9, 0x1a, 0x2d, 0x28, 0x69, 0x4c,
+  0x41, 0xe3, 0xf3, 0x4e, 0xe5, 0xf2, 0xd5, 0xaa, 0xb7, 0x8c, 0x2d, 0xa1, 0x69, 0x67, 0xde, 0x4b,
+  0x9b, 0x0b, 0x68, 0x5d, 0xfe, 0x30, 0xec, 0x7e, 0xd8, 0xa6, 0xa4, 0x47, 0xe7, 0x5a, 0xdc, 0xe2,
+  0x68, 0x9c, 0xcc, 0xc7, 0x47, 0x87, 0xa3, 0xbd, 0x93, 0xbf, 0xbd, 0xfd, 0xf9, 0x71, 0x6c, 0xa6,
+  0x6b, 0x51, 0x34, 0x70, 0x76, 0x06, 0x1f, 0x9e, 0x41, 0x35, 0x0e, 0x66, 0xb9, 0x7b, 0x39, 0x0c,
+  0xe3, 0xa6, 0x88, 0x5b, 0x23, 0xd3, 0x36, 0x33, 0x52, 0x56, 0x6d, 0x8c, 0x53, 0xed, 0x26, 0x57,
+  0x4e, 0xb6, 0x26, 0x8b, 0x37, 0xad, 0x28, 0x8a, 0xe8, 0xeb, 0x50, 0x3e, 0x31, 0xa2, 0xac, 0x97,
+  0xe1, 0x6c, 0xfc, 0x22, 0xfa, 0x71, 0xf4, 0xd3, 0x23, 0x9d, 0x9c, 0xac, 0x54, 0xae, 0x44, 0x53,
+  0x38, 0xf2, 0x1a, 0x2d, 0x00, 0xf0, 0x50, 0xf3, 0x98, 0x58, 0xf8, 0xa2, 0xa2, 0xfe, 0xc7, 0x6a,
+  0x05, 0x5b, 0x7a, 0x89, 0x6f, 0x5b, 0x13, 0x85, 0xed, 0x4d, 0x27, 0xd3, 0x8f, 0x30, 0xe4, 0x26,
+  0x95, 0x85, 0xd8, 0x46, 0x7b, 0x1b, 0xd8, 0xcc, 0x25, 0xa2, 0x69, 0x64, 0x75, 0x8f, 0x8f, 0x4b,
+  0xbd, 0x91, 0x66, 0xac, 0x2b, 0xb2, 0x0e, 0x81, 0x7c, 0xa0, 0xa6, 0xe6, 0x8d, 0x1b, 0x86, 0x48,
+  0xbf, 0xd2, 0x16, 0xc2, 0x3a, 0xf6, 0x30, 0x3a, 0x26, 0x97, 0x4b, 0xf2, 0xb1, 0xe1, 0x34, 0x96,
+  0x8c, 0x12, 0x8a, 0xe5, 0x4a, 0x03, 0x2f, 0x3e, 0x6b, 0xbb, 0xdc, 0x22, 0xff, 0x4e, 0x61, 0xdb,
+  0xe9, 0xee, 0x34, 0x31, 0x69, 0x30, 0xe9, 0x0e, 0x35, 0x55, 0x2a, 0x0d, 0x0d, 0xa0, 0xd8, 0xb8,
+  0xa6, 0x1e, 0x10, 0xe7, 0x93, 0xad, 0x68, 0xec, 0xa3, 0x68, 0x25, 0xba, 0xd0, 0x8d, 0xd9, 0x27,
+  0x23, 0xf4, 0x11, 0xc7, 0xa7, 0x8f, 0x7a, 0x6e, 0xd7, 0x8b, 0xbc, 0x91, 0x88, 0xdc, 0xd3, 0xa3,
+  0xd9, 0x28, 0xb0, 0x90, 0x37, 0x82, 0xb1, 0xdd, 0xc7, 0x32, 0x0c, 0x7c, 0x68, 0xfb, 0x59, 0xd4,
+  0x26, 0x6e, 0x71, 0x2b, 0x8b, 0xb5, 0xaa, 0x86, 0x73, 0x00, 0x6e, 0xcc, 0x9f, 0xd9, 0xee, 0x50,
+  0xd4, 0xde, 0x6d, 0x17, 0x77, 0xc1, 0x76, 0x3f, 0x85, 0x9a, 0xc5, 0x87, 0x0f, 0xef, 0xde, 0xbd,
+  0x7e, 0x1d, 0xd1, 0x90, 0x81, 0xe9, 0x3d, 0xf7, 0x99, 0xa7, 0x24, 0x17, 0x70, 0xb2, 0x08, 0x1e,
+  0x2e, 0x81, 0x0e, 0x08, 0x25, 0x3c, 0x34, 0x0c, 0x6b, 0x9f, 0x1e, 0xef, 0x33, 0xa7, 0x88, 0x4a,
+  0xbd, 0x46, 0xa6, 0xb1, 0xa9, 0xdc, 0xf1, 0x37, 0x0f, 0x70, 0xe2, 0x54, 0x95, 0xe1, 0x48, 0x26,
+  0x71, 0xa9, 0xa1, 0x95, 0x48, 0x11, 0xbc, 0xdc, 0xe8, 0x26, 0xeb, 0x34, 0xc3, 0xd1, 0x7b, 0xf8,
+  0x5e, 0x25, 0xb2, 0x92, 0xfb, 0xb8, 0x58, 0x9e, 0x2d, 0xc3, 0xd8, 0x48, 0x81, 0x93, 0xad, 0x11,
+  0xaa, 0x8a, 0xf5, 0xa6, 0xb5, 0x4d, 0x65, 0x94, 0x95, 0x3c, 0x02, 0x76, 0x3e, 0x7d, 0xf7, 0x17,
+  0xc8, 0xca, 0x82, 0x7a, 0x5d, 0x29, 0xb0, 0x0f, 0x21, 0x66, 0xfd, 0xce, 0x4d, 0xe8, 0x44, 0xdd,
+  0xa6, 0xba, 0x89, 0x0b, 0xd9, 0xe6, 0xba, 0x48, 0xdb, 0x9a, 0x8b, 0x4b, 0xe5, 0x5a, 0x11, 0xf3,
+  0x80, 0xe8, 0x57, 0xba, 0x92, 0xed, 0x23, 0xe0, 0xb7, 0xa9, 0x2a, 0xa3, 0x70, 0x31, 0xfc, 0x0e,
+  0x65, 0xfa, 0x04, 0x22, 0x21, 0xdf, 0x31, 0x39, 0x1a, 0xfd, 0xf4, 0xa4, 0x37, 0x87, 0xb1, 0x84,
+  0xca, 0xd0, 0x03, 0x7a, 0xef, 0xc6, 0xc7, 0x9f, 0x2f, 0x69, 0x08, 0x96, 0x0b, 0xb3, 0x0d, 0xa8,
+  0xd6, 0xc6, 0xd1, 0xe1, 0xc1, 0x7c, 0x06, 0xfa, 0x86, 0xba, 0x4e, 0x74, 0x8a, 0x10, 0xcd, 0x99,
+  0x72, 0xed, 0x01, 0xc8, 0xde, 0x3e, 0x25, 0x36, 0xf5, 0x90, 0x7a, 0x63, 0x9f, 0x91, 0x8f, 0x5b,
+  0x7b, 0x44, 0x1d, 0xf2, 0xa2, 0xd0, 0xca, 0xbf, 0x1a, 0x89, 0x7a, 0x15, 0x85, 0x3d, 0xc0, 0x4b,
+  0x61, 0x6f, 0xa3, 0x90, 0x73, 0x83, 0xea, 0x14, 0xd0, 0x01, 0xc5, 0x5b, 0x87, 0x3c, 0xc6, 0x2a,
+  0x23, 0x59, 0xa5, 0x4a, 0x54, 0x01, 0xcd, 0xee, 0x56, 0xf8, 0xa3, 0xe5, 0x8e, 0xd5, 0x51, 0xb8,
+  0xa3, 0x35, 0xf4, 0x8e, 0x50, 0x7d, 0xbc, 0x12, 0x00, 0x3c, 0x95, 0x77, 0x58, 0xe3, 0xc9, 0x28,
+  0x7a, 0x64, 0x7f, 0x86, 0x1c, 0xd7, 0x34, 0x2c, 0x21, 0xac, 0x12, 0xf0, 0x8c, 0x0e, 0x9e, 0xbe,
+  0x98, 0x00, 0xb0, 0x93, 0xa3, 0x67, 0x93, 0xe7, 0x07, 0x8f, 0xdd, 0xea, 0xbc, 0xc2, 0xad, 0xb3,
+  0xbb, 0xc3, 0x99, 0x47, 0x4f, 0xe8, 0x39, 0x14, 0xf4, 0xb7, 0x24, 0x85, 0x4e, 0x6e, 0xbd, 0xad,
+  0x87, 0xff, 0xb2, 0x35, 0x22, 0xb1, 0x72, 0x40, 0x16, 0x83, 0xc9, 0xbb, 0xe4, 0x25, 0xad, 0x9f,
+  0x33, 0x7a, 0x3d, 0x41, 0x73, 0x80, 0x12, 0x30, 0x96, 0xe8, 0x4f, 0x5b, 0xb8, 0xb4, 0x56, 0x89,
+  0xec, 0x28, 0xdf, 0xdd, 0xac, 0x2c, 0x53, 0xf5, 0x39, 0x1c, 0xd9, 0x56, 0xc9, 0x08, 0xc4, 0x17,
+  0xa0, 0xbb, 0xa5, 0xf0, 0x79, 0x14, 0xce, 0x1e, 0xfc, 0xfb, 0xc3, 0x18, 0x72, 0x55, 0xa3, 0xdb,
+  0x45, 0xde, 0x50, 0xe1, 0xfc, 0x3d, 0xb0, 0x05, 0x69, 0xa0, 0x23, 0x5c, 0xe1, 0xa3, 0x3e, 0x02,
+  0x1d, 0xea, 0x42, 0xc9, 0x7b, 0xe2, 0xff, 0xfe, 0xe7, 0xf5, 0x35, 0xc5, 0x46, 0xdf, 0xc2, 0xd6,
+  0xa1, 0x2c, 0x6b, 0xb7, 0x65, 0xe2, 0xa4, 0xca, 0x0a, 0x60, 0x71, 0xf4, 0x00, 0xaa, 0xe5, 0x5f,
+  0xce, 0x2d, 0x73, 0x6d, 0x5d, 0xb8, 0xe0, 0x18, 0xa1, 0x36, 0xbd, 0xe7, 0x82, 0x74, 0x66, 0xad,
+  0xc2, 0xdd, 0x95, 0x63, 0x99, 0x44, 0x73, 0xa7, 0xf5, 0x9a, 0x19, 0x95, 0xde, 0x12, 0x06, 0x61,
+  0x5f, 0xc2, 0x02, 0x68, 0x77, 0xc0, 0x1e, 0xba, 0x98, 0x2f, 0x82, 0xec, 0x3b, 0xa8, 0x2d, 0xc0,
+  0xef, 0x74, 0xfa, 0xa4, 0x70, 0xc7, 0xbd, 0x0b, 0x4f, 0x32, 0x77, 0x3c, 0xed, 0x8b, 0x2f, 0xa4,
+  0xa3, 0x80, 0x7e, 0xbd, 0xba, 0xf8, 0x63, 0x17, 0x36, 0xfb, 0x7f, 0xc5, 0xa6, 0xc0, 0xc4, 0x82,
+  0x3e, 0x0f, 0xbc, 0xae, 0xc1, 0x62, 0x70, 0xf1, 0x47, 0x7b, 0x71, 0x7e, 0x3e, 0x08, 0x06, 0xb1,
+  0x61, 0x73, 0x2a, 0x69, 0xed, 0x60, 0xe1, 0xab, 0x55, 0x30, 0xe0, 0xda, 0x67, 0x06, 0x8b, 0xcf,
+  0x03, 0x7c, 0x26, 0x93, 0x60, 0x90, 0x75, 0x43, 0xdc, 0x0d, 0x1b, 0x1e, 0xbe, 0x04, 0x03, 0x87,
+  0xbe, 0x6a, 0x15, 0x93, 0x78, 0xb0, 0xb0, 0x12, 0xc9, 0x48, 0xed, 0x97, 0xc7, 0x05, 0x9e, 0xac,
+  0x58, 0x73, 0x65, 0x19, 0xce, 0xfe, 0x23, 0x8c, 0x5d, 0xb5, 0x2f, 0x60, 0x51, 0x95, 0x6c, 0x97,
+  0xa5, 0x3d, 0xe6, 0x8a, 0x56, 0xc8, 0x1e, 0x03, 0x5d, 0xf1, 0x46, 0xde, 0x53, 0x61, 0x6e, 0x7b,
+  0xec, 0xa4, 0x4a, 0x93, 0x2d, 0xa4, 0xac, 0x01, 0x2f, 0xe9, 0x36, 0x5c, 0xc8, 0x76, 0x48, 0x40,
+  0x65, 0x3d, 0xe0, 0x4e, 0x2e, 0x6a, 0x60, 0x6b, 0xd4, 0x25, 0x1e, 0x31, 0x06, 0xaf, 0x00, 0xec,
+  0x8d, 0xe0, 0x77, 0x02, 0x60, 0x0a, 0x43, 0x5c, 0x0e, 0x40, 0x14, 0xba, 0xca, 0x8e, 0x51, 0x1c,
+  0x53, 0xbc, 0x27, 0xd2, 0x06, 0x89, 0x4e, 0xb6, 0x09, 0x34, 0xb3, 0xd4, 0x46, 0xdc, 0xca, 0x71,
+  0x03, 0x0d, 0x35, 0xbb, 0xe0, 0x3d, 0xa3, 0x61, 0xa1, 0x75, 0xed, 0x77, 0x2d, 0xf0, 0x85, 0x4e,
+  0x5a, 0xeb, 0xa2, 0xb0, 0x9d, 0x16, 0xdc, 0x8f, 0x57, 0x02, 0x3f, 0x47, 0xfa, 0x36, 0xb7, 0xeb,
+  0x31, 0xde, 0xbd, 0x6f, 0x76, 0x98, 0xcb, 0x4f, 0xbf, 0xd3, 0xca, 0x74, 0x9c, 0xdf, 0x3e, 0x0c,
+  0xc8, 0xa6, 0xbc, 0xd9, 0xaf, 0x2f, 0xdf, 0xff, 0xcd, 0x4e, 0xcd, 0xc6, 0x87, 0x68, 0x16, 0x01,
+  0x71, 0xcf, 0x00, 0xb3, 0x76, 0x6c, 0x1f, 0xf5, 0xe4, 0xe8, 0xfa, 0x01, 0xdc, 0x46, 0x1b, 0xac,
+  0x73, 0x61, 0xe5, 0xd8, 0xe6, 0x6a, 0xc5, 0xd6, 0xf4, 0xac, 0x82, 0xab, 0x1b, 0x76, 0x11, 0x40,
+  0xf7, 0x6f, 0x00, 0x98, 0x33, 0x9f, 0xce, 0xb9, 0xf4, 0x70, 0x14, 0xb9, 0xbd, 0x60, 0x05, 0x31,
+  0xcc, 0xd9, 0x5f, 0xa5, 0xd3, 0x07, 0x85, 0xda, 0x39, 0xa4, 0x0f, 0x52, 0x95, 0xa8, 0x6d, 0xae,
+  0xdd, 0x7d, 0xbd, 0xeb, 0xdf, 0x90, 0xdc, 0x4d, 0xde, 0x7c, 0x78, 0x33, 0xc6, 0xa3, 0x0b, 0x41,
+  0x49, 0x91, 0xda, 0x77, 0x6f, 0xaf, 0xe1, 0xec, 0xee, 0x3c, 0x82, 0x1d, 0x0b, 0x70, 0xb7, 0xa9,
+  0x03, 0xba, 0xbc, 0xb8, 0xba, 0xe6, 0xd7, 0x98, 0x80, 0xa9, 0x78, 0x26, 0x15, 0xb2, 0x6b, 0x58,
+  0xd6, 0x71, 0xff, 0x46, 0x3f, 0x00, 0x71, 0x2b, 0xe4, 0x42, 0x4e, 0xb2, 0xc9, 0xfe, 0xf1, 0xb5,
+  0xbb, 0x68, 0xf9, 0x8a, 0x81, 0xec, 0xdf, 0x54, 0xb9, 0x73, 0xf5, 0x62, 0xea, 0x91, 0xae, 0x6a,
+  0x0f, 0xf2, 0xdd, 0xa1, 0x63, 0x64, 0x9e, 0xe9, 0x8c, 0x04, 0xa2, 0x6b, 0xf8, 0x3b, 0x8d, 0x5c,
+  0x35, 0x96, 0x17, 0xb8, 0x87, 0x22, 0x8a, 0xf7, 0xae, 0xf9, 0x74, 0xd0, 0x90, 0xa9, 0xc4, 0x80,
+  0xfc, 0x2a, 0x3d, 0xfd, 0x36, 0xc7, 0x36, 0xe3, 0x7a, 0x7a, 0x25, 0x0d, 0x3c, 0x1e, 0x5f, 0x71,
+  0x6e, 0xdf, 0xae, 0xf1, 0xb5, 0x1d, 0x0b, 0x59, 0x54, 0xfa, 0xf9, 0x7d, 0x09, 0x91, 0xce, 0xa8,
+  0x04, 0x32, 0x97, 0x06, 0x15, 0x01, 0xe1, 0xc7, 0x3d, 0x4e, 0xde, 0x39, 0x3e, 0x5a, 0x76, 0x7b,
+  0xdd, 0xd9, 0x29, 0xbf, 0xae, 0xa7, 0xdd, 0x3b, 0x7d, 0xea, 0x5f, 0xfb, 0xff, 0x00, 0xaa, 0x4b,
+  0x73, 0xe5, 0xf4, 0x0b, 0x00, 0x00,
+};
+
+// info.html: 3299 bytes, 1298 gzipped
+#define WEB_INFO_ETAG "\"67b9d2e9e1ee7cab\""
+static const uint8_t WEB_INFO[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x9d, 0x57, 0x51, 0x73, 0xdb, 0x36,
+  0x0c, 0xfe, 0x2b, 0x1c, 0x77, 0x3d, 0x4b, 0x97, 0xd4, 0x72, 0xb2, 0x26, 0x0f, 0xb1, 0x65, 0x5f,
+  0xb6, 0xb6, 0x4b, 0x76, 0xc9, 0xd2, 0xab, 0xdd, 0xbb, 0xdd, 0xed, 0xf6, 0x40, 0x5b, 0xb0, 0xc5,
+  0x96, 0x22, 0x35, 0x92, 0xb2, 0xe3, 0xa5, 0xfe, 0xef, 0x03, 0x49, 0x39, 0x96, 0x1d, 0xa5, 0xe9,
+  0xf6, 0x90, 0x84, 0x02, 0xf0, 0x01, 0x20, 0x04, 0x7c, 0x50, 0x06, 0xb9, 0x2d, 0xc4, 0x70, 0x90,
+  0x03, 0xcb, 0x86, 0x03, 0xcb, 0xad, 0x80, 0xe1, 0xa5, 0x94, 0xec, 0x8a, 0xc9, 0x6c, 0x90, 0x84,
+  0xe7, 0x81, 0x99, 0x69, 0x5e, 0x5a, 0x62, 0xd7, 0x25, 0xa4, 0xd4, 0xc2, 0xbd, 0x4d, 0x3e, 0xb3,
+  0x25, 0x0b, 0x52, 0x3a, 0x9c, 0x57, 0x72, 0x66, 0xb9, 0x92, 0x84, 0xcb, 0xa5, 0xfa, 0x02, 0x51,
+  0xa5, 0x45, 0xfc, 0xb0, 0x64, 0x9a, 0xdc, 0xe7, 0x9a, 0xa4, 0x44, 0xc2, 0x8a, 0xfc, 0x71, 0x7b,
+  0x73, 0x65, 0x6d, 0xf9, 0x11, 0xfe, 0xae, 0xc0, 0xd8, 0x28, 0xee, 0xa3, 0xaa, 0xab, 0x4a, 0x90,
+  0x11, 0xfd, 0xf5, 0xdd, 0x84, 0x1e, 0x13, 0xc4, 0x1c, 0x13, 0xab, 0x2b, 0x08, 0x2a, 0x03, 0x32,
+  0x8b, 0x64, 0x25, 0x44, 0xdc, 0xdf, 0xf4, 0x1f, 0xfd, 0x1b, 0xb0, 0x11, 0xcf, 0x8e, 0x49, 0xa9,
+  0x11, 0xaa, 0xed, 0xfa, 0x98, 0x2c, 0x99, 0x40, 0xc8, 0x03, 0x9f, 0x93, 0xc8, 0x1f, 0xc9, 0x0f,
+  0x69, 0x4a, 0x2a, 0x99, 0xc1, 0x9c, 0x4b, 0xc8, 0x62, 0x92, 0xa9, 0x59, 0x55, 0x80, 0xb4, 0xdd,
+  0x05, 0xd8, 0x77, 0x02, 0xdc, 0xf1, 0xe7, 0xf5, 0x75, 0x86, 0x5e, 0xe2, 0x3f, 0xb7, 0x5e, 0xfe,
+  0xc2, 0x1c, 0x3d, 0xb8, 0x19, 0x8a, 0x95, 0xa5, 0x58, 0x47, 0x6a, 0xfa, 0x39, 0xdc, 0x44, 0xf0,
+  0x45, 0x6e, 0x0d, 0x1a, 0xa2, 0xa4, 0x5b, 0x3f, 0x7c, 0xfd, 0x4a, 0x1e, 0x36, 0x7d, 0x97, 0x13,
+  0x35, 0x86, 0x67, 0x78, 0x09, 0xca, 0xa5, 0x04, 0x7d, 0x35, 0xb9, 0xbd, 0xc1, 0x07, 0x67, 0xe9,
+  0xe4, 0x71, 0x30, 0xd1, 0x78, 0x6e, 0x33, 0x71, 0xf2, 0xda, 0x84, 0x97, 0x6d, 0x06, 0xbc, 0xac,
+  0xd5, 0x05, 0x9b, 0xb5, 0xe9, 0x51, 0x1c, 0xf7, 0x5d, 0x01, 0x42, 0x5a, 0xdd, 0x69, 0x25, 0xa6,
+  0xb1, 0x2f, 0x15, 0x75, 0x47, 0x07, 0xf1, 0xb7, 0xc3, 0x43, 0xc3, 0xa2, 0x1b, 0x2a, 0xd7, 0x04,
+  0xde, 0xe8, 0xc5, 0x74, 0x55, 0x23, 0x83, 0xe8, 0x30, 0x5c, 0xd3, 0xb0, 0xc5, 0xc1, 0x2a, 0xe7,
+  0x16, 0x6a, 0x07, 0xfe, 0xdc, 0x12, 0xdb, 0xcb, 0x5b, 0xb0, 0xe8, 0xb2, 0x46, 0xe2, 0xa9, 0x05,
+  0x87, 0xd2, 0x26, 0xca, 0x57, 0x0e, 0xa6, 0x4a, 0xd9, 0x09, 0x2f, 0x40, 0x1f, 0xbe, 0xf6, 0xe0,
+  0xc8, 0xeb, 0x5b, 0x6b, 0xbe, 0x43, 0x0e, 0x7b, 0x23, 0x4a, 0x5e, 0x13, 0x7a, 0x74, 0x20, 0xbf,
+  0xa0, 0x34, 0xee, 0xbb, 0x37, 0x5f, 0xd5, 0x2f, 0xbd, 0x2a, 0x33, 0x66, 0xc1, 0x07, 0xaf, 0xea,
+  0x00, 0x41, 0x74, 0x18, 0x20, 0xaa, 0xba, 0xc6, 0xa2, 0x3c, 0x4d, 0x29, 0xcf, 0x04, 0xd0, 0x11,
+  0xa5, 0x17, 0x21, 0x44, 0xad, 0x38, 0x6a, 0x58, 0x68, 0x98, 0x01, 0x5f, 0x72, 0xb9, 0x40, 0x33,
+  0x6f, 0x81, 0x4d, 0xb9, 0xd0, 0x60, 0x8c, 0x37, 0xe2, 0xff, 0xc0, 0x88, 0x26, 0x1e, 0x88, 0x47,
+  0x97, 0x92, 0xfb, 0x71, 0x2a, 0xd0, 0x5a, 0xe9, 0x11, 0xbd, 0xf0, 0x18, 0xff, 0xe0, 0x34, 0x5e,
+  0xe5, 0xae, 0x80, 0x9e, 0xa5, 0xd2, 0x05, 0x13, 0x8f, 0xd1, 0x79, 0xc1, 0x16, 0xe0, 0xad, 0x9d,
+  0x3e, 0xde, 0x55, 0x51, 0x59, 0xd6, 0x5a, 0x3d, 0x94, 0xb7, 0x95, 0x0e, 0xc5, 0xe8, 0xdc, 0x0d,
+  0x2a, 0xf5, 0x85, 0xbb, 0x93, 0x24, 0xa2, 0x47, 0xb7, 0xcc, 0xe6, 0x5d, 0xad, 0xd0, 0xc7, 0xd6,
+  0xa7, 0x2f, 0x62, 0x72, 0xde, 0x8b, 0x8f, 0x68, 0xc1, 0x65, 0x1c, 0x92, 0xb8, 0x9b, 0xcf, 0xe9,
+  0xde, 0x40, 0x87, 0x0a, 0x46, 0xff, 0x99, 0x2d, 0x68, 0xe2, 0x0a, 0x58, 0xb9, 0x06, 0xdd, 0x71,
+  0x86, 0x92, 0x42, 0xb1, 0x0c, 0x5d, 0x3c, 0xba, 0x8f, 0xb0, 0x1b, 0x3d, 0x37, 0x38, 0xb5, 0x46,
+  0x82, 0x5b, 0x8f, 0x5d, 0xdd, 0x49, 0x8a, 0xf7, 0x7d, 0xd3, 0x50, 0x05, 0x67, 0x5e, 0x7c, 0xda,
+  0xeb, 0xa1, 0x22, 0x4c, 0xff, 0x6f, 0xe3, 0xbb, 0xdf, 0xbb, 0x25, 0xd3, 0x06, 0x6a, 0x07, 0xa6,
+  0x54, 0xd2, 0xc0, 0x04, 0xf9, 0x0f, 0x0b, 0xb8, 0xd9, 0x6c, 0x9e, 0x52, 0x95, 0xf3, 0xb8, 0xe2,
+  0x32, 0x53, 0xab, 0xee, 0xbb, 0x25, 0x92, 0xcd, 0x58, 0x55, 0x7a, 0xe6, 0xb2, 0x70, 0xd7, 0x6a,
+  0x48, 0x22, 0x9a, 0x80, 0x7b, 0x32, 0x34, 0xc6, 0xbc, 0x0b, 0x7c, 0xe1, 0xee, 0xf5, 0x1c, 0xa6,
+  0x4e, 0x9e, 0xe4, 0x01, 0x5d, 0x2c, 0x18, 0xc3, 0xe8, 0x64, 0xd3, 0xdf, 0x80, 0x30, 0x40, 0x1e,
+  0xb6, 0x35, 0x74, 0x24, 0x71, 0x2d, 0x2d, 0x68, 0x1c, 0x93, 0x28, 0x08, 0x8f, 0xc9, 0x49, 0x0f,
+  0xef, 0xd3, 0xdf, 0x0c, 0x92, 0xc0, 0xd5, 0xc3, 0x41, 0x12, 0x78, 0x7e, 0xaa, 0xb2, 0x35, 0x72,
+  0xfe, 0xc9, 0x8e, 0xea, 0x4d, 0xc9, 0x90, 0xc0, 0xb3, 0x94, 0x2e, 0x41, 0x1b, 0xcc, 0x80, 0x0e,
+  0x91, 0x52, 0x4f, 0xba, 0xbd, 0x93, 0x18, 0xc1, 0xa8, 0x73, 0xd0, 0x13, 0x5c, 0x10, 0x6c, 0x2a,
+  0x80, 0x18, 0xbb, 0x16, 0xb8, 0x09, 0x72, 0x70, 0xc3, 0x79, 0x41, 0xce, 0x7b, 0xe5, 0x7d, 0x9f,
+  0x92, 0x15, 0xcf, 0x6c, 0x9e, 0x52, 0x8c, 0xf9, 0x8a, 0xa2, 0x65, 0x88, 0x61, 0x35, 0xfe, 0x64,
+  0x5b, 0x84, 0x37, 0xb9, 0x20, 0x67, 0xbd, 0x57, 0x7d, 0x34, 0xf1, 0x31, 0x67, 0x82, 0x19, 0x83,
+  0xb3, 0x22, 0xe7, 0x8a, 0x0e, 0xc7, 0xe3, 0xeb, 0xb7, 0x17, 0x64, 0x1b, 0xf1, 0x31, 0x27, 0xcf,
+  0xaf, 0xc3, 0xad, 0x78, 0xaa, 0x93, 0x36, 0xec, 0x47, 0x04, 0xb7, 0x60, 0x3d, 0xf1, 0xbe, 0x84,
+  0xbd, 0xfe, 0xd0, 0x82, 0x44, 0x3e, 0x7e, 0x09, 0x77, 0x7b, 0xf9, 0x4b, 0x0b, 0xd0, 0x31, 0xf5,
+  0x4b, 0xc8, 0x1b, 0xcf, 0x6b, 0x2d, 0xe0, 0x9a, 0x7a, 0x1f, 0xf1, 0x5c, 0x96, 0xd5, 0x76, 0xf5,
+  0x6a, 0x26, 0x17, 0x40, 0xbd, 0x99, 0xe7, 0x76, 0x82, 0xb3, 0x95, 0xd2, 0x1e, 0xfe, 0x65, 0xf7,
+  0x29, 0x3d, 0x3d, 0x3b, 0xa3, 0x44, 0xc9, 0x59, 0xee, 0xac, 0x5c, 0x1c, 0xbf, 0x8d, 0x3b, 0x89,
+  0xf7, 0x38, 0x72, 0x80, 0xb4, 0x73, 0x64, 0x73, 0x6e, 0x6a, 0x26, 0xa5, 0xc9, 0xbe, 0xf7, 0x99,
+  0x12, 0x4a, 0x07, 0xef, 0x8e, 0x84, 0x9f, 0x77, 0x85, 0xda, 0x3d, 0x4f, 0x38, 0x1a, 0xa5, 0x60,
+  0xd8, 0xd5, 0x9d, 0x1f, 0x3b, 0xc7, 0x9d, 0x57, 0xa7, 0x3f, 0x75, 0xe2, 0x27, 0xce, 0x1b, 0xa9,
+  0x87, 0xdd, 0xf0, 0x34, 0xf7, 0xe4, 0xf9, 0x88, 0x1e, 0x72, 0x90, 0xfd, 0x70, 0xc0, 0xb6, 0x25,
+  0x15, 0x5c, 0x7e, 0xa1, 0x24, 0xd7, 0x30, 0x4f, 0xa9, 0xcf, 0x5b, 0xf0, 0xd9, 0x97, 0x86, 0x13,
+  0xa4, 0x36, 0x56, 0x09, 0x3b, 0x62, 0x42, 0xa4, 0xb3, 0x4a, 0x6b, 0x9c, 0xbc, 0x4e, 0xdc, 0xd7,
+  0x60, 0x2b, 0x2d, 0xc9, 0x9c, 0xe1, 0x1c, 0x61, 0x3b, 0xde, 0x42, 0xa1, 0x34, 0xf2, 0xec, 0x20,
+  0x61, 0x58, 0x7c, 0x9b, 0xb9, 0x5f, 0xfa, 0xdb, 0x0d, 0xfc, 0xdd, 0x09, 0x84, 0x5b, 0xb8, 0xf0,
+  0x56, 0x2d, 0x16, 0x02, 0x9e, 0x46, 0x9f, 0x78, 0x39, 0x09, 0x6d, 0x11, 0x52, 0x68, 0xf4, 0xcf,
+  0x77, 0x07, 0x0a, 0x2b, 0xec, 0xa9, 0xfb, 0x8f, 0x5e, 0x4e, 0xde, 0xc2, 0x92, 0xcf, 0xc2, 0x0d,
+  0x77, 0x03, 0x12, 0xf6, 0xe4, 0xff, 0x0e, 0x88, 0xbc, 0xd3, 0x16, 0x0f, 0xc5, 0xcd, 0x70, 0x6d,
+  0x5e, 0xbf, 0xe1, 0x16, 0x57, 0xc8, 0x88, 0x79, 0x2a, 0x7c, 0xa9, 0x62, 0x77, 0x93, 0xcb, 0xfd,
+  0xfb, 0xb8, 0xcd, 0xb5, 0x7f, 0x99, 0x39, 0xee, 0x42, 0xaf, 0xaa, 0xca, 0x85, 0x66, 0x19, 0xbc,
+  0xc7, 0x67, 0xec, 0x3b, 0xb0, 0xb9, 0x42, 0x61, 0xa9, 0x8c, 0xa5, 0x04, 0x90, 0x78, 0x7d, 0xa3,
+  0x16, 0xd8, 0x28, 0x1c, 0xd9, 0xd6, 0x26, 0x0e, 0xf6, 0xda, 0xf1, 0x2d, 0x25, 0x75, 0x2a, 0x34,
+  0xa9, 0x77, 0x3e, 0x66, 0x6c, 0xaa, 0x69, 0xc1, 0x2d, 0xee, 0x42, 0xd7, 0x92, 0xb5, 0xbe, 0x53,
+  0xeb, 0x47, 0x26, 0x67, 0xa7, 0x67, 0xe7, 0xd8, 0xb0, 0xcf, 0x7d, 0x80, 0x76, 0xea, 0x54, 0xae,
+  0x98, 0xc9, 0x3b, 0x71, 0x3d, 0x46, 0x56, 0xf3, 0x22, 0x8a, 0x0f, 0x88, 0x31, 0xb8, 0xa6, 0xc3,
+  0x4f, 0x01, 0x40, 0xde, 0x73, 0x5d, 0xac, 0x98, 0x86, 0x1d, 0x75, 0x34, 0xc7, 0x6c, 0xce, 0xf1,
+  0x93, 0x83, 0x48, 0x56, 0xd4, 0xe7, 0x89, 0xfa, 0x54, 0xba, 0xb5, 0x48, 0xf7, 0xee, 0xef, 0x8d,
+  0x0e, 0x06, 0xd4, 0x7d, 0xd6, 0xef, 0x59, 0xb9, 0xd4, 0x28, 0x71, 0x5f, 0x1e, 0x29, 0x3d, 0x7f,
+  0x43, 0x89, 0x1f, 0xf1, 0x5c, 0x89, 0x0c, 0x74, 0x4a, 0xc7, 0x57, 0x97, 0xaf, 0xf1, 0x86, 0x87,
+  0x53, 0x1e, 0x8a, 0x42, 0xc3, 0xf7, 0x74, 0x4a, 0xeb, 0x9c, 0xf7, 0xdc, 0x8e, 0x83, 0x09, 0x02,
+  0x7d, 0x81, 0x1b, 0x2f, 0xae, 0xae, 0xed, 0xfe, 0xbb, 0xdb, 0x0d, 0x62, 0x52, 0x6f, 0x94, 0xc4,
+  0xef, 0x20, 0xd7, 0x4c, 0xa1, 0x7d, 0x70, 0xa5, 0x09, 0x64, 0xea, 0xcb, 0x0f, 0xd7, 0xe4, 0x93,
+  0x5b, 0xa3, 0x61, 0x78, 0x6a, 0x5b, 0xff, 0xcf, 0xcd, 0xbf, 0xf6, 0x14, 0xc3, 0x74, 0xe3, 0x0c,
+  0x00, 0x00,
+};
+
+#endif
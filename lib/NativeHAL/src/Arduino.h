@@ -0,0 +1,148 @@
+// Host (native) replacement for the ESP8266 Arduino core - only what AnnaHand uses.
+// Time is virtual: millis()/micros() only move forward through delay(), yield() or HAL::advance().
+
+#ifndef NATIVE_HAL_ARDUINO_H
+#define NATIVE_HAL_ARDUINO_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "WString.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT             0x00
+#define INPUT_PULLUP      0x02
+#define INPUT_PULLDOWN_16 0x04
+#define OUTPUT            0x01
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define IRAM_ATTR
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) (((p) < 16) ? (p) : NOT_AN_INTERRUPT)
+
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+#define PWMRANGE 1023
+#define F_CPU 80000000L
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+#define microsecondsToClockCycles(a) ((a) * clockCyclesPerMicrosecond())
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+void analogWriteFreq(uint32_t freq);
+void analogWriteRange(uint32_t range);
+
+class HardwareSerial
+{
+  public:
+    void begin(unsigned long) {}
+    void setDebugOutput(bool) {}
+    size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+    size_t println(const char *s) { return print(s) + print("\n"); }
+    size_t printf(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+  public:
+    void restart();
+    uint32_t getChipId();                    // 0x00C0FFEE + HAL::device()
+    uint32_t getSketchSize();
+    uint32_t getFreeSketchSpace();
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);    // 128 blocks of 4 bytes
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize() { return getFreeHeap(); }   // the host heap does not fragment
+    uint8_t getHeapFragmentation() { return 0; }
+};
+extern EspClass ESP;
+
+// Simulation controls, not part of the Arduino API.
+namespace HAL
+{
+  const uint32_t SKETCH_SIZE = 0x5A3C0;    // bytes - the sketch running at power-on, see flash_hal.h;
+                                           // ESP.getSketchSize() follows the images eboot installs
+  struct Restart {};
+  void restartThrows(bool enable);         // ESP.restart() throws HAL::Restart instead of exiting
+  void startClock(uint64_t ms);            // before anything ran: start at ms, e.g. right before the millis() rollover
+  void advance(unsigned long ms);          // move the virtual clock, firing due events
+  void realTime(bool enable);              // advance() also waits as long, for real peers (a broker on the host)
+  bool heard(unsigned long sent);          // a frame sent to the station at millis() 'sent' is received by now
+  void at(unsigned long ms, std::function<void()> event);   // run event when millis() reaches ms
+  unsigned long events();                  // number of events (timer callbacks...) fired so far
+  void setInput(uint8_t pin, int value);   // drive a pin read back by digitalRead(), runs its interrupt handler
+  int pwm(uint8_t pin);                    // duty of a pin (0..PWMRANGE): analogWrite(), digitalWrite() or waveform
+  unsigned long pwmWrites();               // number of writes so far
+  unsigned long pwmChangedAt(uint8_t pin); // millis() of the last write changing the duty
+
+  // Group simulation: spawn() forks a device running the sketch, setup() then loop() forever,
+  // booting at millis() 'boot' of this process with a clock running 'ppm' parts per million fast.
+  // This process, device 0, runs them in turn on its own virtual clock through advance(): their
+  // datagrams are routed (multicast to every other device, unicast to 127.0.0.<device + 1>)
+  // and delivered at their next wake-up, their PWM changes are recorded.
+  struct PwmChange {
+    unsigned long time;                    // millis() of device 0
+    uint8_t pin;
+    int value;
+  };
+  int device();                            // index of the device in its process, 0 if not spawned
+  int spawn(unsigned long boot, long ppm, void (*setup)(), void (*loop)());   // index of the device
+  void stop(int device);                   // power a spawned device off
+  const std::vector<PwmChange>& pwmTrace(int device);   // device 0: while recordPwm() is on
+  void recordPwm(bool enable);             // record the PWM changes of this device, from none
+
+  struct HeapStats {
+    unsigned long allocations;             // calls to new / malloc / realloc
+    unsigned long frees;
+    size_t inUse;                          // bytes currently allocated
+    size_t highWater;                      // max of inUse
+  };
+  const HeapStats& heap();
+  void resetHeapHighWater();
+}
+
+#endif
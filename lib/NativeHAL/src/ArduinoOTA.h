@@ -0,0 +1,72 @@
+// Host replacement for ArduinoOTA: accepts the configuration, and upload() plays an espota
+// transfer through the callbacks and the Updater like ArduinoOTAClass::_runUpdate().
+
+#ifndef NATIVE_HAL_ARDUINOOTA_H
+#define NATIVE_HAL_ARDUINOOTA_H
+
+#include "ESP8266WiFi.h"
+#include "Updater.h"
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass
+{
+  public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+    typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+    ~ArduinoOTAClass() { if (s_instance == this) s_instance = nullptr; }
+    void setHostname(const char *) {}
+    void setPasswordHash(const char *) {}
+    void onStart(THandlerFunction fn) { m_start = fn; }
+    void onEnd(THandlerFunction fn) { m_end = fn; }
+    void onError(THandlerFunction_Error fn) { m_error = fn; }
+    void onProgress(THandlerFunction_Progress fn) { m_progress = fn; }
+    void begin() { s_instance = this; }
+    void handle() {}
+
+    // simulation only
+    static ArduinoOTAClass *simulated() { return s_instance; }   // the last one begun, if alive
+    // espota sending the first 'sent' bytes of 'image' (the MD5 check is not modelled), then
+    // the restart on success
+    void upload(const std::string &image, size_t sent = std::string::npos)
+    {
+      if (m_start) m_start();
+      if (!Update.begin(image.size())) {
+        if (m_error) m_error(OTA_BEGIN_ERROR);
+        return;
+      }
+      sent = std::min(sent, image.size());
+      for (size_t offset = 0; offset < sent;) {
+        size_t count = std::min(sent - offset, size_t(1460));
+        if (Update.write((uint8_t *)image.data() + offset, count) != count) break;
+        offset += count;
+        if (m_progress) m_progress(offset, image.size());
+      }
+      if (!Update.end()) {
+        if (m_error) m_error(OTA_END_ERROR);
+        return;
+      }
+      if (m_end) m_end();
+      ESP.restart();
+    }
+
+  protected:
+    static ArduinoOTAClass *s_instance;
+    THandlerFunction m_start, m_end;
+    THandlerFunction_Error m_error;
+    THandlerFunction_Progress m_progress;
+};
+
+#ifndef NO_GLOBAL_ARDUINOOTA
+extern ArduinoOTAClass ArduinoOTA;
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+// Host replacement for the ESP8266 EEPROM emulation: a RAM sector that starts erased (0xFF).
+
+#ifndef NATIVE_HAL_EEPROM_H
+#define NATIVE_HAL_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass
+{
+  public:
+    enum { SECTOR_SIZE = 4096 };
+    EEPROMClass() { memset(m_flash, 0xFF, sizeof(m_flash)); }
+    void begin(size_t size);
+    uint8_t read(int address) { return (address >= 0 && size_t(address) < m_size) ? m_data[address] : 0; }
+    void write(int address, uint8_t value);
+    bool commit();
+    void end();
+
+    template<typename T>
+    T &get(int address, T &t)
+    {
+      if (address >= 0 && address + sizeof(T) <= m_size) memcpy(&t, m_data + address, sizeof(T));
+      return t;
+    }
+    template<typename T>
+    const T &put(int address, const T &t)
+    {
+      if (address >= 0 && address + sizeof(T) <= m_size) {
+        memcpy(m_data + address, &t, sizeof(T));
+        m_dirty = true;
+      }
+      return t;
+    }
+
+    unsigned long commits() const { return m_commits; }   // simulation only
+
+  protected:
+    uint8_t m_flash[SECTOR_SIZE];
+    uint8_t m_data[SECTOR_SIZE];
+    size_t m_size = 0;
+    bool m_dirty = false;
+    unsigned long m_commits = 0;
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,330 @@
+#include "ESP8266WebServer.h"
+#include "HALHeap.h"
+
+#include <chrono>
+#include <strings.h>
+
+static const String s_empty;
+
+ESP8266WebServer *ESP8266WebServer::s_instance = nullptr;
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static String urlDecode(const char *begin, const char *end)
+{
+  std::string decoded;
+  for (const char *p = begin; p < end; ++p) {
+    if (*p == '+') decoded += ' ';
+    else if (*p == '%' && p + 2 < end && hexValue(p[1]) >= 0 && hexValue(p[2]) >= 0) {
+      decoded += char(hexValue(p[1]) * 16 + hexValue(p[2]));
+      p += 2;
+    }
+    else decoded += *p;
+  }
+  return String(decoded.c_str());
+}
+
+void ESP8266WebServer::on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn)
+{
+  m_handlers.push_back(Handler{ uri, method, fn, ufn });
+}
+
+std::string ESP8266WebServer::requestText(const char *uriAndQuery, HTTPMethod method, const std::string &body,
+                                          const std::string &headers)
+{
+  static const char *methods[] = { "GET", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS" };
+  std::string text = std::string(methods[method]) + " " + uriAndQuery + " HTTP/1.1\r\nHost: native\r\n" + headers;
+  if (!body.empty()) text += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+  return text + "\r\n" + body;
+}
+
+WiFiClient ESP8266WebServer::request(const char *uriAndQuery, HTTPMethod method, const std::string &uploadBody,
+                                     const std::string &headers)
+{
+  HALHeap::Untracked untracked;
+  WiFiClient client = WiFiClient::open();
+  client.connection()->incoming = requestText(uriAndQuery, method, uploadBody, headers);
+  _server.connect(client);
+  m_requests.push_back(client);
+  return client;
+}
+
+void ESP8266WebServer::request(WiFiClient &client, const char *uriAndQuery, HTTPMethod method, const std::string &uploadBody,
+                               const std::string &headers)
+{
+  HALHeap::Untracked untracked;
+  client.connection()->incoming += requestText(uriAndQuery, method, uploadBody, headers);
+  client.connection()->opened = millis();
+  client.connection()->answered = false;
+  m_requests.push_back(client);
+}
+
+WiFiClient ESP8266WebServer::stalledRequest(const char *uriAndQuery, size_t sent, HTTPMethod method, const std::string &uploadBody)
+{
+  HALHeap::Untracked untracked;
+  WiFiClient client = WiFiClient::open();
+  client.connection()->incoming = requestText(uriAndQuery, method, uploadBody, std::string()).substr(0, sent);
+  _server.connect(client);
+  m_requests.push_back(client);
+  return client;
+}
+
+size_t ESP8266WebServer::pending()
+{
+  HALHeap::Untracked untracked;
+  m_requests.erase(std::remove_if(m_requests.begin(), m_requests.end(), [](const WiFiClient &client) {
+    return client.connection()->answered || !client.connection()->open;
+  }), m_requests.end());
+  return m_requests.size();
+}
+
+// The whole request has been received: split into its head (without the blank line) and body
+bool ESP8266WebServer::complete(std::string &head, std::string &body)
+{
+  HALHeap::Untracked untracked;
+  const WiFiClient::Connection &connection = *_currentClient.connection();
+  size_t end = connection.incoming.find("\r\n\r\n", connection.consumed);
+  if (end == std::string::npos) return false;
+  head = connection.incoming.substr(connection.consumed, end - connection.consumed);
+  size_t length = 0, field = head.find("Content-Length: ");
+  if (field != std::string::npos) length = strtoul(head.c_str() + field + 16, NULL, 10);
+  if (connection.incoming.size() < end + 4 + length) return false;
+  body = connection.incoming.substr(end + 4, length);
+  return true;
+}
+
+void ESP8266WebServer::drop()
+{
+  HALHeap::Untracked untracked;
+  _currentClient.stop();
+  _currentClient = WiFiClient();
+  _currentStatus = HC_NONE;
+}
+
+void ESP8266WebServer::handleClient()
+{
+  if (_currentStatus == HC_NONE) {
+    if (!_server.hasClient()) return;
+    _currentClient = _server.accept();
+    _currentStatus = HC_WAIT_READ;
+    _statusChange = millis();
+  }
+  // while the core keeps a connection waiting it yields, which lets (virtual) time pass
+  if (_currentStatus == HC_WAIT_CLOSE) {
+    // the response is sent, the connection is released when the peer closes it
+    if (!_currentClient.connected() || millis() - _statusChange > HTTP_MAX_CLOSE_WAIT) {
+      HALHeap::Untracked untracked;
+      _currentClient = WiFiClient();
+      _currentStatus = HC_NONE;
+    }
+    else delay(1);
+    return;
+  }
+  if (!_currentClient.available()) {
+    if (!_currentClient.connected() || millis() - _statusChange > HTTP_MAX_DATA_WAIT) drop();
+    else delay(1);
+    return;
+  }
+  // the core reads the request with a stream timeout, the loop is blocked meanwhile
+  std::string head, body;
+  unsigned long start = millis();
+  while (!complete(head, body)) {
+    if (millis() - start >= HTTP_MAX_DATA_WAIT) {
+      drop();
+      return;
+    }
+    delay(1);
+  }
+  {
+    HALHeap::Untracked untracked;
+    _currentClient.connection()->consumed += head.size() + 4 + body.size();
+    _currentClient.connection()->answered = true;
+    m_latencies.push_back(millis() - _currentClient.connection()->opened);
+  }
+  dispatch(head, body);
+  {
+    HALHeap::Untracked untracked;
+    m_response.body += _currentClient.connection()->stream;
+    bool kept = head.find("\r\nConnection: keep-alive") != std::string::npos &&
+                m_response.headers.find("Connection: keep-alive\r\n") != std::string::npos;
+    if (m_finished && !kept) _currentClient.connection()->open = false;
+    if (_currentClient.connected()) {
+      _currentStatus = HC_WAIT_CLOSE;
+      _statusChange = millis();
+    }
+    else {
+      _currentClient = WiFiClient();
+      _currentStatus = HC_NONE;
+    }
+  }
+  if (m_onResponse) m_onResponse(m_response);
+}
+
+void ESP8266WebServer::parseArgs(const char *query)
+{
+  m_args.clear();
+  while (query && *query) {
+    const char *end = strchr(query, '&');
+    if (!end) end = query + strlen(query);
+    const char *equal = (const char *)memchr(query, '=', end - query);
+    if (equal) m_args.push_back(Arg{ urlDecode(query, equal), urlDecode(equal + 1, end) });
+    else if (end > query) m_args.push_back(Arg{ urlDecode(query, end), String() });
+    query = *end ? end + 1 : end;
+  }
+}
+
+void ESP8266WebServer::dispatch(const std::string &head, const std::string &body)
+{
+  {
+    HALHeap::Untracked untracked;
+    size_t space = head.find(' '), target = space + 1, targetEnd = head.find(' ', target);
+    std::string method = head.substr(0, space), uri = head.substr(target, targetEnd - target);
+    size_t question = uri.find('?');
+    m_uri = uri.substr(0, question).c_str();
+    m_method = method == "POST" ? HTTP_POST : method == "HEAD" ? HTTP_HEAD : HTTP_GET;
+    parseArgs(question == std::string::npos ? nullptr : uri.c_str() + question + 1);
+    for (Arg &header : m_headers) header.value = String();
+    for (size_t line = head.find("\r\n"); line != std::string::npos && line < head.size();) {
+      line += 2;
+      size_t end = head.find("\r\n", line), colon = head.find(':', line);
+      if (end == std::string::npos) end = head.size();
+      if (colon < end) {
+        String name(head.substr(line, colon - line).c_str());
+        size_t value = head.find_first_not_of(' ', colon + 1);
+        for (Arg &header : m_headers) {
+          if (strcasecmp(header.key.c_str(), name.c_str()) == 0) header.value = head.substr(value, end - value).c_str();
+        }
+      }
+      line = end;
+    }
+    m_response = Response();
+    m_pendingHeaders.clear();
+    _contentLength = CONTENT_LENGTH_NOT_SET;
+    m_finished = false;
+  }
+
+  // only the handlers (sketch code) are accounted in HAL::heap() and handlerTimes()
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  invoke(body);
+  double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  HALHeap::Untracked untracked;
+  m_handlerTimes.push_back(elapsed);
+}
+
+void ESP8266WebServer::invoke(const std::string &body)
+{
+  for (Handler &handler : m_handlers) {
+    if (handler.uri != m_uri || (handler.method != HTTP_ANY && handler.method != m_method)) continue;
+    if (handler.ufn && m_method == HTTP_POST) {
+      m_upload.filename = "firmware.bin";
+      m_upload.totalSize = 0;
+      m_upload.currentSize = 0;
+      m_upload.status = UPLOAD_FILE_START;
+      handler.ufn();
+      for (size_t offset = 0; offset < body.size(); offset += HTTP_UPLOAD_BUFLEN) {
+        m_upload.currentSize = std::min(body.size() - offset, size_t(HTTP_UPLOAD_BUFLEN));
+        memcpy(m_upload.buf, body.data() + offset, m_upload.currentSize);
+        m_upload.totalSize += m_upload.currentSize;
+        m_upload.status = UPLOAD_FILE_WRITE;
+        handler.ufn();
+      }
+      m_upload.status = UPLOAD_FILE_END;
+      handler.ufn();
+    }
+    if (handler.fn) handler.fn();
+    return;
+  }
+  HALHeap::Untracked untracked;
+  send(404, "text/plain", String("Not found: ") + m_uri);
+}
+
+const String &ESP8266WebServer::arg(const String &name) const
+{
+  for (const Arg &a : m_args) {
+    if (a.key == name) return a.value;
+  }
+  return s_empty;
+}
+
+const String &ESP8266WebServer::arg(int i) const
+{
+  return (i >= 0 && size_t(i) < m_args.size()) ? m_args[i].value : s_empty;
+}
+
+const String &ESP8266WebServer::argName(int i) const
+{
+  return (i >= 0 && size_t(i) < m_args.size()) ? m_args[i].key : s_empty;
+}
+
+bool ESP8266WebServer::hasArg(const String &name) const
+{
+  for (const Arg &a : m_args) {
+    if (a.key == name) return true;
+  }
+  return false;
+}
+
+void ESP8266WebServer::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+  HALHeap::Untracked untracked;
+  m_headers.clear();
+  for (size_t i = 0; i < headerKeysCount; ++i) m_headers.push_back(Arg{ headerKeys[i], String() });
+}
+
+const String &ESP8266WebServer::header(const String &name) const
+{
+  for (const Arg &h : m_headers) {
+    if (strcasecmp(h.key.c_str(), name.c_str()) == 0) return h.value;
+  }
+  return s_empty;
+}
+
+bool ESP8266WebServer::hasHeader(const String &name) const
+{
+  return header(name).length() > 0;
+}
+
+void ESP8266WebServer::sendHeader(const String &name, const String &value, bool first)
+{
+  HALHeap::Untracked untracked;
+  std::string line = std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+  if (first) m_pendingHeaders.insert(0, line);
+  else m_pendingHeaders += line;
+}
+
+void ESP8266WebServer::send(int code, const char *content_type, const String &content)
+{
+  HALHeap::Untracked untracked;
+  m_response.code = code;
+  m_response.contentType = content_type ? content_type : "";
+  if (_keepAlive && _server.hasClient()) _keepAlive = false;   // as the core: not with another client waiting
+  m_response.headers = m_pendingHeaders + "Connection: " + (_keepAlive ? "keep-alive" : "close") + "\r\n";
+  m_pendingHeaders.clear();
+  m_finished = _contentLength != CONTENT_LENGTH_UNKNOWN;
+  m_response.body.append(content.c_str(), content.length());
+}
+
+void ESP8266WebServer::send_P(int code, PGM_P content_type, PGM_P content)
+{
+  send_P(code, content_type, content, strlen(content));
+}
+
+void ESP8266WebServer::send_P(int code, PGM_P content_type, PGM_P content, size_t contentLength)
+{
+  HALHeap::Untracked untracked;
+  send(code, content_type, String());
+  m_response.body.append(content, contentLength);
+}
+
+void ESP8266WebServer::sendContent(const char *content, size_t size)
+{
+  HALHeap::Untracked untracked;
+  if (size == 0 && _contentLength == CONTENT_LENGTH_UNKNOWN) m_finished = true;   // last chunk
+  m_response.body.append(content, size);
+}
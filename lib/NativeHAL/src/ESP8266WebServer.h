@@ -0,0 +1,143 @@
+// Host replacement for ESP8266WebServer. Requests are sent by simulated clients with request()
+// and served by handleClient() one connection at a time like the core does: waiting for the first
+// bytes does not block, but the rest of the request is waited for (up to HTTP_MAX_DATA_WAIT) and a
+// connection left open after its response is kept until the peer closes it (up to
+// HTTP_MAX_CLOSE_WAIT). As the core 3 server, responses say Connection: keep-alive after
+// keepAlive(true), unless another client is waiting. The last response is kept for inspection.
+
+#ifndef NATIVE_HAL_ESP8266WEBSERVER_H
+#define NATIVE_HAL_ESP8266WEBSERVER_H
+
+#include <string>
+
+#include "ESP8266WiFi.h"
+#include "Updater.h"
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPClientStatus { HC_NONE, HC_WAIT_READ, HC_WAIT_CLOSE };
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+#define HTTP_UPLOAD_BUFLEN 2048
+#define HTTP_MAX_DATA_WAIT 5000
+#define HTTP_MAX_CLOSE_WAIT 2000
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+#define CONTENT_LENGTH_NOT_SET ((size_t) -2)
+
+struct HTTPUpload
+{
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class ESP8266WebServer
+{
+  public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    struct Response {
+      int code = 0;
+      std::string contentType;
+      std::string headers;
+      std::string body;
+    };
+
+    explicit ESP8266WebServer(int port = 80) : _server(port) { s_instance = this; }
+
+    void begin() {}
+    void handleClient();
+    void on(const String &uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+    void on(const String &uri, HTTPMethod method, THandlerFunction fn) { on(uri, method, fn, THandlerFunction()); }
+    void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
+
+    const String &uri() const { return m_uri; }
+    HTTPMethod method() const { return m_method; }
+    WiFiClient &client() { return _currentClient; }
+    HTTPUpload &upload() { return m_upload; }
+
+    const String &arg(const String &name) const;
+    const String &arg(int i) const;
+    const String &argName(int i) const;
+    int args() const { return int(m_args.size()); }
+    bool hasArg(const String &name) const;
+    void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+    const String &header(const String &name) const;
+    bool hasHeader(const String &name) const;
+
+    void sendHeader(const String &name, const String &value, bool first = false);
+    void setContentLength(size_t contentLength) { _contentLength = contentLength; }
+    void keepAlive(bool keepAlive) { _keepAlive = keepAlive; }
+    void send(int code, const char *content_type = NULL, const String &content = String(""));
+    void send(int code, const String &content_type, const String &content) { send(code, content_type.c_str(), content); }
+    void send(int code, const char *content_type, const char *content, size_t contentLength) { send_P(code, content_type, content, contentLength); }
+    void send_P(int code, PGM_P content_type, PGM_P content);
+    void send_P(int code, PGM_P content_type, PGM_P content, size_t contentLength);
+    void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+    void sendContent(const char *content, size_t size);
+    void sendContent_P(PGM_P content) { sendContent(content, strlen(content)); }
+    void sendContent_P(PGM_P content, size_t size) { sendContent(content, size); }
+
+    // simulation only
+    static ESP8266WebServer &simulated() { return *s_instance; }   // the sketch's server
+    // A client connecting and sending its request now, 'headers' as "Name: value\r\n" lines.
+    // The peer closes the connection once the response is complete (with a length, or its last
+    // chunk), unless both its request and the response said Connection: keep-alive.
+    WiFiClient request(const char *uriAndQuery, HTTPMethod method = HTTP_GET, const std::string &uploadBody = std::string(),
+                       const std::string &headers = std::string());
+    // The next request of a client on the connection it kept
+    void request(WiFiClient &client, const char *uriAndQuery, HTTPMethod method = HTTP_GET,
+                 const std::string &uploadBody = std::string(), const std::string &headers = std::string());
+    // A client sending the first 'sent' bytes of its request, then nothing
+    WiFiClient stalledRequest(const char *uriAndQuery, size_t sent, HTTPMethod method = HTTP_GET,
+                              const std::string &uploadBody = std::string());
+    size_t pending();   // requests neither answered nor dropped
+    const Response &response() const { return m_response; }   // includes what the handler wrote to client()
+    std::vector<unsigned long> &latencies() { return m_latencies; }   // ms from request() to handler, per request
+    std::vector<double> &handlerTimes() { return m_handlerTimes; }     // host us spent in the handler, per request
+    void onResponse(std::function<void(const Response &)> fn) { m_onResponse = fn; }
+
+  protected:
+    struct Handler {
+      String uri;
+      HTTPMethod method;
+      THandlerFunction fn;
+      THandlerFunction ufn;
+    };
+    struct Arg {
+      String key;
+      String value;
+    };
+    static std::string requestText(const char *uriAndQuery, HTTPMethod method, const std::string &body, const std::string &headers);
+    bool complete(std::string &head, std::string &body);
+    void dispatch(const std::string &head, const std::string &body);
+    void invoke(const std::string &body);
+    void drop();
+    void parseArgs(const char *query);
+
+    static ESP8266WebServer *s_instance;
+    WiFiServer _server;
+    WiFiClient _currentClient;
+    HTTPClientStatus _currentStatus = HC_NONE;
+    unsigned long _statusChange = 0;
+    std::vector<Handler> m_handlers;
+    std::vector<WiFiClient> m_requests;   // sent by request(), until answered or closed
+    std::vector<Arg> m_args;
+    std::vector<Arg> m_headers;       // the collected ones only, like the real server
+    String m_uri;
+    HTTPMethod m_method = HTTP_GET;
+    HTTPUpload m_upload;
+    size_t _contentLength = CONTENT_LENGTH_NOT_SET;
+    bool _keepAlive = false;
+    bool m_finished = false;   // the whole response is sent
+    Response m_response;
+    std::string m_pendingHeaders;
+    std::vector<unsigned long> m_latencies;
+    std::vector<double> m_handlerTimes;
+    std::function<void(const Response &)> m_onResponse;
+};
+
+#endif
@@ -0,0 +1,83 @@
+// Host replacement for the ESP8266WiFi station API: associated to a fake AP association() ms after
+// begin() (the saved credentials always work), beacons every 102.4 ms (100 TU) with a DTIM period
+// of 1. The network itself does not depend on the association. The radio starts awake (WIFI_NONE_SLEEP); in modem or
+// light sleep the AP buffers the frames for the station until its next listen beacon, so incoming
+// connections and datagrams wait for it (see HAL::heard()).
+
+#ifndef NATIVE_HAL_ESP8266WIFI_H
+#define NATIVE_HAL_ESP8266WIFI_H
+
+#include <limits.h>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "user_interface.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+#include "WiFiUdp.h"
+
+enum WiFiSleepType_t { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 };
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+enum wl_status_t { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+
+struct WiFiEventStationModeDisconnected
+{
+  String ssid;
+  uint8_t reason;
+};
+typedef std::shared_ptr<std::function<void(const WiFiEventStationModeDisconnected &)>> WiFiEventHandler;
+
+class ESP8266WiFiClass
+{
+  public:
+    WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> fn)
+    {
+      m_disconnected = std::make_shared<std::function<void(const WiFiEventStationModeDisconnected &)>>(fn);
+      return m_disconnected;
+    }
+    void disconnected(uint8_t reason)   // simulation only: the station lost its AP
+    {
+      if (m_disconnected) (*m_disconnected)(WiFiEventStationModeDisconnected{ SSID(), reason });
+    }
+    // simulation only: time the next begin() takes to connect, ULONG_MAX for an unreachable AP
+    void association(unsigned long ms) { m_association = ms; }
+    bool mode(WiFiMode_t mode) { m_mode = mode; return true; }
+    wl_status_t begin()
+    {
+      m_begun = m_association != ULONG_MAX;
+      m_connectAt = millis() + (m_begun ? m_association : 0);
+      return status();
+    }
+    wl_status_t status() const
+    {
+      bool connected = m_begun && int32_t(millis() - m_connectAt) >= 0;
+      return connected ? WL_CONNECTED : WL_DISCONNECTED;
+    }
+    bool isConnected() const { return status() == WL_CONNECTED; }
+    // 'listenInterval': beacons, 1-10, 0 for every DTIM
+    bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0)
+    {
+      if (listenInterval > 10) return false;
+      m_sleep = type;
+      m_listenInterval = type == WIFI_NONE_SLEEP ? 0 : listenInterval;
+      return true;
+    }
+    WiFiSleepType_t getSleepMode() const { return m_sleep; }
+    uint8_t getListenInterval() const { return m_listenInterval; }
+    String SSID() const { return String("native"); }
+    int32_t RSSI() { return -42; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1 + HAL::device()); }
+    String macAddress() { return String("DE:AD:BE:EF:00:01"); }
+    uint8_t *macAddress(uint8_t *mac) { static const uint8_t m[6] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x00, 0x01 }; memcpy(mac, m, 6); return mac; }
+  protected:
+    WiFiEventHandler m_disconnected;
+    WiFiMode_t m_mode = WIFI_STA;
+    unsigned long m_association = 2000;   // ms - WPA2 handshake and DHCP
+    unsigned long m_connectAt = 0;        // millis()
+    bool m_begun = false;                 // and the AP reachable
+    WiFiSleepType_t m_sleep = WIFI_NONE_SLEEP;
+    uint8_t m_listenInterval = 0;
+};
+extern ESP8266WiFiClass WiFi;
+
+#endif
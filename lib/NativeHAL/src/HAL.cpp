@@ -0,0 +1,751 @@
+#include "Arduino.h"
+#include "ArduinoOTA.h"
+#include "EEPROM.h"
+#include "ESP8266WiFi.h"
+#include "Updater.h"
+#include "core_esp8266_waveform.h"
+#include "coredecls.h"
+#include "eboot_command.h"
+#include "flash_hal.h"
+#include "HALHeap.h"
+#include "user_interface.h"
+
+#include <stdarg.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <map>
+#include <new>
+
+HardwareSerial Serial;
+EspClass ESP;
+EEPROMClass EEPROM;
+ESP8266WiFiClass WiFi;
+UpdaterClass Update;
+ArduinoOTAClass *ArduinoOTAClass::s_instance = nullptr;
+
+namespace
+{
+  enum { PIN_COUNT = 17, HEAP_SIZE = 80 * 1024 };
+  uint64_t s_micros = 0;
+  uint64_t s_origin = 0;              // us - where HAL::startClock() started the clock
+  int s_inputs[PIN_COUNT];
+  void (*s_interrupts[PIN_COUNT])(void);
+  int s_interruptModes[PIN_COUNT];
+  int s_pwm[PIN_COUNT];
+  unsigned long s_pwmWrites = 0;
+  unsigned long s_pwmChangedAt[PIN_COUNT];
+  std::multimap<uint64_t, std::function<void()> > s_events;
+  unsigned long s_eventCount = 0;
+  bool s_scheduled = false;           // esp_schedule() called, the loop task wakes up
+  bool s_sleeping = false;            // in esp_delay(): time stops at the event calling esp_schedule()
+  unsigned long s_wakeups = 0;
+  bool s_realTime = false;
+  HAL::HeapStats s_heap;
+
+  int s_untracked = 0;
+
+  // group simulation, see HAL::spawn()
+  struct Message {
+    enum Type : uint8_t { RUN, WAIT, DATAGRAM, PWM } type;
+    uint8_t pin;          // PWM
+    uint16_t port;        // DATAGRAM destination port
+    uint16_t fromPort;
+    uint8_t to[4];        // DATAGRAM addresses
+    uint8_t from[4];
+    int32_t value;        // PWM duty
+    uint64_t time;        // us on the clock of device 0: RUN until, WAIT for
+    uint16_t length;      // DATAGRAM
+    char data[1472];
+  };
+  struct Device {
+    pid_t pid;
+    int channel;                      // socket pair end of device 0
+    uint64_t wake;                    // us on the clock of device 0, UINT64_MAX once off
+    std::vector<Message> inbox;       // datagrams delivered at the next wake-up
+    std::vector<HAL::PwmChange> trace;
+  };
+  std::vector<Device> s_devices;      // in device 0, index 0 unused
+  bool s_recording = false;           // PWM changes of this device, to s_trace
+  std::vector<HAL::PwmChange> s_trace;
+  int s_device = 0;                   // this process
+  int s_channel = -1;                 // in a spawned device, its socket pair end
+  uint64_t s_boot = 0;                // in a spawned device: its boot and drift on the clock of device 0
+  long s_ppm = 0;
+
+  struct Block {
+    size_t size;
+    size_t tracked;    // also keeps the payload 16-byte aligned
+  };
+
+  void track(Block *block, size_t size)
+  {
+    block->size = size;
+    block->tracked = s_untracked == 0;
+    if (!block->tracked) return;
+    ++s_heap.allocations;
+    s_heap.inUse += size;
+    if (s_heap.inUse > s_heap.highWater) s_heap.highWater = s_heap.inUse;
+  }
+
+  void untrack(Block *block)
+  {
+    if (!block->tracked) return;
+    ++s_heap.frees;
+    s_heap.inUse -= block->size;
+  }
+}
+
+// -- time ------------------------------------------------------------------------------------
+
+namespace
+{
+  // Fire the events due by 'target' (us), then move the clock to it
+  void runUntil(uint64_t target)
+  {
+    while (!s_events.empty() && s_events.begin()->first <= target) {
+      std::function<void()> event;
+      {
+        HALHeap::Untracked untracked;
+        event = s_events.begin()->second;
+        s_micros = std::max(s_micros, s_events.begin()->first);
+        s_events.erase(s_events.begin());
+      }
+      ++s_eventCount;
+      event();
+      if (s_sleeping && s_scheduled) return;
+    }
+    s_micros = std::max(s_micros, target);
+  }
+
+  void deviceWait(uint64_t target);
+  void resume(Device &device);
+  void sendMessage(int channel, const Message &message);
+}
+
+// millis() and micros() are 32-bit on the ESP8266, keep their wrap-around on the host
+unsigned long millis() { return (uint32_t)(s_micros / 1000); }
+unsigned long micros() { return (uint32_t)s_micros; }
+void delay(unsigned long ms)
+{
+  if (s_channel >= 0) deviceWait(s_micros + uint64_t(ms) * 1000);
+  else HAL::advance(ms);
+}
+void yield() {}
+
+void esp_schedule() { s_scheduled = true; }
+
+void esp_delay(unsigned long ms)
+{
+  struct Sleep {
+    Sleep() { s_sleeping = true; }
+    ~Sleep() { s_sleeping = false; }   // also when an event restarts the device
+  };
+  if (!s_scheduled) {
+    Sleep sleep;
+    delay(ms);
+  }
+  s_scheduled = false;
+  ++s_wakeups;
+}
+
+unsigned long HAL::wakeups() { return s_wakeups; }
+
+void HAL::advance(unsigned long ms)
+{
+  uint64_t start = s_micros, target = start + uint64_t(ms) * 1000;
+  // spawned devices run in turn with the events of this one, earliest first; a sleeping loop task
+  // woken by esp_schedule() stops there
+  while (!(s_sleeping && s_scheduled)) {
+    Device *next = nullptr;
+    for (size_t i = 1; i < s_devices.size(); ++i) {
+      if (s_devices[i].wake <= target && (!next || s_devices[i].wake < next->wake)) next = &s_devices[i];
+    }
+    if (!next) {
+      runUntil(target);
+      break;
+    }
+    runUntil(next->wake);
+    if (!(s_sleeping && s_scheduled)) resume(*next);
+  }
+  if (s_realTime) usleep(s_micros - start);
+}
+
+void HAL::realTime(bool enable) { s_realTime = enable; }
+
+// Asleep, the station listens at one beacon of every listen interval, counted from where the clock
+// started: the same instants from boot wherever that is
+bool HAL::heard(unsigned long sent)
+{
+  if (WiFi.getSleepMode() == WIFI_NONE_SLEEP) return true;
+  uint64_t period = std::max<uint64_t>(1, WiFi.getListenInterval()) * 102400;   // us
+  uint64_t frame = s_micros - uint64_t((uint32_t)(millis() - sent)) * 1000;
+  return (s_micros - s_origin) / period > (frame - s_origin) / period;
+}
+
+void HAL::startClock(uint64_t ms) { s_origin = s_micros = ms * 1000; }
+
+unsigned long HAL::events() { return s_eventCount; }
+
+void HAL::at(unsigned long ms, std::function<void()> event)
+{
+  // ms is a (wrapping) millis() value, convert it back to the 64-bit clock
+  HALHeap::Untracked untracked;
+  uint64_t when = s_micros + uint64_t((uint32_t)(ms - millis())) * 1000;
+  s_events.insert(std::make_pair(when - s_micros % 1000, event));
+}
+
+// -- pins ------------------------------------------------------------------------------------
+
+namespace
+{
+  // Output of a pin as a duty, whichever way it was written
+  void setDuty(uint8_t pin, int val)
+  {
+    ++s_pwmWrites;
+    if (pin >= PIN_COUNT || s_pwm[pin] == val) return;
+    s_pwm[pin] = val;
+    s_pwmChangedAt[pin] = millis();
+    if (s_recording) {
+      HALHeap::Untracked untracked;
+      s_trace.push_back(HAL::PwmChange{ millis(), pin, val });
+    }
+    if (s_channel < 0) return;
+    Message change;
+    change.type = Message::PWM;
+    change.pin = pin;
+    change.value = val;
+    sendMessage(s_channel, change);
+  }
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t val) { setDuty(pin, val ? PWMRANGE : 0); }
+int digitalRead(uint8_t pin) { return pin < PIN_COUNT ? s_inputs[pin] : LOW; }
+void analogWrite(uint8_t pin, int val) { setDuty(pin, val); }
+void analogWriteFreq(uint32_t) {}
+void analogWriteRange(uint32_t) {}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode)
+{
+  // like the ESP8266, GPIO16 has no interrupt
+  if (pin >= 16) return;
+  s_interrupts[pin] = handler;
+  s_interruptModes[pin] = mode;
+}
+void detachInterrupt(uint8_t pin) { if (pin < 16) s_interrupts[pin] = nullptr; }
+
+void HAL::setInput(uint8_t pin, int value)
+{
+  if (pin >= PIN_COUNT) return;
+  int previous = s_inputs[pin];
+  s_inputs[pin] = value;
+  if (!s_interrupts[pin] || (previous != 0) == (value != 0)) return;
+  int edge = value ? RISING : FALLING;
+  if (s_interruptModes[pin] & edge) s_interrupts[pin]();
+}
+int HAL::pwm(uint8_t pin) { return pin < PIN_COUNT ? s_pwm[pin] : 0; }
+
+namespace
+{
+  HAL::Waveform s_waveforms[PIN_COUNT];
+  bool s_phaseLocked = false;
+}
+
+int startWaveformClockCycles(uint8_t pin, uint32_t highCcys, uint32_t lowCcys, uint32_t, int8_t alignPhase, uint32_t phaseOffsetCcys, bool)
+{
+  if (pin >= PIN_COUNT || highCcys + lowCcys == 0) return false;
+  // the default generator has no alignment
+  if (!s_phaseLocked) alignPhase = -1, phaseOffsetCcys = 0;
+  s_waveforms[pin] = HAL::Waveform{ highCcys, lowCcys, alignPhase, phaseOffsetCcys };
+  setDuty(pin, int((uint64_t(highCcys) * PWMRANGE * 2 + highCcys + lowCcys) / (2 * (uint64_t(highCcys) + lowCcys))));
+  return true;
+}
+
+int stopWaveform(uint8_t pin)
+{
+  if (pin >= PIN_COUNT || !s_waveforms[pin].high) return false;
+  s_waveforms[pin] = HAL::Waveform{ 0, 0, -1, 0 };
+  return true;
+}
+
+void enablePhaseLockedWaveform() { s_phaseLocked = true; }
+
+const HAL::Waveform &HAL::waveform(uint8_t pin) { return s_waveforms[pin < PIN_COUNT ? pin : 0]; }
+bool HAL::phaseLocked() { return s_phaseLocked; }
+unsigned long HAL::pwmWrites() { return s_pwmWrites; }
+unsigned long HAL::pwmChangedAt(uint8_t pin) { return pin < PIN_COUNT ? s_pwmChangedAt[pin] : 0; }
+
+// -- system ----------------------------------------------------------------------------------
+
+void system_restore() {}
+
+bool wifi_station_get_config(struct station_config *config)
+{
+  memset(config, 0, sizeof(*config));
+  memcpy(config->ssid, "native", 6);
+  return true;
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int len = vprintf(format, args);
+  va_end(args);
+  return len > 0 ? len : 0;
+}
+
+namespace
+{
+  bool s_restartThrows = false;
+  uint32_t s_sketchSize = HAL::SKETCH_SIZE;   // of the image at offset 0, changed by HAL::bootloader()
+  uint32_t s_rtcMemory[128];               // RTC user memory, blocks 0..31 hold the eboot command
+}
+
+void EspClass::restart()
+{
+  printf("ESP.restart()\n");
+  // the pins are reset, not written: no PWM change
+  std::fill(s_pwm, s_pwm + PIN_COUNT, 0);
+  std::fill(s_waveforms, s_waveforms + PIN_COUNT, HAL::Waveform{ 0, 0, -1, 0 });
+  s_phaseLocked = false;
+  if (s_restartThrows) throw HAL::Restart();
+  exit(0);
+}
+
+void HAL::restartThrows(bool enable) { s_restartThrows = enable; }
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+{
+  if (offset + (size + 3) / 4 > 128 || (size & 3)) return false;
+  memcpy(data, s_rtcMemory + offset, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+{
+  if (offset + (size + 3) / 4 > 128 || (size & 3)) return false;
+  memcpy(s_rtcMemory + offset, data, size);
+  return true;
+}
+
+uint32_t EspClass::getChipId() { return 0x00C0FFEE + s_device; }
+
+uint32_t EspClass::getSketchSize() { return s_sketchSize; }
+
+uint32_t EspClass::getFreeSketchSpace()
+{
+  return FS_PHYS_ADDR - ((s_sketchSize + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1));
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  return s_heap.inUse < HEAP_SIZE ? HEAP_SIZE - s_heap.inUse : 0;
+}
+
+// -- EEPROM ----------------------------------------------------------------------------------
+
+void EEPROMClass::begin(size_t size)
+{
+  m_size = size < SECTOR_SIZE ? size : SECTOR_SIZE;
+  memcpy(m_data, m_flash, m_size);
+  m_dirty = false;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  if (address >= 0 && size_t(address) < m_size) {
+    m_data[address] = value;
+    m_dirty = true;
+  }
+}
+
+bool EEPROMClass::commit()
+{
+  if (!m_size) return false;
+  if (!m_dirty) return true;
+  memcpy(m_flash, m_data, m_size);
+  m_dirty = false;
+  ++m_commits;
+  return true;
+}
+
+void EEPROMClass::end()
+{
+  commit();
+  m_size = 0;
+}
+
+// -- flash -----------------------------------------------------------------------------------
+
+namespace
+{
+  const uint32_t FLASH_CHIP_SIZE = 0x400000;
+  std::vector<uint8_t> s_flash;            // whole chip, allocated on first use
+  unsigned long s_flashWrites = 0;
+  unsigned long s_flashErases = 0;
+  size_t s_flashPowerLoss = SIZE_MAX;
+  bool s_flashPowered = true;
+
+  uint8_t *flash(uint32_t addr, uint32_t size)
+  {
+    if (size > FLASH_CHIP_SIZE || addr > FLASH_CHIP_SIZE - size) return nullptr;
+    if (s_flash.empty()) {
+      HALHeap::Untracked untracked;
+      s_flash.assign(FLASH_CHIP_SIZE, 0xFF);
+      std::string sketch = HAL::sketchImage(1);
+      memcpy(s_flash.data(), sketch.data(), sketch.size());
+    }
+    return s_flash.data() + addr;
+  }
+}
+
+int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst)
+{
+  uint8_t *src = flash(addr, size);
+  if (!src) return FLASH_HAL_READ_ERROR;
+  memcpy(dst, src, size);
+  return FLASH_HAL_OK;
+}
+
+int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src)
+{
+  uint8_t *dst = flash(addr, size);
+  if (!dst || (addr & 3) || (size & 3) || !s_flashPowered) return FLASH_HAL_WRITE_ERROR;
+  ++s_flashWrites;
+  size_t programmed = size < s_flashPowerLoss ? size : s_flashPowerLoss;
+  for (size_t i = 0; i < programmed; ++i) dst[i] &= src[i];
+  if (programmed < size) {
+    s_flashPowerLoss = SIZE_MAX;
+    s_flashPowered = false;
+    return FLASH_HAL_WRITE_ERROR;
+  }
+  return FLASH_HAL_OK;
+}
+
+int32_t flash_hal_erase(uint32_t addr, uint32_t size)
+{
+  uint8_t *dst = flash(addr, size);
+  if (!dst || (addr % FLASH_SECTOR_SIZE) || (size % FLASH_SECTOR_SIZE) || !s_flashPowered) return FLASH_HAL_ERASE_ERROR;
+  memset(dst, 0xFF, size);
+  s_flashErases += size / FLASH_SECTOR_SIZE;
+  return FLASH_HAL_OK;
+}
+
+unsigned long HAL::flashWrites() { return s_flashWrites; }
+unsigned long HAL::flashErases() { return s_flashErases; }
+void HAL::flashPowerLoss(size_t bytes) { s_flashPowerLoss = bytes; }
+void HAL::flashPowerOn() { s_flashPowered = true; }
+
+std::string HAL::sketchImage(uint32_t seed, size_t size)
+{
+  HALHeap::Untracked untracked;
+  std::string image(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    image[i] = char(seed >> 16);
+  }
+  image[0] = char(0xE9);
+  return image;
+}
+
+// -- updater and bootloader ------------------------------------------------------------------
+
+bool UpdaterClass::begin(size_t size)
+{
+  uint32_t sketch = (s_sketchSize + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+  uint32_t rounded = (size + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+  m_running = false;
+  m_error = size == 0 || rounded > FS_PHYS_ADDR - sketch;   // like the core: staged below the FS, above the sketch
+  if (m_error) return false;
+  m_start = FS_PHYS_ADDR - rounded;
+  m_size = size;
+  m_progress = 0;
+  m_running = true;
+  HALHeap::Untracked untracked;
+  m_image.clear();
+  return true;
+}
+
+size_t UpdaterClass::write(uint8_t *data, size_t len)
+{
+  if (!m_running || m_error) return 0;
+  // like the core, the first bytes must be an image header, raw or gzip (inflated by eboot)
+  if (m_progress == 0 && len > 0 && data[0] != 0xE9 && !(len > 1 && data[0] == 0x1F && data[1] == 0x8B)) len = 0;
+  if (len == 0 || m_progress + len > m_size) {
+    m_error = true;
+    m_running = false;
+    return 0;
+  }
+  for (size_t offset = 0; offset < len;) {
+    uint32_t address = m_start + m_progress + offset;
+    if (address % FLASH_SECTOR_SIZE == 0 && flash_hal_erase(address, FLASH_SECTOR_SIZE) != FLASH_HAL_OK) m_error = true;
+    size_t count = std::min(len - offset, size_t(FLASH_SECTOR_SIZE - address % FLASH_SECTOR_SIZE));
+    uint8_t *dst = flash(address, count);
+    for (size_t i = 0; i < count; ++i) dst[i] &= data[offset + i];
+    offset += count;
+  }
+  m_progress += len;
+  HALHeap::Untracked untracked;
+  m_image.append((const char *)data, len);
+  return m_error ? 0 : len;
+}
+
+bool UpdaterClass::end(bool evenIfRemaining)
+{
+  bool finished = m_progress == m_size;
+  m_running = false;
+  if (m_error || (!finished && !evenIfRemaining)) return false;
+  eboot_command command;
+  memset(&command, 0, sizeof(command));
+  command.action = ACTION_COPY_RAW;
+  command.args[0] = m_start;
+  command.args[1] = 0;
+  command.args[2] = m_progress;
+  eboot_command_write(&command);
+  return true;
+}
+
+void eboot_command_write(struct eboot_command *cmd)
+{
+  cmd->magic = EBOOT_MAGIC;
+  cmd->crc32 = 0;
+  memcpy(s_rtcMemory, cmd, sizeof(*cmd));
+}
+
+int eboot_command_read(struct eboot_command *cmd)
+{
+  memcpy(cmd, s_rtcMemory, sizeof(*cmd));
+  return (cmd->magic & EBOOT_MAGIC_MASK) == EBOOT_MAGIC ? 0 : 1;
+}
+
+void eboot_command_clear()
+{
+  std::fill(s_rtcMemory, s_rtcMemory + sizeof(eboot_command) / 4, 0);
+}
+
+bool HAL::bootloader()
+{
+  eboot_command command;
+  if (eboot_command_read(&command) != 0 || command.action != ACTION_COPY_RAW) return false;
+  uint8_t *src = flash(command.args[0], command.args[2]), *dst = flash(command.args[1], command.args[2]);
+  if (src && dst) memmove(dst, src, command.args[2]);
+  if (src && dst && command.args[1] == 0) s_sketchSize = command.args[2];
+  eboot_command_clear();
+  return src && dst;
+}
+
+// -- group simulation ------------------------------------------------------------------------
+
+namespace
+{
+  // A spawned device's clock runs s_ppm fast from s_boot on the clock of device 0
+  uint64_t toLocal(uint64_t time)
+  {
+    return time <= s_boot ? 0 : uint64_t(floorl((long double)(time - s_boot) * (1 + s_ppm * 1e-6L)));
+  }
+  uint64_t toDevice0(uint64_t local)
+  {
+    uint64_t time = s_boot + uint64_t(ceill(local / (1 + s_ppm * 1e-6L)));
+    while (toLocal(time) < local) ++time;
+    return time;
+  }
+
+  bool receive(int channel, Message &message)
+  {
+    return recv(channel, &message, sizeof(message), 0) > 0;
+  }
+
+  void sendMessage(int channel, const Message &message)
+  {
+    size_t length = offsetof(Message, data) + (message.type == Message::DATAGRAM ? message.length : 0);
+    send(channel, &message, length, MSG_NOSIGNAL);
+  }
+
+  IPAddress address(const uint8_t *bytes) { return IPAddress(bytes[0], bytes[1], bytes[2], bytes[3]); }
+
+  void deliver(const Message &message)
+  {
+    WiFiUDP::deliver(address(message.from), message.fromPort, address(message.to), message.port, message.data, message.length);
+  }
+
+  // In a spawned device: sleep until 'target' (local us), device 0 runs the others meanwhile
+  void deviceWait(uint64_t target)
+  {
+    do {
+      uint64_t until = s_events.empty() ? target : std::min(target, s_events.begin()->first);
+      Message message;
+      message.type = Message::WAIT;
+      message.time = toDevice0(until);
+      sendMessage(s_channel, message);
+      for (;;) {
+        if (!receive(s_channel, message)) _exit(0);   // powered off
+        if (message.type == Message::DATAGRAM) deliver(message);
+        if (message.type == Message::RUN) break;
+      }
+      runUntil(std::min(target, toLocal(message.time)));
+    } while (s_micros < target && !(s_sleeping && s_scheduled));
+  }
+
+  // In device 0: datagram 'message' sent by 'from', multicast to every other device, unicast by address
+  void route(int from, const Message &message)
+  {
+    HALHeap::Untracked untracked;
+    bool multicast = (message.to[0] & 0xF0) == 0xE0;
+    for (size_t i = 0; i < s_devices.size(); ++i) {
+      if (int(i) == from || (!multicast && message.to[3] != i + 1)) continue;
+      if (i == 0) deliver(message);
+      else if (s_devices[i].wake != UINT64_MAX) s_devices[i].inbox.push_back(message);
+    }
+  }
+
+  // In device 0: run a spawned device until it waits again
+  void resume(Device &device)
+  {
+    HALHeap::Untracked untracked;
+    int index = int(&device - s_devices.data());
+    for (const Message &message : device.inbox) sendMessage(device.channel, message);
+    device.inbox.clear();
+    Message message;
+    message.type = Message::RUN;
+    message.time = s_micros;
+    sendMessage(device.channel, message);
+    for (;;) {
+      if (!receive(device.channel, message)) {
+        device.wake = UINT64_MAX;
+        return;
+      }
+      if (message.type == Message::WAIT) break;
+      if (message.type == Message::DATAGRAM) route(index, message);
+      if (message.type == Message::PWM) device.trace.push_back(HAL::PwmChange{ millis(), message.pin, int(message.value) });
+    }
+    device.wake = std::max(message.time, s_micros + 1);
+  }
+}
+
+int HAL::device() { return s_device; }
+
+int HAL::spawn(unsigned long boot, long ppm, void (*setupFn)(), void (*loopFn)())
+{
+  HALHeap::Untracked untracked;
+  if (s_devices.empty()) s_devices.resize(1);
+  int channels[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, channels) != 0) return -1;
+  uint64_t bootTime = s_micros + uint64_t((uint32_t)(boot - millis())) * 1000;
+  int index = int(s_devices.size());
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(channels[0]);
+    for (const Device &device : s_devices) {
+      if (device.pid) close(device.channel);
+    }
+    s_devices.clear();
+    s_events.clear();
+    WiFiUDP::stopAll();
+    s_device = index;
+    s_channel = channels[1];
+    s_boot = bootTime;
+    s_ppm = ppm;
+    s_micros = 0;
+    deviceWait(0);
+    setupFn();
+    for (;;) loopFn();
+  }
+  close(channels[1]);
+  Device device;
+  device.pid = pid;
+  device.channel = channels[0];
+  device.wake = bootTime;
+  s_devices.push_back(device);
+  return index;
+}
+
+void HAL::stop(int index)
+{
+  if (index <= 0 || index >= int(s_devices.size()) || !s_devices[index].pid) return;
+  Device &device = s_devices[index];
+  close(device.channel);
+  waitpid(device.pid, nullptr, 0);
+  device.pid = 0;
+  device.wake = UINT64_MAX;
+}
+
+const std::vector<HAL::PwmChange> &HAL::pwmTrace(int index) { return index == 0 ? s_trace : s_devices[index].trace; }
+
+void HAL::recordPwm(bool enable)
+{
+  HALHeap::Untracked untracked;
+  s_recording = enable;
+  if (enable) s_trace.clear();
+}
+
+bool HAL::send(IPAddress to, uint16_t port, uint16_t fromPort, const std::string &data)
+{
+  IPAddress self = WiFi.localIP();
+  if ((s_channel < 0 && s_devices.empty()) || to == self) {
+    return false;
+  }
+  Message message;
+  message.type = Message::DATAGRAM;
+  message.port = port;
+  message.fromPort = fromPort;
+  for (int i = 0; i < 4; ++i) {
+    message.to[i] = to[i];
+    message.from[i] = self[i];
+  }
+  message.length = uint16_t(std::min(data.size(), sizeof(message.data)));
+  memcpy(message.data, data.data(), message.length);
+  if (s_channel >= 0) sendMessage(s_channel, message);
+  else route(0, message);
+  return true;
+}
+
+// -- heap ------------------------------------------------------------------------------------
+
+const HAL::HeapStats &HAL::heap() { return s_heap; }
+void HAL::resetHeapHighWater() { s_heap.highWater = s_heap.inUse; }
+
+HALHeap::Untracked::Untracked() { ++s_untracked; }
+HALHeap::Untracked::~Untracked() { --s_untracked; }
+
+void *HALHeap::malloc(size_t size)
+{
+  Block *block = static_cast<Block *>(::malloc(sizeof(Block) + size));
+  if (!block) return nullptr;
+  track(block, size);
+  return block + 1;
+}
+
+void *HALHeap::realloc(void *ptr, size_t size)
+{
+  if (!ptr) return HALHeap::malloc(size);
+  Block *block = static_cast<Block *>(ptr) - 1;
+  untrack(block);
+  block = static_cast<Block *>(::realloc(block, sizeof(Block) + size));
+  if (!block) return nullptr;
+  track(block, size);
+  return block + 1;
+}
+
+void HALHeap::free(void *ptr)
+{
+  if (!ptr) return;
+  Block *block = static_cast<Block *>(ptr) - 1;
+  untrack(block);
+  ::free(block);
+}
+
+void *operator new(size_t size)
+{
+  void *ptr = HALHeap::malloc(size);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { HALHeap::free(ptr); }
+void operator delete[](void *ptr) noexcept { HALHeap::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { HALHeap::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { HALHeap::free(ptr); }
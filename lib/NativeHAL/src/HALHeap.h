@@ -0,0 +1,22 @@
+// Tracked heap used by the host String and the global operator new (see HAL::heap()).
+
+#ifndef NATIVE_HAL_HEAP_H
+#define NATIVE_HAL_HEAP_H
+
+#include <stddef.h>
+
+namespace HALHeap
+{
+  void *malloc(size_t size);
+  void *realloc(void *ptr, size_t size);
+  void free(void *ptr);
+
+  // Allocations made while an Untracked guard is alive belong to the simulator itself
+  // and are left out of HAL::heap().
+  struct Untracked {
+    Untracked();
+    ~Untracked();
+  };
+}
+
+#endif
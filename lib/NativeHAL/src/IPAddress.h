@@ -0,0 +1,25 @@
+#ifndef NATIVE_HAL_IPADDRESS_H
+#define NATIVE_HAL_IPADDRESS_H
+
+#include "Arduino.h"
+#include "lwip/ip_addr.h"
+
+class IPAddress
+{
+  public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : m_bytes{ a, b, c, d } {}
+    IPAddress(const ip_addr_t *from) { memcpy(m_bytes, &from->addr, 4); }
+    bool isSet() const { return m_bytes[0] || m_bytes[1] || m_bytes[2] || m_bytes[3]; }
+    uint8_t operator [](int index) const { return m_bytes[index]; }
+    bool operator ==(const IPAddress &other) const { return memcmp(m_bytes, other.m_bytes, 4) == 0; }
+    String toString() const
+    {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", m_bytes[0], m_bytes[1], m_bytes[2], m_bytes[3]);
+      return String(buf);
+    }
+  protected:
+    uint8_t m_bytes[4];
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "Ticker.h"
+#include "HALHeap.h"
+
+#include <chrono>
+#include <map>
+
+namespace
+{
+  std::map<uint32_t, Ticker::Timing> &timings()
+  {
+    static std::map<uint32_t, Ticker::Timing> periods;
+    return periods;
+  }
+}
+
+void Ticker::attach_ms(uint32_t milliseconds, callback_function_t callback)
+{
+  detach();
+  m_callback = callback;
+  m_period = milliseconds;
+  m_repeat = true;
+  m_active = true;
+  schedule(m_generation);
+}
+
+void Ticker::once_ms(uint32_t milliseconds, callback_function_t callback)
+{
+  detach();
+  m_callback = callback;
+  m_period = milliseconds;
+  m_repeat = false;
+  m_active = true;
+  schedule(m_generation);
+}
+
+void Ticker::schedule(unsigned generation)
+{
+  HAL::at(millis() + m_period, [this, generation]() {
+    if (generation != m_generation) return;   // detached or re-armed since
+    if (m_repeat) schedule(generation);
+    else m_active = false;
+    uint32_t period = m_period;   // the callback may re-arm the ticker
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_callback();
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    HALHeap::Untracked untracked;
+    Timing &timing = timings()[period];
+    ++timing.calls;
+    timing.micros += elapsed;
+  });
+}
+
+Ticker::Timing Ticker::timing(uint32_t milliseconds)
+{
+  HALHeap::Untracked untracked;
+  return timings()[milliseconds];
+}
@@ -0,0 +1,36 @@
+// Host replacement for the ESP8266 Ticker: periodic callbacks on the virtual clock.
+
+#ifndef NATIVE_HAL_TICKER_H
+#define NATIVE_HAL_TICKER_H
+
+#include "Arduino.h"
+
+class Ticker
+{
+  public:
+    typedef std::function<void(void)> callback_function_t;
+
+    ~Ticker() { detach(); }
+    void attach_ms(uint32_t milliseconds, callback_function_t callback);
+    void once_ms(uint32_t milliseconds, callback_function_t callback);
+    void detach() { ++m_generation; m_active = false; }
+    bool active() const { return m_active; }
+
+    // simulation only: callbacks of the tickers of a period so far, and the host time spent in them
+    struct Timing {
+      unsigned long calls;
+      double micros;
+    };
+    static Timing timing(uint32_t milliseconds);
+
+  protected:
+    void schedule(unsigned generation);
+
+    callback_function_t m_callback;
+    uint32_t m_period = 0;
+    bool m_repeat = false;
+    bool m_active = false;
+    unsigned m_generation = 0;
+};
+
+#endif
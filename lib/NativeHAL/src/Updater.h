@@ -0,0 +1,34 @@
+// Host replacement for the ESP8266 Updater: stages the image in the simulated flash like the core
+// (at the end of the free space, below the FS region) and leaves an eboot copy command on end().
+// The MD5 check of the core is not modelled.
+
+#ifndef NATIVE_HAL_UPDATER_H
+#define NATIVE_HAL_UPDATER_H
+
+#include "Arduino.h"
+#include <string>
+
+class UpdaterClass
+{
+  public:
+    bool begin(size_t size);
+    size_t write(uint8_t *data, size_t len);
+    bool end(bool evenIfRemaining = false);
+    bool hasError() { return m_error; }
+    bool isRunning() { return m_running; }
+    size_t progress() { return m_progress; }
+    size_t size() { return m_size; }
+    void printError(HardwareSerial &out) { out.printf("Update error\n"); }
+
+    const std::string &image() const { return m_image; }   // simulation only: the bytes written
+  protected:
+    std::string m_image;
+    uint32_t m_start = 0;
+    size_t m_size = 0;
+    size_t m_progress = 0;
+    bool m_error = false;
+    bool m_running = false;
+};
+extern UpdaterClass Update;
+
+#endif
@@ -0,0 +1,286 @@
+#include "WString.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HALHeap.h"
+
+String::String(const char *cstr)
+{
+  if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(const String &str)
+{
+  copy(str.buffer(), str.m_len);
+}
+
+String::String(String &&rval)
+{
+  move(rval);
+}
+
+String::String(StringSumHelper &&rval)
+{
+  move(rval);
+}
+
+String::String(const __FlashStringHelper *str)
+{
+  const char *cstr = reinterpret_cast<const char *>(str);
+  if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(char c)
+{
+  copy(&c, 1);
+}
+
+static void formatNumber(char *buf, size_t size, unsigned long value, bool negative, unsigned char base)
+{
+  char tmp[8 * sizeof(unsigned long) + 2];
+  char *p = tmp + sizeof(tmp) - 1;
+  *p = '\0';
+  do {
+    unsigned digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value);
+  if (negative) *--p = '-';
+  snprintf(buf, size, "%s", p);
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long)value, base) {}
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base)
+{
+  char buf[8 * sizeof(long) + 2];
+  // like the ESP8266 core, only base 10 prints a sign
+  if (base == 10 && value < 0) formatNumber(buf, sizeof(buf), -(unsigned long)value, true, base);
+  else formatNumber(buf, sizeof(buf), (unsigned long)value, false, base);
+  copy(buf, strlen(buf));
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+  char buf[8 * sizeof(unsigned long) + 2];
+  formatNumber(buf, sizeof(buf), value, false, base);
+  copy(buf, strlen(buf));
+}
+
+String::~String()
+{
+  invalidate();
+}
+
+void String::invalidate()
+{
+  if (m_heap) HALHeap::free(m_heap);
+  m_heap = nullptr;
+  m_capacity = SSO_SIZE - 1;
+  m_len = 0;
+  m_sso[0] = '\0';
+}
+
+bool String::reserve(unsigned int size)
+{
+  if (size <= m_capacity) return true;
+  return changeBuffer(size);
+}
+
+bool String::changeBuffer(unsigned int maxStrLen)
+{
+  if (maxStrLen < SSO_SIZE) {
+    if (m_heap) {
+      memcpy(m_sso, m_heap, m_len + 1);
+      HALHeap::free(m_heap);
+      m_heap = nullptr;
+    }
+    m_capacity = SSO_SIZE - 1;
+    return true;
+  }
+  char *buf = static_cast<char *>(HALHeap::realloc(m_heap, maxStrLen + 1));
+  if (!buf) return false;
+  if (!m_heap) memcpy(buf, m_sso, m_len + 1);
+  m_heap = buf;
+  m_capacity = maxStrLen;
+  return true;
+}
+
+String &String::copy(const char *cstr, unsigned int length)
+{
+  if (!reserve(length)) {
+    invalidate();
+    return *this;
+  }
+  memmove(wbuffer(), cstr, length);
+  m_len = length;
+  wbuffer()[m_len] = '\0';
+  return *this;
+}
+
+void String::move(String &rhs)
+{
+  invalidate();
+  if (rhs.m_heap) {
+    m_heap = rhs.m_heap;
+    m_capacity = rhs.m_capacity;
+    rhs.m_heap = nullptr;
+  }
+  else {
+    memcpy(m_sso, rhs.m_sso, SSO_SIZE);
+  }
+  m_len = rhs.m_len;
+  rhs.invalidate();
+}
+
+String &String::operator =(const String &rhs)
+{
+  if (this != &rhs) copy(rhs.buffer(), rhs.m_len);
+  return *this;
+}
+
+String &String::operator =(const char *cstr)
+{
+  if (cstr) copy(cstr, strlen(cstr));
+  else invalidate();
+  return *this;
+}
+
+String &String::operator =(String &&rval)
+{
+  if (this != &rval) move(rval);
+  return *this;
+}
+
+String &String::operator =(StringSumHelper &&rval)
+{
+  if (this != &rval) move(rval);
+  return *this;
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+  if (!cstr) return false;
+  if (length == 0) return true;
+  unsigned int newlen = m_len + length;
+  if (!reserve(newlen)) return false;
+  memmove(wbuffer() + m_len, cstr, length);
+  m_len = newlen;
+  wbuffer()[m_len] = '\0';
+  return true;
+}
+
+bool String::concat(const char *cstr)
+{
+  return cstr ? concat(cstr, strlen(cstr)) : false;
+}
+
+bool String::concat(int num) { return concat(String(num)); }
+bool String::concat(unsigned int num) { return concat(String(num)); }
+bool String::concat(long num) { return concat(String(num)); }
+bool String::concat(unsigned long num) { return concat(String(num)); }
+
+StringSumHelper &operator +(const StringSumHelper &lhs, const String &rhs)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(rhs);
+  return a;
+}
+
+StringSumHelper &operator +(const StringSumHelper &lhs, const char *cstr)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(cstr);
+  return a;
+}
+
+StringSumHelper &operator +(const StringSumHelper &lhs, char c)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(c);
+  return a;
+}
+
+StringSumHelper &operator +(const StringSumHelper &lhs, int num)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper &operator +(const StringSumHelper &lhs, unsigned int num)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper &operator +(const StringSumHelper &lhs, long num)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper &operator +(const StringSumHelper &lhs, unsigned long num)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(num);
+  return a;
+}
+
+int String::compareTo(const String &s) const
+{
+  return strcmp(buffer(), s.buffer());
+}
+
+bool String::equals(const String &s) const
+{
+  return m_len == s.m_len && memcmp(buffer(), s.buffer(), m_len) == 0;
+}
+
+bool String::equals(const char *cstr) const
+{
+  if (!cstr) return m_len == 0;
+  return strcmp(buffer(), cstr) == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+  return prefix.m_len <= m_len && memcmp(buffer(), prefix.buffer(), prefix.m_len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  return suffix.m_len <= m_len && memcmp(buffer() + m_len - suffix.m_len, suffix.buffer(), suffix.m_len) == 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+  if (fromIndex >= m_len) return -1;
+  const char *p = strchr(buffer() + fromIndex, ch);
+  return p ? int(p - buffer()) : -1;
+}
+
+String String::substring(unsigned int left, unsigned int right) const
+{
+  if (left > right) {
+    unsigned int temp = right;
+    right = left;
+    left = temp;
+  }
+  String out;
+  if (left >= m_len) return out;
+  if (right > m_len) right = m_len;
+  out.copy(buffer() + left, right - left);
+  return out;
+}
+
+long String::toInt() const
+{
+  return atol(buffer());
+}
@@ -0,0 +1,110 @@
+// Host replacement for the ESP8266 core String - same allocation behaviour (exact-size
+// realloc on growth, 11 chars small string optimisation) so heap churn can be measured.
+
+#ifndef NATIVE_HAL_WSTRING_H
+#define NATIVE_HAL_WSTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class __FlashStringHelper;
+class StringSumHelper;
+
+class String
+{
+  public:
+    String(const char *cstr = "");
+    String(const String &str);
+    String(String &&rval);
+    String(StringSumHelper &&rval);
+    String(const __FlashStringHelper *str);
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    ~String();
+
+    String &operator =(const String &rhs);
+    String &operator =(const char *cstr);
+    String &operator =(String &&rval);
+    String &operator =(StringSumHelper &&rval);
+
+    bool reserve(unsigned int size);
+    unsigned int length() const { return m_len; }
+    const char *c_str() const { return buffer(); }
+
+    bool concat(const String &str) { return concat(str.buffer(), str.m_len); }
+    bool concat(const char *cstr);
+    bool concat(const char *cstr, unsigned int length);
+    bool concat(char c) { return concat(&c, 1); }
+    bool concat(int num);
+    bool concat(unsigned int num);
+    bool concat(long num);
+    bool concat(unsigned long num);
+
+    String &operator +=(const String &rhs) { concat(rhs); return *this; }
+    String &operator +=(const char *cstr) { concat(cstr); return *this; }
+    String &operator +=(char c) { concat(c); return *this; }
+    String &operator +=(int num) { concat(num); return *this; }
+    String &operator +=(unsigned int num) { concat(num); return *this; }
+
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, const String &rhs);
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, const char *cstr);
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, char c);
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, int num);
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, unsigned int num);
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, long num);
+    friend StringSumHelper &operator +(const StringSumHelper &lhs, unsigned long num);
+
+    int compareTo(const String &s) const;
+    bool equals(const String &s) const;
+    bool equals(const char *cstr) const;
+    bool operator ==(const String &rhs) const { return equals(rhs); }
+    bool operator ==(const char *cstr) const { return equals(cstr); }
+    bool operator !=(const String &rhs) const { return !equals(rhs); }
+    bool operator !=(const char *cstr) const { return !equals(cstr); }
+    bool startsWith(const String &prefix) const;
+    bool endsWith(const String &suffix) const;
+
+    char charAt(unsigned int index) const { return index < m_len ? buffer()[index] : 0; }
+    char operator [](unsigned int index) const { return charAt(index); }
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, m_len); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+    long toInt() const;
+
+  protected:
+    enum { SSO_SIZE = 12 };
+    const char *buffer() const { return m_heap ? m_heap : m_sso; }
+    char *wbuffer() { return m_heap ? m_heap : m_sso; }
+    bool changeBuffer(unsigned int maxStrLen);
+    void invalidate();
+    void move(String &rhs);
+    String &copy(const char *cstr, unsigned int length);
+
+    char m_sso[SSO_SIZE];
+    char *m_heap = nullptr;
+    unsigned int m_capacity = SSO_SIZE - 1;
+    unsigned int m_len = 0;
+};
+
+class StringSumHelper : public String
+{
+  public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(const char *p) : String(p) {}
+    StringSumHelper(char c) : String(c) {}
+    StringSumHelper(int num) : String(num) {}
+    StringSumHelper(unsigned int num) : String(num) {}
+    StringSumHelper(long num) : String(num) {}
+    StringSumHelper(unsigned long num) : String(num) {}
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "WiFiClient.h"
+#include "lwip/dns.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <map>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::map<uint16_t, WiFiClient::Listener>& listeners()
+{
+  static std::map<uint16_t, WiFiClient::Listener> listeners;
+  return listeners;
+}
+
+WiFiClient::Connection::~Connection()
+{
+  if (socket >= 0) ::close(socket);
+}
+
+void WiFiClient::listen(uint16_t port, Listener listener)
+{
+  HALHeap::Untracked untracked;
+  if (listener) listeners()[port] = listener;
+  else listeners().erase(port);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+  HALHeap::Untracked untracked;
+  stop();
+  m_connection.reset();
+  auto listener = listeners().find(port);
+  if (listener != listeners().end()) {
+    WiFiClient client = open();
+    if (!listener->second(client)) return 0;
+    m_connection = client.m_connection;
+    return 1;
+  }
+
+  // a real server, connected within the timeout (of the host clock, the virtual one does not move)
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  addrinfo hints = {}, *addresses = NULL;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, service, &hints, &addresses) != 0) return 0;
+  int fd = -1;
+  for (addrinfo *address = addresses; address && fd < 0; address = address->ai_next) {
+    fd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) continue;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int error = 0;
+    socklen_t length = sizeof(error);
+    pollfd writable = { fd, POLLOUT, 0 };
+    if ((::connect(fd, address->ai_addr, address->ai_addrlen) != 0 && errno != EINPROGRESS) ||
+        poll(&writable, 1, int(m_timeout)) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) return 0;
+  m_connection = std::make_shared<Connection>();
+  m_connection->opened = millis();
+  m_connection->socket = fd;
+  return 1;
+}
+
+void WiFiClient::stop()
+{
+  if (!m_connection) return;
+  m_connection->open = false;
+  if (m_connection->socket >= 0) {
+    ::close(m_connection->socket);
+    m_connection->socket = -1;
+  }
+}
+
+void WiFiClient::pump()
+{
+  HALHeap::Untracked untracked;
+  Connection &connection = *m_connection;
+  while (connection.sent < connection.stream.size()) {
+    ssize_t sent = ::send(connection.socket, connection.stream.data() + connection.sent, connection.stream.size() - connection.sent,
+                          MSG_NOSIGNAL);
+    if (sent <= 0) break;
+    connection.sent += sent;
+  }
+  char buffer[1024];
+  ssize_t received;
+  while ((received = ::recv(connection.socket, buffer, sizeof(buffer), 0)) > 0) connection.incoming.append(buffer, received);
+  if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    connection.open = false;
+    ::close(connection.socket);
+    connection.socket = -1;
+  }
+}
+
+struct HostName {
+  IPAddress address;
+  unsigned long latency;
+};
+
+static std::map<std::string, HostName>& hostNames()
+{
+  static std::map<std::string, HostName> hostNames;
+  return hostNames;
+}
+
+void HAL::hostName(const char *name, const IPAddress &address, unsigned long latency)
+{
+  HALHeap::Untracked untracked;
+  hostNames()[name] = { address, latency };
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg)
+{
+  HALHeap::Untracked untracked;
+  if (!hostname || !hostname[0] || !addr) return ERR_ARG;
+  in_addr literal;
+  if (inet_pton(AF_INET, hostname, &literal) == 1) {
+    addr->addr = literal.s_addr;
+    return ERR_OK;
+  }
+  HostName answer = { IPAddress(), 4000 };
+  auto known = hostNames().find(hostname);
+  if (known != hostNames().end()) answer = known->second;
+  else {
+    addrinfo hints = {}, *addresses = NULL;
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(hostname, NULL, &hints, &addresses) == 0) {
+      ip_addr_t host = { ((sockaddr_in *)addresses->ai_addr)->sin_addr.s_addr };
+      answer = { IPAddress(&host), 20 };
+      freeaddrinfo(addresses);
+    }
+  }
+  std::string name = hostname;
+  HAL::at(millis() + answer.latency, [name, answer, found, callback_arg]() {
+    ip_addr_t address = { 0 };
+    for (int i = 0; i < 4; ++i) ((uint8_t *)&address.addr)[i] = answer.address[i];
+    found(name.c_str(), answer.address.isSet() ? &address : NULL, callback_arg);
+  });
+  return ERR_INPROGRESS;
+}
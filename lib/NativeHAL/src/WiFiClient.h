@@ -0,0 +1,93 @@
+// Host replacement for WiFiClient. Copies share the same connection, like on the ESP8266;
+// what the peer sent is read from 'incoming', what is written is kept in 'stream' for inspection.
+// connect() reaches a server simulated with listen() on that port, else a real one through a
+// host TCP socket (e.g. a local mosquitto), whose data is moved to and from the same buffers.
+
+#ifndef NATIVE_HAL_WIFICLIENT_H
+#define NATIVE_HAL_WIFICLIENT_H
+
+#include "Arduino.h"
+#include "HALHeap.h"
+#include "IPAddress.h"
+
+class WiFiClient
+{
+  public:
+    struct Connection {
+      std::string incoming;   // received from the peer
+      size_t consumed = 0;    // bytes of incoming already read
+      std::string stream;
+      unsigned long opened = 0;   // millis() when connected, or when the last request was sent on it
+      bool answered = false;  // a request was read from it and handled
+      bool open = true;
+      size_t window = 2920;   // room for writes, reported by availableForWrite()
+      int socket = -1;        // host socket of a real connection
+      size_t sent = 0;        // bytes of stream written to it
+      ~Connection();
+    };
+    // Simulated server: gets each connection to 'port', refuses it by returning false
+    typedef std::function<bool(WiFiClient&)> Listener;
+
+    size_t write(const uint8_t *buf, size_t size)
+    {
+      HALHeap::Untracked untracked;
+      if (!connected()) return 0;
+      m_connection->stream.append((const char *)buf, size);
+      if (m_connection->socket >= 0) pump();
+      return size;
+    }
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    int availableForWrite() { return connected() ? int(m_connection->window) : 0; }
+    int available()
+    {
+      if (m_connection && m_connection->socket >= 0) pump();
+      return m_connection ? int(m_connection->incoming.size() - m_connection->consumed) : 0;
+    }
+    size_t peekBytes(uint8_t *buffer, size_t length)
+    {
+      length = std::min(length, size_t(available()));
+      if (length) memcpy(buffer, m_connection->incoming.data() + m_connection->consumed, length);
+      return length;
+    }
+    int read()
+    {
+      if (available() <= 0) return -1;
+      return (uint8_t)m_connection->incoming[m_connection->consumed++];
+    }
+    uint8_t connected()
+    {
+      if (m_connection && m_connection->socket >= 0) pump();
+      return m_connection && m_connection->open;
+    }
+    void setNoDelay(bool) {}
+    void setTimeout(unsigned long ms) { m_timeout = ms; }
+    int connect(const char *host, uint16_t port);
+    int connect(const IPAddress &ip, uint16_t port)
+    {
+      char host[16];
+      snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+      return connect(host, port);
+    }
+    void stop();
+    explicit operator bool() { return available() || connected(); }
+
+    // simulation only
+    static WiFiClient open()
+    {
+      HALHeap::Untracked untracked;
+      WiFiClient client;
+      client.m_connection = std::make_shared<Connection>();
+      client.m_connection->opened = millis();
+      return client;
+    }
+    std::shared_ptr<Connection> connection() const { return m_connection; }
+    static void listen(uint16_t port, Listener listener);   // an empty listener stops listening
+
+  protected:
+    void pump();   // real connection: sends what was written, receives what arrived
+
+    std::shared_ptr<Connection> m_connection;
+    unsigned long m_timeout = 1000;   // ms
+};
+
+#endif
@@ -0,0 +1,29 @@
+// Host replacement for WiFiManager: the portal serves no one, it only takes its time.
+
+#ifndef NATIVE_HAL_WIFIMANAGER_H
+#define NATIVE_HAL_WIFIMANAGER_H
+
+#include "ESP8266WiFi.h"
+#include "ESP8266WebServer.h"
+
+class WiFiManager
+{
+  public:
+    void setConfigPortalTimeout(unsigned long seconds) { m_timeout = seconds; }
+    // Blocks until the timeout, the tickers running on; true if the station connected meanwhile
+    bool startConfigPortal(const char * /*apName*/, const char * /*apPassword*/ = NULL)
+    {
+      ++portals();
+      delay(m_timeout * 1000);
+      return WiFi.isConnected();
+    }
+    static unsigned long &portals()   // simulation only: portals opened so far
+    {
+      static unsigned long count = 0;
+      return count;
+    }
+  protected:
+    unsigned long m_timeout = 0;   // s
+};
+
+#endif
@@ -0,0 +1,34 @@
+// Host replacement for WiFiServer: connections opened by the simulation wait in a backlog until accepted,
+// and until the radio heard them (see WiFi.setSleepMode()).
+
+#ifndef NATIVE_HAL_WIFISERVER_H
+#define NATIVE_HAL_WIFISERVER_H
+
+#include "WiFiClient.h"
+
+class WiFiServer
+{
+  public:
+    explicit WiFiServer(uint16_t port) : m_port(port) {}
+    bool hasClient() { return !m_backlog.empty() && HAL::heard(m_backlog.front().connection()->opened); }
+    WiFiClient accept()
+    {
+      HALHeap::Untracked untracked;
+      if (!hasClient()) return WiFiClient();
+      WiFiClient client = m_backlog.front();
+      m_backlog.erase(m_backlog.begin());
+      return client;
+    }
+    WiFiClient available() { return accept(); }
+
+    void connect(const WiFiClient &client)   // simulation only
+    {
+      HALHeap::Untracked untracked;
+      m_backlog.push_back(client);
+    }
+  protected:
+    uint16_t m_port;
+    std::vector<WiFiClient> m_backlog;
+};
+
+#endif
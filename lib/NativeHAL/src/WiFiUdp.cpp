@@ -0,0 +1,128 @@
+#include "WiFiUdp.h"
+#include "ESP8266WiFi.h"
+#include "HALHeap.h"
+
+namespace
+{
+  std::vector<WiFiUDP *> &sockets()
+  {
+    static std::vector<WiFiUDP *> bound;
+    return bound;
+  }
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  HALHeap::Untracked untracked;
+  stop();
+  for (WiFiUDP *socket : sockets()) {
+    if (socket->m_port == port) return 0;
+  }
+  m_port = port;
+  sockets().push_back(this);
+  return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress, IPAddress multicast, uint16_t port)
+{
+  if (!begin(port)) return 0;
+  m_group = multicast;
+  return 1;
+}
+
+void WiFiUDP::stop()
+{
+  HALHeap::Untracked untracked;
+  if (m_port == 0) return;
+  sockets().erase(std::remove(sockets().begin(), sockets().end(), this), sockets().end());
+  m_port = 0;
+  m_group = IPAddress();
+  m_received.clear();
+  m_current = Datagram();
+  m_offset = 0;
+}
+
+void WiFiUDP::stopAll()
+{
+  while (!sockets().empty()) sockets().back()->stop();
+}
+
+int WiFiUDP::parsePacket()
+{
+  HALHeap::Untracked untracked;
+  m_current = Datagram();
+  m_offset = 0;
+  if (m_received.empty() || !HAL::heard(m_received.front().sent)) return 0;
+  m_current = std::move(m_received.front());
+  m_received.pop_front();
+  return int(m_current.data.size());
+}
+
+int WiFiUDP::read()
+{
+  if (available() <= 0) return -1;
+  return (uint8_t)m_current.data[m_offset++];
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t length)
+{
+  size_t count = std::min(length, size_t(std::max(0, available())));
+  memcpy(buffer, m_current.data.data() + m_offset, count);
+  m_offset += count;
+  return int(count);
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  HALHeap::Untracked untracked;
+  m_sending.clear();
+  m_destination = port;
+  m_destinationAddress = ip;
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+  HALHeap::Untracked untracked;
+  m_sending.append((const char *)buffer, size);
+  return size;
+}
+
+int WiFiUDP::endPacket()
+{
+  HALHeap::Untracked untracked;
+  // multicast is not looped back to the sender
+  if (HAL::send(m_destinationAddress, m_destination, m_port, m_sending) || (m_destinationAddress[0] & 0xF0) == 0xE0) {
+    m_sending.clear();
+    return 1;
+  }
+  for (WiFiUDP *socket : sockets()) {
+    if (socket->m_port != m_destination) continue;
+    Datagram datagram;
+    datagram.data = m_sending;
+    datagram.from = m_port;
+    datagram.address = WiFi.localIP();
+    socket->m_received.push_back(std::move(datagram));
+    m_sending.clear();
+    return 1;
+  }
+  m_sending.clear();
+  return 0;
+}
+
+bool WiFiUDP::deliver(IPAddress from, uint16_t fromPort, IPAddress to, uint16_t port, const char *data, size_t length)
+{
+  HALHeap::Untracked untracked;
+  bool multicast = (to[0] & 0xF0) == 0xE0, delivered = false;
+  for (WiFiUDP *socket : sockets()) {
+    if (socket->m_port != port || (multicast && !(socket->m_group == to))) continue;
+    Datagram datagram;
+    datagram.data.assign(data, length);
+    datagram.from = fromPort;
+    datagram.address = from;
+    socket->m_received.push_back(std::move(datagram));
+    delivered = true;
+    if (!multicast) break;
+  }
+  return delivered;
+}
@@ -0,0 +1,71 @@
+// Host replacement for WiFiUDP: a loopback network. A datagram sent with beginPacket() /
+// endPacket() is queued on the socket bound to its destination port, whatever the address,
+// and read back with parsePacket() / read() like on the ESP8266. In a group simulation (see
+// HAL::spawn()) a datagram for another device, or for a multicast group, goes to the devices
+// instead: multicast reaches the sockets that joined the group, not the sender. A datagram is
+// read once the radio heard it (see WiFi.setSleepMode()).
+
+#ifndef NATIVE_HAL_WIFIUDP_H
+#define NATIVE_HAL_WIFIUDP_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+#include <deque>
+
+class WiFiUDP
+{
+  public:
+    WiFiUDP() {}
+    WiFiUDP(const WiFiUDP &) = delete;
+    WiFiUDP &operator =(const WiFiUDP &) = delete;
+    ~WiFiUDP() { stop(); }
+
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port);
+    void stop();
+    static void stopAll();
+
+    int parsePacket();           // next datagram, the rest of the current one is dropped
+    int available() const { return int(m_current.data.size() - m_offset); }
+    int read();
+    int read(uint8_t *buffer, size_t length);
+    IPAddress remoteIP() const { return m_current.address; }
+    uint16_t remotePort() const { return m_current.from; }
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl = 1)
+    {
+      return beginPacket(multicastAddress, port);
+    }
+    size_t write(uint8_t byte) { return write(&byte, 1); }
+    size_t write(const uint8_t *buffer, size_t size);
+    int endPacket();             // 0 if no socket is bound to the destination port
+
+    // simulation: a datagram from another device, false if no socket takes it
+    static bool deliver(IPAddress from, uint16_t fromPort, IPAddress to, uint16_t port, const char *data, size_t length);
+
+  protected:
+    struct Datagram {
+      std::string data;
+      uint16_t from = 0;
+      IPAddress address = IPAddress(127, 0, 0, 1);
+      unsigned long sent = millis();
+    };
+    uint16_t m_port = 0;
+    IPAddress m_group;
+    std::deque<Datagram> m_received;
+    Datagram m_current;
+    size_t m_offset = 0;
+    std::string m_sending;
+    uint16_t m_destination = 0;
+    IPAddress m_destinationAddress;
+};
+
+namespace HAL
+{
+  // Datagram for another device of a group simulation, false if it is for this one
+  bool send(IPAddress to, uint16_t port, uint16_t fromPort, const std::string &data);
+}
+
+#endif
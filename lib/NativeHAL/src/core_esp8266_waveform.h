@@ -0,0 +1,29 @@
+// Host replacement for the core waveform generator (core_esp8266_waveform.h of core 3): a waveform
+// is recorded as the duty it makes in PWMRANGE steps (see HAL::pwm()), its timing is kept for
+// inspection. As the core, the phase offsets only apply once enablePhaseLockedWaveform() selected
+// the phase locked generator, until the next restart.
+
+#ifndef NATIVE_HAL_CORE_ESP8266_WAVEFORM_H
+#define NATIVE_HAL_CORE_ESP8266_WAVEFORM_H
+
+#include "Arduino.h"
+
+// Times in CPU cycles; 'alignPhase': pin whose rising edge this one follows by 'phaseOffsetCcys', -1 for none
+int startWaveformClockCycles(uint8_t pin, uint32_t highCcys, uint32_t lowCcys, uint32_t runTimeCcys = 0,
+                             int8_t alignPhase = -1, uint32_t phaseOffsetCcys = 0, bool autoPwm = false);
+int stopWaveform(uint8_t pin);
+void enablePhaseLockedWaveform();
+
+namespace HAL
+{
+  struct Waveform {
+    uint32_t high;       // cycles, 0 when stopped
+    uint32_t low;
+    int8_t align;        // pin, -1 for none
+    uint32_t phase;      // cycles after the rising edge of 'align'
+  };
+  const Waveform &waveform(uint8_t pin);
+  bool phaseLocked();   // enablePhaseLockedWaveform() called since the last restart
+}
+
+#endif
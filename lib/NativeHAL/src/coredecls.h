@@ -0,0 +1,42 @@
+// Host replacement for the ESP8266 core coredecls.h (core 3): the loop task sleeps in esp_delay()
+// until its timeout or until esp_schedule() wakes it up, from an interrupt or a timer callback.
+
+#ifndef NATIVE_HAL_COREDECLS_H
+#define NATIVE_HAL_COREDECLS_H
+
+#include "Arduino.h"
+#include <algorithm>
+
+void esp_schedule();
+void esp_delay(unsigned long ms);   // returns early, at the event that called esp_schedule()
+
+// As the core: true once 'timeout_ms' expired since 'start_ms', else sleeps up to 'intvl_ms'
+inline bool esp_try_delay(const uint32_t start_ms, const uint32_t timeout_ms, const uint32_t intvl_ms)
+{
+  uint32_t expired = millis() - start_ms;
+  if (expired >= timeout_ms) return true;
+  esp_delay(std::min(timeout_ms - expired, intvl_ms));
+  return false;
+}
+
+// Sleep until 'timeout_ms', blocked() checked at each wake-up: every 'intvl_ms' and at esp_schedule()
+template <typename T>
+inline void esp_delay(const uint32_t timeout_ms, T &&blocked, const uint32_t intvl_ms)
+{
+  const uint32_t start_ms = millis();
+  while (!esp_try_delay(start_ms, timeout_ms, intvl_ms) && blocked()) {}
+}
+
+template <typename T>
+inline void esp_delay(const uint32_t timeout_ms, T &&blocked)
+{
+  esp_delay(timeout_ms, blocked, timeout_ms);
+}
+
+// Simulation controls, not part of the core API.
+namespace HAL
+{
+  unsigned long wakeups();   // esp_delay() sleeps ended so far, by their timeout or esp_schedule()
+}
+
+#endif
@@ -0,0 +1,37 @@
+// Host replacement for the ESP8266 core eboot_command.h: the bootloader command kept in the
+// first 32 blocks of RTC user memory, run by HAL::bootloader() as at the next boot.
+
+#ifndef NATIVE_HAL_EBOOT_COMMAND_H
+#define NATIVE_HAL_EBOOT_COMMAND_H
+
+#include <stdint.h>
+
+enum action_t {
+  ACTION_COPY_RAW = 0x00000001,
+  ACTION_LOAD_APP = 0xffffffff
+};
+
+#define EBOOT_MAGIC      0xeb001000
+#define EBOOT_MAGIC_MASK 0xfffff000
+
+struct eboot_command {
+  uint32_t magic;
+  enum action_t action;
+  uint32_t args[29];
+  uint32_t crc32;
+};
+
+int eboot_command_read(struct eboot_command *cmd);
+void eboot_command_write(struct eboot_command *cmd);
+void eboot_command_clear();
+
+// Simulation controls, not part of the core API.
+namespace HAL
+{
+  // Run the pending command like eboot: ACTION_COPY_RAW copies args[2] bytes from args[0] to
+  // args[1] (a gzip image is copied as is, not inflated), a copy to 0 sets ESP.getSketchSize(). False
+  // when there was none.
+  bool bootloader();
+}
+
+#endif
@@ -0,0 +1,38 @@
+// Host replacement for the ESP8266 core flash_hal.h: a 4M1M chip held in RAM with NOR semantics
+// (erase sets a sector to 0xFF, programming can only clear bits). The running sketch,
+// HAL::sketchImage(1), sits at offset 0 and the FS region at FS_PHYS_ADDR.
+
+#ifndef NATIVE_HAL_FLASH_HAL_H
+#define NATIVE_HAL_FLASH_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "Arduino.h"
+
+#define FLASH_SECTOR_SIZE 0x1000
+#define FS_PHYS_ADDR      0x300000
+#define FS_PHYS_SIZE      0xFA000
+
+#define FLASH_HAL_OK          (0)
+#define FLASH_HAL_READ_ERROR  (-1)
+#define FLASH_HAL_WRITE_ERROR (-2)
+#define FLASH_HAL_ERASE_ERROR (-3)
+
+int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst);
+int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src);
+int32_t flash_hal_erase(uint32_t addr, uint32_t size);
+
+// Simulation controls, not part of the core API.
+namespace HAL
+{
+  unsigned long flashWrites();             // flash_hal_write() calls so far
+  unsigned long flashErases();             // sectors erased so far
+  void flashPowerLoss(size_t bytes);       // the next write stops after 'bytes' bytes, then every
+                                           // write and erase fails until flashPowerOn()
+  void flashPowerOn();
+  std::string sketchImage(uint32_t seed, size_t size = SKETCH_SIZE);   // raw image (0xE9) of random bytes
+}
+
+#endif
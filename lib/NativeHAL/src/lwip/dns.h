@@ -0,0 +1,23 @@
+// Host replacement for lwIP's dns.h: an address literal is answered at once, a name through the
+// callback, from the tcpip context, after a simulated lookup (see HAL::hostName) or the host's.
+
+#ifndef NATIVE_HAL_LWIP_DNS_H
+#define NATIVE_HAL_LWIP_DNS_H
+
+#include "lwip/ip_addr.h"
+#include "IPAddress.h"
+
+// 'ipaddr' is NULL when the name could not be resolved
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+// ERR_OK with 'addr' set, or ERR_INPROGRESS and 'found' called later
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg);
+
+namespace HAL
+{
+  // 'name' resolves to 'address', or fails when it is unset, 'latency' ms after the lookup; other
+  // names are resolved by the host and answered after 20 ms, a failure after 4 s as lwIP's retries
+  void hostName(const char *name, const IPAddress &address, unsigned long latency);
+}
+
+#endif
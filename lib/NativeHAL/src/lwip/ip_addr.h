@@ -0,0 +1,17 @@
+// Host replacement for lwIP's ip_addr.h, IPv4 only as the core builds it by default
+
+#ifndef NATIVE_HAL_LWIP_IP_ADDR_H
+#define NATIVE_HAL_LWIP_IP_ADDR_H
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+#define ERR_OK          0
+#define ERR_INPROGRESS -5
+#define ERR_ARG        -16
+
+typedef struct ip_addr {
+  uint32_t addr;   // network byte order
+} ip_addr_t;
+
+#endif
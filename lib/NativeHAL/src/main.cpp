@@ -0,0 +1,1729 @@
+// Host entry point for env:native.
+//
+//   program [bench]      run the benchmark suite (default), exit status 1 if a check FAILED
+//   program group        group mode: devices forked from this process, synchronized by UDP (the
+//                        bench runs it last)
+//   program rollover ms  30 s of random commands from boot with the clock starting at ms, prints the
+//                        PWM changes in ms from boot (the bench compares runs across the millis() rollover)
+//   program serve        read request lines ("/light?all=on", "wait 500"), sensor edges
+//                        ("sensor 1") and UDP datagrams ("udp 0100010000ff", hex) from stdin,
+//                        run loop() until each request is answered and print the responses;
+//                        "realtime" makes the virtual clock keep pace with the host one, for
+//                        real peers such as a local MQTT broker ("/default?mqtt=localhost")
+//   program load [clients [s [seed]]]
+//                        8 automations (by default) hammering /light, /status and /default for 60 s
+//                        of virtual time: throughput, handler time and latency, heap high-water,
+//                        loop() stalls, and the lighting invariants (exit status 1 if broken)
+//   program replay trace the same for a trace in the serve format, e.g. recorded from an access log
+
+#include "Arduino.h"
+#include "ArduinoOTA.h"
+#include "ESP8266WebServer.h"
+#include "WiFiUdp.h"
+#include "EEPROM.h"
+#include "flash_hal.h"
+#include "ColorSpace.h"
+#include "FlashLog.h"
+#include "HALHeap.h"
+#include "Sha256.h"
+#include "Ticker.h"
+#include "core_esp8266_waveform.h"
+#include "coredecls.h"
+#include "eboot_command.h"
+#include "WiFiManager.h"
+#include "lwip/dns.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <limits.h>
+#include <math.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+namespace
+{
+  const uint8_t PIN_BULB = D5;
+  const uint8_t PIN_SENSOR = D0;
+  const uint32_t RAMP_TICK = 10;   // ms
+  const uint16_t UDP_LIGHT_PORT = 4210;
+  const IPAddress SYNC_GROUP(239, 255, 65, 72);
+  ESP8266WebServer *web = nullptr;
+  const char *program = nullptr;
+  unsigned failures = 0;              // checks reported FAILED, for the exit status
+
+  const char *verdict(bool ok)
+  {
+    failures += !ok;
+    return ok ? "ok" : "FAILED";
+  }
+
+  struct Sample {
+    double micros;
+    double allocations;
+  };
+
+  // cost of reading the clock twice, removed from every sample
+  double clockOverhead()
+  {
+    const unsigned iterations = 100000;
+    std::chrono::steady_clock::duration elapsed(0);
+    for (unsigned i = 0; i < iterations; ++i) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      elapsed += std::chrono::steady_clock::now() - start;
+    }
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+  }
+
+  // Run fn() iterations times and report wall-clock cost and heap allocations per call.
+  // prepare() runs before each call and is excluded from both measures.
+  template<typename Prepare, typename Fn>
+  Sample measure(const char *name, unsigned iterations, Prepare prepare, Fn fn)
+  {
+    std::chrono::steady_clock::duration elapsed(0);
+    unsigned long allocations = 0;
+    for (unsigned i = 0; i < iterations; ++i) {
+      prepare();
+      unsigned long before = HAL::heap().allocations;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      fn();
+      elapsed += std::chrono::steady_clock::now() - start;
+      allocations += HAL::heap().allocations - before;
+    }
+    static const double overhead = clockOverhead();
+    Sample sample;
+    sample.micros = std::max(0.0, std::chrono::duration<double, std::micro>(elapsed).count() / iterations - overhead);
+    sample.allocations = double(allocations) / iterations;
+    printf("%-36s %10.3f us/op %8.2f allocs/op\n", name, sample.micros, sample.allocations);
+    return sample;
+  }
+
+  // Host us per call of the 'period' ms tickers since 'since'
+  double tickCost(uint32_t period, const Ticker::Timing &since)
+  {
+    Ticker::Timing now = Ticker::timing(period);
+    return (now.micros - since.micros) / std::max(1UL, now.calls - since.calls);
+  }
+
+  struct Duty {
+    double micros;      // wall-clock us per virtual second
+    double wakeups;     // sleeps ended per virtual second: loop() calls and socket polls
+    double events;      // timer callbacks per virtual second
+  };
+
+  // Run loop() for 100 virtual seconds and report its cost per virtual second
+  template<typename Prepare>
+  Duty duty(const char *name, Prepare prepare)
+  {
+    const unsigned long duration = 100000;
+    std::chrono::steady_clock::duration elapsed(0);
+    unsigned long allocations = 0, start = millis(), events = HAL::events(), wakeups = HAL::wakeups();
+    while (millis() - start < duration) {
+      prepare();
+      unsigned long before = HAL::heap().allocations;
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      loop();
+      elapsed += std::chrono::steady_clock::now() - begin;
+      allocations += HAL::heap().allocations - before;
+    }
+    Duty result;
+    result.micros = std::chrono::duration<double, std::micro>(elapsed).count() * 1000 / duration;
+    result.wakeups = double(HAL::wakeups() - wakeups) * 1000 / duration;
+    result.events = double(HAL::events() - events) * 1000 / duration;
+    printf("%-36s %10.3f us/s  %8.2f allocs/s %8.2f wake-ups/s\n", name, result.micros,
+           double(allocations) * 1000 / duration, result.wakeups);
+    return result;
+  }
+
+  void settle()
+  {
+    for (int i = 0; i < 1000 && web->pending(); ++i) loop();
+  }
+
+  Sample request(const char *name, const char *uri, unsigned iterations = 20000)
+  {
+    return measure(name, iterations, [uri]() { web->request(uri); }, []() { web->handleClient(); });
+  }
+
+  void run(unsigned long duration)
+  {
+    uint32_t start = millis();
+    while (uint32_t(millis() - start) < duration) loop();
+  }
+
+  uint32_t random(uint32_t &seed, uint32_t range)
+  {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % range;
+  }
+
+  // Deadline accuracy of loop(): idle wake-ups, request latency, ramp end and auto-off
+  void scheduler()
+  {
+    uint32_t seed = 1;
+    web->request("/light?all=off&ramp=0");
+    run(5000);
+
+    // requests arriving at random instants, while loop() sleeps
+    web->latencies().clear();
+    unsigned long t = millis();
+    for (int i = 0; i < 200; ++i) {
+      t += 20 + random(seed, 2000);
+      HAL::at(t, []() { web->request("/light?bulb=toggle&ramp=0"); });
+    }
+    run(t + 100 - millis());
+    std::vector<unsigned long> latencies = web->latencies();
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-36s %10lu ms p50 %6lu ms max\n", "/light latency", latencies[latencies.size() / 2], latencies.back());
+
+    // ramp end versus its deadline
+    long worst = 0;
+    for (int i = 0; i < 50; ++i) {
+      unsigned long ramp = 100 + random(seed, 4900);
+      char uri[64];
+      web->request("/light?bulb=0&ramp=0");
+      loop();
+      snprintf(uri, sizeof(uri), "/light?bulb=255&ramp=%lu", ramp);
+      web->request(uri);
+      unsigned long begin = millis();
+      run(ramp + 200);
+      worst = std::max(worst, long(HAL::pwmChangedAt(PIN_BULB) - (begin + ramp)));
+    }
+    printf("%-36s %10ld ms max\n", "ramp end lateness", worst);
+
+    // auto-off delay
+    web->request("/default?bulb_delay=500&bulb_rampOn=0&bulb_rampOff=0");
+    web->request("/light?bulb=255&ramp=0");
+    unsigned long begin = millis();
+    run(1000);
+    printf("%-36s %10ld ms\n", "auto-off lateness", long(HAL::pwmChangedAt(PIN_BULB) - (begin + 500)));
+    web->request("/default?bulb_delay=0&bulb_rampOn=3000&bulb_rampOff=3000");
+    loop();
+  }
+
+  size_t count(const std::string &haystack, const char *needle)
+  {
+    size_t n = 0;
+    for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) ++n;
+    return n;
+  }
+
+  // Server-Sent Events pushed to one subscriber while idle and during a ramp
+  void events()
+  {
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+    web->request("/events");
+    web->handleClient();
+    std::shared_ptr<WiFiClient::Connection> connection = web->client().connection();
+    run(100);
+    size_t events = count(connection->stream, "data: "), bytes = connection->stream.size();
+    run(10000);
+    printf("%-36s %10zu events %6zu bytes\n", "/events, 10 s idle", count(connection->stream, "data: ") - events,
+           connection->stream.size() - bytes);
+    events = count(connection->stream, "data: ");
+    bytes = connection->stream.size();
+    web->request("/light?all=on&ramp=3000");
+    run(5000);
+    printf("%-36s %10zu events %6zu bytes\n", "/events, 3 s ramp", count(connection->stream, "data: ") - events,
+           connection->stream.size() - bytes);
+    connection->open = false;
+    loop();
+  }
+
+  // Settings log of the sketch (SETTINGS_SLOT, SETTINGS_SECTORS), read back as at boot
+  size_t readSettings(uint8_t *data, size_t size, uint32_t &sequence)
+  {
+    FlashLog<128> log;
+    uint16_t version;
+    log.begin(FS_PHYS_ADDR, 4);
+    sequence = log.sequence();
+    return log.read(data, size, version);
+  }
+
+  std::string get(const char *uri)
+  {
+    web->request(uri);
+    web->handleClient();
+    return web->response().body;
+  }
+
+  // Static pages: bytes sent compressed, and a revalidation with the ETag answered by a 304
+  void pages()
+  {
+    const char *pages[] = { "/info", "/help" };
+    for (const char *page : pages) {
+      std::string name, header;
+      size_t size;
+      {
+        HALHeap::Untracked untracked;
+        name = std::string(page) + " page";
+      }
+      request(name.c_str(), page);
+      {
+        HALHeap::Untracked untracked;
+        const std::string &headers = web->response().headers;
+        size_t tag = headers.find("ETag: "), end = headers.find("\r\n", tag);
+        header = "If-None-Match: " + headers.substr(tag + 6, end - tag - 6) + "\r\n";
+        size = web->response().body.size();
+        name = std::string(page) + " revalidate";
+      }
+      measure(name.c_str(), 20000, [page, &header]() { web->request(page, HTTP_GET, std::string(), header); },
+              []() { web->handleClient(); });
+      printf("%-36s %10zu bytes gzip, then %d %zu bytes\n", page, size, web->response().code,
+             web->response().body.size());
+    }
+  }
+
+  // A minute of 3 dashboards polling /status, an automation on /light, an /events subscriber and
+  // clients stalling mid-request every 5 s: latency of the served requests
+  void concurrency()
+  {
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+    WiFiClient subscriber = web->request("/events");
+    run(100);
+    web->latencies().clear();
+    unsigned long start = millis();
+    for (unsigned long t = 0; t < 60000; t += 250) {
+      for (int dashboard = 0; dashboard < 3; ++dashboard) HAL::at(start + t + dashboard * 70, []() { web->request("/status"); });
+      if (t % 1000 == 0) HAL::at(start + t + 30, []() { web->request("/light?bulb=toggle&ramp=500"); });
+      if (t % 5000 == 0) HAL::at(start + t + 10, []() { web->stalledRequest("/status", 20); });
+    }
+    run(62000);
+    WiFi.disconnected(8);
+    std::string metrics = get("/metrics");
+    printf("%-36s %13s %s\n", "/metrics counters", "",
+           verdict(metrics.find("annahand_http_timeouts_total 12\n") != std::string::npos &&
+                   metrics.find("annahand_wifi_disconnects_total 1\n") != std::string::npos &&
+                   metrics.find("annahand_http_handler_seconds_count{uri=\"/light\"}") != std::string::npos));
+    std::vector<unsigned long> latencies = web->latencies();
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-36s %10lu ms p50 %6lu ms p99 %6lu ms max %5zu requests\n", "HTTP latency, 3 dashboards + stalls",
+           latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back(), latencies.size());
+    subscriber.connection()->open = false;
+    web->request("/light?all=off&ramp=0");
+    run(3000);
+  }
+
+  // A client keeping its connection for its next requests, until idle for 2 s; a client stalling
+  // in the middle of a short POST body, not holding up the next request
+  void keepAlive()
+  {
+    const std::string keep = "Connection: keep-alive\r\n";
+    WiFiClient client = web->request("/status", HTTP_GET, std::string(), keep);
+    run(20);
+    bool kept = web->response().headers.find("Connection: keep-alive\r\n") != std::string::npos && client.connected();
+    web->request(client, "/light?bulb=50&ramp=0", HTTP_GET, std::string(), keep);
+    run(20);
+    kept &= HAL::pwm(PIN_BULB) > 0 && client.connected() && !web->pending();
+    run(2500);
+    printf("%-36s %13s %s\n", "keep-alive, 2 requests then idle", "", verdict(kept && !client.connected()));
+
+    std::string body(40, 'x');
+    const size_t head = strlen("POST /light?bulb=0&ramp=0 HTTP/1.1\r\nHost: native\r\nContent-Length: 40\r\n\r\n");
+    WiFiClient stalled = web->stalledRequest("/light?bulb=0&ramp=0", head + 10, HTTP_POST, body);
+    run(5);
+    web->latencies().clear();
+    web->request("/status");
+    run(50);
+    unsigned long latency = web->latencies().empty() ? ULONG_MAX : web->latencies().back();
+    run(2500);
+    printf("%-36s %10lu ms behind it %s\n", "stalled POST body", latency,
+           verdict(latency <= 10 && HAL::pwm(PIN_BULB) > 0 && !stalled.connected()));
+
+    // a body too long to wait for in a slot, stalled: refused at once, never read by the core
+    WiFiClient large = web->stalledRequest("/light?bulb=0&ramp=0", 200, HTTP_POST, std::string(4096, 'x'));
+    run(5);
+    web->latencies().clear();
+    web->request("/status");
+    run(50);
+    latency = web->latencies().empty() ? ULONG_MAX : web->latencies().back();
+    bool refused = large.connection()->stream.compare(0, 13, "HTTP/1.1 413 ") == 0 && !large.connected();
+    printf("%-36s %10lu ms behind it %s\n", "stalled 4 KB POST body, 413", latency,
+           verdict(refused && latency <= 10 && HAL::pwm(PIN_BULB) > 0));
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+  }
+
+  // Trace lines (see serve) scheduled from 't' on: returns the time of the last one
+  unsigned long schedule(std::istream &in, unsigned long t, WiFiUDP &client)
+  {
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      if (line == "realtime") {
+        HAL::realTime(true);
+        continue;
+      }
+      if (line.compare(0, 5, "wait ") == 0) {
+        t += strtoul(line.c_str() + 5, NULL, 10);
+        continue;
+      }
+      if (line.compare(0, 7, "sensor ") == 0) {
+        int level = atoi(line.c_str() + 7);
+        HAL::at(t, [level]() { HAL::setInput(PIN_SENSOR, level); });
+        continue;
+      }
+      if (line.compare(0, 4, "udp ") == 0) {
+        std::string packet;
+        for (size_t i = 4; i + 1 < line.size(); i += 2) packet += char(strtoul(line.substr(i, 2).c_str(), NULL, 16));
+        HAL::at(t, [&client, packet]() {
+          client.beginPacket(IPAddress(127, 0, 0, 1), UDP_LIGHT_PORT);
+          client.write((const uint8_t *)packet.data(), packet.size());
+          client.endPacket();
+        });
+        continue;
+      }
+      HTTPMethod method = HTTP_GET;
+      if (line.compare(0, 4, "GET ") == 0) line.erase(0, 4);
+      else if (line.compare(0, 5, "POST ") == 0) { line.erase(0, 5); method = HTTP_POST; }
+      HAL::at(t, [line, method]() { web->request(line.c_str(), method); });
+    }
+    return t;
+  }
+
+  // 'clients' automations for 'duration' ms, each sending a request every 50-450 ms: light
+  // changes with ramps, colours and toggles, /status polls, /default edits, now and then a client
+  // stalling mid-request. Returns the end.
+  unsigned long synthesize(int clients, unsigned long duration, uint32_t seed)
+  {
+    static const char *const lights[] = { "bulb", "red", "green", "blue", "white", "rgb", "rgbw", "all" };
+    unsigned long start = millis();
+    for (int client = 0; client < clients; ++client) {
+      for (unsigned long t = random(seed, 500); t < duration; t += 50 + random(seed, 400)) {
+        char uri[96];
+        uint32_t kind = random(seed, 20);
+        if (kind < 8) {
+          snprintf(uri, sizeof(uri), "/light?%s=%u&ramp=%u", lights[random(seed, 8)], random(seed, 256), random(seed, 4000));
+        }
+        else if (kind < 10) {
+          if (random(seed, 2)) snprintf(uri, sizeof(uri), "/light?rgbw=hsv:%u,%u&ramp=%u", random(seed, 360), random(seed, 256), random(seed, 4000));
+          else snprintf(uri, sizeof(uri), "/light?rgb=ct:%u,%u&ramp=%u", 1000 + random(seed, 9001), random(seed, 256), random(seed, 4000));
+        }
+        else if (kind < 11) snprintf(uri, sizeof(uri), "/light?%s=toggle&ramp=%u", lights[random(seed, 8)], random(seed, 2000));
+        else if (kind < 19) snprintf(uri, sizeof(uri), "/status");
+        else snprintf(uri, sizeof(uri), "/default?%s=%u&%s_rampOn=%u", lights[random(seed, 5)], random(seed, 256),
+                      lights[random(seed, 5)], random(seed, 5000));
+        std::string request(uri);
+        HAL::at(start + t, [request]() { web->request(request.c_str()); });
+        if (random(seed, 200) == 0) HAL::at(start + t + 5, []() { web->stalledRequest("/status", 20); });
+      }
+    }
+    return start + duration;
+  }
+
+  template<typename T>
+  T percentile(const std::vector<T> &sorted, unsigned p)
+  {
+    return sorted.empty() ? T() : sorted[std::min(sorted.size() - 1, sorted.size() * p / 100)];
+  }
+
+  // Run loop() until 'end' and every request is answered, then bring every light to one value.
+  // Reports throughput, handler time (host) and latency (virtual), heap high-water and loop()
+  // calls over LOAD_STALL of host time; checks the lights: every duty written within
+  // 0..PWMRANGE, /status values within 0..255, the ramps finished and the lights at the value.
+  const double LOAD_STALL = 1000;   // us - host, some 20-50 ms on the ESP8266
+  bool load(const char *name, unsigned long end)
+  {
+    const unsigned FINAL = 77, FINAL_RAMP = 1500;
+    unsigned long start = millis(), responses = 0, errors = 0, stalls = 0;
+    double longest = 0;
+    {
+      HALHeap::Untracked untracked;
+      web->latencies().clear();
+      web->handlerTimes().clear();
+      web->onResponse([&responses, &errors](const ESP8266WebServer::Response &response) {
+        ++responses;
+        if (response.code >= 500) ++errors;
+      });
+    }
+    HAL::recordPwm(true);
+    HAL::resetHeapHighWater();
+    size_t inUse = HAL::heap().inUse;
+    while (int32_t(millis() - end) < 0 || web->pending()) {
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      loop();
+      double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+      if (elapsed > LOAD_STALL) ++stalls;
+      longest = std::max(longest, elapsed);
+    }
+    unsigned long duration = std::max(1UL, millis() - start);
+    size_t highWater = HAL::heap().highWater;
+    long leaked = long(HAL::heap().inUse) - long(inUse);
+    std::vector<unsigned long> latencies;
+    std::vector<double> handlers;
+    {
+      HALHeap::Untracked untracked;
+      web->onResponse(std::function<void(const ESP8266WebServer::Response &)>());
+      latencies = web->latencies();
+      handlers = web->handlerTimes();
+      std::sort(latencies.begin(), latencies.end());
+      std::sort(handlers.begin(), handlers.end());
+    }
+    double busy = 0;
+    for (double handler : handlers) busy += handler;
+
+    // the last command wins once its ramp is over, and nothing moves after it
+    get("/default?bulb_delay=0&red_delay=0&green_delay=0&blue_delay=0&white_delay=0");
+    char uri[64];
+    snprintf(uri, sizeof(uri), "/light?scene=off&all=%u&ramp=%u", FINAL, FINAL_RAMP);
+    get(uri);
+    run(FINAL_RAMP + 500);
+    unsigned long settled = HAL::pwmTrace(0).size();
+    run(5000);
+    bool ranged = true;
+    for (const HAL::PwmChange &change : HAL::pwmTrace(0)) ranged &= change.value >= 0 && change.value <= PWMRANGE;
+    bool finished = HAL::pwmTrace(0).size() == settled, converged = true;
+    std::string status = get("/status");
+    for (size_t pos = status.find("\"value\":"); pos != std::string::npos; pos = status.find("\"value\":", pos + 1)) {
+      if (status[pos + 8] == '"') continue;   // colours
+      long value = strtol(status.c_str() + pos + 8, NULL, 10);
+      ranged &= value >= 0 && value <= 255;
+      converged &= value == long(FINAL);
+    }
+    HAL::recordPwm(false);
+    bool answered = responses == latencies.size() && responses > 0 && errors == 0;
+
+    printf("%-36s %10lu requests %6.1f req/s %5lu errors\n", name, responses, responses * 1000.0 / duration, errors);
+    printf("%-36s %10.3f us p50 %8.3f us p99 %8.3f us max %8.0f req/s\n", "  handler time", percentile(handlers, 50),
+           percentile(handlers, 99), handlers.empty() ? 0.0 : handlers.back(), handlers.size() / std::max(busy, 1.0) * 1e6);
+    printf("%-36s %10lu ms p50 %6lu ms p99 %6lu ms max\n", "  latency", percentile(latencies, 50), percentile(latencies, 99),
+           latencies.empty() ? 0UL : latencies.back());
+    printf("%-36s %10zu bytes %+7ld bytes in use after\n", "  heap high-water", highWater, leaked);
+    printf("%-36s %10lu loop() calls over %.0f us, longest %.0f us\n", "  loop stalls", stalls, LOAD_STALL, longest);
+    bool ok = answered && ranged && finished && converged;
+    printf("%-36s %10s (answered %d, in range %d, ramps finished %d, at the last command %d)\n", "  lighting invariants",
+           verdict(ok), answered, ranged, finished, converged);
+    return ok;
+  }
+
+  std::string field(const std::string &json, const char *name)
+  {
+    size_t pos = json.find(std::string("\"") + name + "\":");
+    if (pos == std::string::npos) return std::string();
+    pos += strlen(name) + 3;
+    return json.substr(pos, json.find_first_of(",}", pos) - pos);
+  }
+
+  // A request answered whenever the radio hears it
+  std::string fetch(const char *uri)
+  {
+    web->request(uri);
+    settle();
+    return web->response().body;
+  }
+
+  // Radio asleep while the lights are dark: request latency within the budget, a sensor press
+  // lighting at once, the radio awake again once lit
+  void powerSave(const Duty &idle)
+  {
+    const unsigned long budget = 300;
+    uint32_t seed = 5;
+    fetch("/default?power_latency=300&sensor_present=on&sensor_absent=off");
+    fetch("/light?all=off&ramp=0");
+    run(11000);
+    std::string power = fetch("/status");
+    printf("%-36s %10s mode %s listen, %s mA %s\n", "power save, dark", field(power, "mode").c_str(), field(power, "listen").c_str(),
+           field(power, "current").c_str(), verdict(field(power, "mode") == "\"sleep\"" && HAL::pwm(PIN_BULB) == 0));
+    Duty asleep = duty("loop() idle, radio asleep", []() {});
+    // the figure reported counts the socket polls of idle() too, as the simulation does
+    long reported = atol(field(fetch("/status"), "wakeups").c_str());
+    printf("%-36s %10.2f wake-ups/s asleep %6.2f awake, %ld reported %s\n", "power save wake-ups", asleep.wakeups, idle.wakeups,
+           reported, verdict(fabs(reported - asleep.wakeups) <= 2));
+
+    // requests at random instants wait for the next listen
+    web->latencies().clear();
+    unsigned long t = millis();
+    for (int i = 0; i < 100; ++i) {
+      t += 20 + random(seed, 2000);
+      HAL::at(t, []() { web->request("/status"); });
+    }
+    run(t + budget - millis());
+    std::vector<unsigned long> latencies = web->latencies();
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-36s %10lu ms p50 %6lu ms max %s\n", "/status latency, radio asleep", percentile(latencies, 50), latencies.back(),
+           verdict(latencies.size() == 100 && latencies.back() <= budget));
+
+    // a light turned on wakes the radio up
+    web->latencies().clear();
+    HAL::at(millis() + 10 + random(seed, 500), []() { web->request("/light?bulb=255&ramp=0"); });
+    run(1000);
+    power = fetch("/status");
+    printf("%-36s %10lu ms, then %s %s mA %s\n", "/light latency, radio asleep", web->latencies().front(), field(power, "mode").c_str(),
+           field(power, "current").c_str(), verdict(web->latencies().front() <= budget && field(power, "mode") == "\"awake\""));
+
+    // the sensor is sampled as usual
+    fetch("/light?all=off&ramp=0");
+    run(2000);
+    unsigned long pressed = millis() + 33;
+    HAL::at(pressed, []() { HAL::setInput(PIN_SENSOR, HIGH); });
+    HAL::recordPwm(true);
+    run(500);
+    long lit = -1;
+    for (const HAL::PwmChange &change : HAL::pwmTrace(0)) {
+      if (change.pin == PIN_BULB && lit < 0) lit = long(change.time - pressed);
+    }
+    HAL::recordPwm(false);
+    printf("%-36s %10ld ms %s\n", "sensor press -> light, radio asleep", lit, verdict(HAL::pwm(PIN_BULB) > 0 && lit >= 0 && lit <= 20));
+    HAL::setInput(PIN_SENSOR, LOW);
+    fetch("/default?power_latency=0");
+    fetch("/light?all=off&ramp=0");
+    run(4000);
+    // the sketch handed the radio back to the SDK default (modem sleep): awake for the next sections
+    WiFi.setSleepMode(WIFI_NONE_SLEEP);
+  }
+
+  // Flash traffic of /default bursts, and recovery from a power loss while a record is written
+  void persistence()
+  {
+    unsigned long erases = HAL::flashErases(), writes = HAL::flashWrites(), commits = EEPROM.commits();
+    run(10000);
+    for (int burst = 0; burst < 10; ++burst) {
+      // a slider dragged for 2 s
+      for (int i = 0; i < 10; ++i) {
+        char uri[64];
+        snprintf(uri, sizeof(uri), "/default?bulb=%d&bulb_rampOn=%d", 100 + i, 1000 + i * 100);
+        web->request(uri);
+        run(200);
+      }
+      run(10000);
+    }
+    printf("%-36s %10lu erases %5lu writes %5lu EEPROM commits\n", "/default, 10 bursts of 10",
+           HAL::flashErases() - erases, HAL::flashWrites() - writes, EEPROM.commits() - commits);
+
+    uint8_t before[128], after[128];
+    uint32_t sequenceBefore, sequenceAfter;
+    size_t length = readSettings(before, sizeof(before), sequenceBefore);
+    web->request("/default?bulb=1&bulb_rampOn=1&bulb_rampOff=1&bulb_delay=1");
+    HAL::flashPowerLoss(24);
+    run(10000);
+    bool kept = readSettings(after, sizeof(after), sequenceAfter) == length && memcmp(before, after, length) == 0;
+    printf("%-36s %10s (sequence %u -> %u)\n", "power loss mid-write", kept && sequenceAfter == sequenceBefore ? "recovered" : "CORRUPT",
+           sequenceBefore, sequenceAfter);
+    // the next flush skips the torn slot
+    HAL::flashPowerOn();
+    web->request("/default?bulb=255&bulb_rampOn=3000&bulb_rampOff=3000&bulb_delay=0");
+    run(10000);
+    readSettings(after, sizeof(after), sequenceAfter);
+    printf("%-36s %10s (sequence %u)\n", "flush after power loss", verdict(sequenceAfter == sequenceBefore + 1), sequenceAfter);
+  }
+
+  // Binary snapshot: a device cloned in one request and one flash write, damaged or foreign
+  // snapshots refused with the settings untouched, older versions applied as a prefix
+  void snapshot()
+  {
+    run(10000);
+    std::string original = fetch("/snapshot");
+    request("/snapshot export", "/snapshot");
+    fetch("/default?bulb=40&bulb_rampOn=700&red_rampOff=900&white_delay=60000&sensor_hold=dim:rgb&power_latency=200&pwm_frequency=2000");
+    run(10000);
+    std::string exported = fetch("/snapshot");
+    printf("%-36s %10zu bytes\n", "/snapshot", exported.size());
+
+    // the source device back to its settings: the snapshot makes them those of the clone
+    web->request("/snapshot", HTTP_POST, original);
+    settle();
+    bool restored = web->response().code == 200 && fetch("/snapshot") == original;
+    unsigned long erases = HAL::flashErases(), writes = HAL::flashWrites();
+    web->request("/snapshot", HTTP_POST, exported);
+    settle();
+    int code = web->response().code;
+    unsigned long flashWrites = HAL::flashWrites() - writes, flashErases = HAL::flashErases() - erases;
+    std::string status = fetch("/status");
+    bool cloned = code == 200 && restored && fetch("/snapshot") == exported && field(status, "pwmFrequency") == "2000";
+    printf("%-36s %10d %5lu erases %5lu writes %s\n", "/snapshot import", code, flashErases, flashWrites,
+           verdict(cloned && flashWrites == 1));
+
+    std::string damaged = exported, truncated = exported.substr(0, exported.size() - 10), newer = exported;
+    damaged[20] ^= 1;
+    newer[4] = 99;
+    const std::string *refused[] = { &damaged, &truncated, &newer, &status };
+    int rejected = 0;
+    for (const std::string *body : refused) {
+      web->request("/snapshot", HTTP_POST, *body);
+      settle();
+      rejected += web->response().code == 400;
+    }
+    printf("%-36s %6d/%zu refused %s\n", "/snapshot damaged, truncated, newer", rejected, sizeof(refused) / sizeof(refused[0]),
+           verdict(rejected == 4 && fetch("/snapshot") == exported));
+
+    // version 3: the lights and the sensor, the broker and the power latency kept
+    std::string older = original.substr(0, 8 + 80);
+    older[4] = 3;
+    older[6] = 80;
+    uint32_t crc = crc32(older.data(), older.size());
+    older.append((const char *)&crc, sizeof(crc));
+    web->request("/snapshot", HTTP_POST, older);
+    settle();
+    code = web->response().code;
+    status = fetch("/status");
+    printf("%-36s %10d %s\n", "/snapshot version 3", code,
+           verdict(code == 200 && field(status, "pwmFrequency") == "1000" && fetch("/snapshot") != original &&
+                  field(status, "latency") == "200"));
+    web->request("/snapshot", HTTP_POST, original);
+    settle();
+    run(1000);
+    WiFi.setSleepMode(WIFI_NONE_SLEEP);   // see powerSave()
+  }
+
+  struct Edge {
+    unsigned long time;    // ms from the start of the trace
+    int level;
+  };
+
+  // Drive the sensor pin through an edge trace, then let loop() run for 'after' ms
+  template<size_t N>
+  void replay(const Edge (&trace)[N], unsigned long after = 1000)
+  {
+    unsigned long start = millis();
+    for (const Edge &edge : trace) {
+      int level = edge.level;
+      HAL::at(start + edge.time, [level]() { HAL::setInput(PIN_SENSOR, level); });
+    }
+    run(trace[N - 1].time + after);
+  }
+
+  std::string status()
+  {
+    return get("/status");
+  }
+
+  // Loopback client of the UDP protocol: opcode, sequence, lights, ramp (big endian), payload
+  void sendUdp(WiFiUDP &client, uint8_t opcode, uint8_t sequence, uint8_t lights, uint16_t ramp,
+               std::initializer_list<uint8_t> payload = {})
+  {
+    uint8_t packet[16] = { opcode, sequence, lights, uint8_t(ramp >> 8), uint8_t(ramp) };
+    size_t length = 5;
+    for (uint8_t byte : payload) packet[length++] = byte;
+    client.beginPacket(IPAddress(127, 0, 0, 1), UDP_LIGHT_PORT);
+    client.write(packet, length);
+    client.endPacket();
+  }
+
+  // UDP commands at 50/s: latency, cost per command against /light, status reply, late datagrams
+  void udpControl()
+  {
+    WiFiUDP client;
+    client.begin(4211);
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+
+    // a slider dragged for 4 s
+    std::vector<unsigned long> sent, latencies;
+    unsigned long start = millis();
+    for (int i = 0; i < 200; ++i) {
+      sent.push_back(start + 20 * i + (i * 7) % 10);
+      HAL::at(sent.back(), [&client, i]() { sendUdp(client, 1, uint8_t(i + 1), 0x01, 0, { uint8_t(i % 2 ? 200 : 100) }); });
+      HAL::at(sent.back() + 15, [i, &sent, &latencies]() { latencies.push_back(HAL::pwmChangedAt(PIN_BULB) - sent[i]); });
+    }
+    run(4100);
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-36s %10lu ms p50 %6lu ms max\n", "UDP set latency, 50/s", latencies[latencies.size() / 2], latencies.back());
+
+    // the same 100 s of commands over UDP and HTTP, against as many wake-ups by runt datagrams
+    start = millis();
+    for (int i = 0; i < 5000; ++i) {
+      HAL::at(start + 20 * i, [&client]() {
+        client.beginPacket(IPAddress(127, 0, 0, 1), UDP_LIGHT_PORT);
+        client.write(uint8_t(0));
+        client.endPacket();
+      });
+    }
+    Duty wakeups = duty("loop() 50 wake-ups/s", []() {});
+    start = millis();
+    for (int i = 0; i < 5000; ++i) {
+      HAL::at(start + 20 * i, [&client, i]() { sendUdp(client, 1, 0, 0x1F, 0, { uint8_t(i), 20, 30, 40, 50 }); });
+    }
+    Duty udpRate = duty("loop() UDP set 50/s", []() {});
+    printf("%-36s %10.3f us/op\n", "UDP set, 5 lights (derived)", (udpRate.micros - wakeups.micros) / 50);
+    start = millis();
+    for (int i = 0; i < 5000; ++i) {
+      HAL::at(start + 20 * i, [i]() {
+        char uri[80];
+        snprintf(uri, sizeof(uri), "/light?bulb=%d&red=20&green=30&blue=40&white=50&ramp=0", i % 256);
+        web->request(uri);
+      });
+    }
+    Duty httpRate = duty("loop() /light 50/s", []() {});
+    printf("%-36s %10.3f us/op\n", "/light, 5 lights (derived)", (httpRate.micros - wakeups.micros) / 50);
+
+    // status reply through the loopback
+    sendUdp(client, 1, 0, 0x1F, 0, { 10, 20, 30, 40, 50 });
+    sendUdp(client, 6, 42, 0, 0);
+    run(10);
+    uint8_t reply[24] = {};
+    int length = client.parsePacket() > 0 ? client.read(reply, sizeof(reply)) : 0;
+    const uint8_t expected[] = { 0x86, 42, 0x1F, 0, 0, 10, 20, 30, 40, 50, 0xFF };   // then the group clock
+    printf("%-36s %10d bytes %s\n", "UDP status reply", length,
+           verdict(length == int(sizeof(expected)) + 4 && memcmp(reply, expected, sizeof(expected)) == 0));
+
+    // a late datagram is dropped, a sender starting over after a pause is not
+    sendUdp(client, 1, 10, 0x01, 0, { 100 });
+    sendUdp(client, 1, 9, 0x01, 0, { 200 });
+    run(10);
+    int late = HAL::pwm(PIN_BULB);
+    run(2000);
+    sendUdp(client, 1, 1, 0x01, 0, { 200 });
+    run(10);
+    int restart = HAL::pwm(PIN_BULB);
+    sendUdp(client, 5, 0, 0, 0, { 1 });
+    run(100);
+    printf("%-36s %13s %s\n", "UDP late datagram, restart, scene", "",
+           verdict(late < restart && status().find("\"scene\":\"rainbow\"") != std::string::npos));
+
+    sendUdp(client, 5, 0, 0, 0, { 0xFF });
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+  }
+
+  volatile uint32_t sink;   // keeps the results of the measured conversions
+
+  // Colour conversions per second, and the cost and path of a ramp through HSV
+  void colors(const Duty &idle)
+  {
+    uint32_t seed = 3;
+    uint16_t rgb16[3], hue, value;
+    uint8_t rgb[3], saturation;
+    Sample sample = measure("HSV -> RGB", 100000, [&seed]() { random(seed, 1); }, [&seed, &rgb16]() {
+      ColorSpace::hsvToRgb(seed % ColorSpace::HUE_RANGE, seed >> 8, seed >> 16, rgb16);
+      sink = rgb16[0] + rgb16[1] + rgb16[2];
+    });
+    printf("%-36s %10.0f /s\n", "HSV -> RGB conversions", 1 / std::max(sample.micros, 1e-3) * 1e6);
+    sample = measure("RGB -> HSV", 100000, [&seed, &rgb16]() {
+      random(seed, 1);
+      rgb16[0] = seed;
+      rgb16[1] = seed >> 8;
+      rgb16[2] = seed >> 16;
+    }, [&rgb16, &hue, &saturation, &value]() {
+      ColorSpace::rgbToHsv(rgb16, hue, saturation, value);
+      sink = hue + saturation + value;
+    });
+    printf("%-36s %10.0f /s\n", "RGB -> HSV conversions", 1 / std::max(sample.micros, 1e-3) * 1e6);
+    sample = measure("kelvin -> RGB", 100000, [&seed]() { random(seed, 1); }, [&seed, &rgb]() {
+      ColorSpace::kelvinToRgb(1000 + seed % 9000, rgb);
+      sink = rgb[0] + rgb[1] + rgb[2];
+    });
+    printf("%-36s %10.0f /s\n", "kelvin -> RGB conversions", 1 / std::max(sample.micros, 1e-3) * 1e6);
+    sample = measure("xy -> RGB", 100000, [&seed]() { random(seed, 1); }, [&seed, &rgb]() {
+      ColorSpace::xyToRgb(1000 + seed % 5000, 1000 + (seed >> 8) % 5000, rgb);
+      sink = rgb[0] + rgb[1] + rgb[2];
+    });
+    printf("%-36s %10.0f /s\n", "xy -> RGB conversions", 1 / std::max(sample.micros, 1e-3) * 1e6);
+    sample = measure("RGB -> RGBW (white extraction)", 100000, [&seed, &rgb]() {
+      random(seed, 1);
+      rgb[0] = seed;
+      rgb[1] = seed >> 8;
+      rgb[2] = seed >> 16;
+    }, [&rgb]() { sink = ColorSpace::extractWhite(rgb); });
+    printf("%-36s %10.0f /s\n", "RGB -> RGBW conversions", 1 / std::max(sample.micros, 1e-3) * 1e6);
+    request("/light parse (hsv)", "/light?rgbw=hsv:200,180,255&ramp=0");
+    request("/light parse (ct)", "/light?rgbw=ct:2700,200&ramp=0");
+
+    // red to green in 2 s: halfway is yellow at full brightness, not a dim olive
+    web->request("/light?all=off&rgb=%23ff0000&ramp=0");
+    run(100);
+    web->request("/light?rgb=%2300ff00&ramp=2000");
+    run(1000);
+    int red = HAL::pwm(D4), green = HAL::pwm(D3), blue = HAL::pwm(D2);
+    run(1100);
+    printf("%-36s %10d %d %d duty %s\n", "hue ramp red -> green, halfway", red, green, blue,
+           verdict(red > PWMRANGE * 9 / 10 && green > PWMRANGE * 9 / 10 && blue == 0 && HAL::pwm(D4) == 0 && HAL::pwm(D3) == PWMRANGE));
+
+    // a ramp on one channel during a hue ramp: the others carry on to their targets
+    web->request("/light?rgb=%230000ff&ramp=2000");
+    run(500);
+    web->request("/light?red=255&ramp=0");
+    run(2000);
+    printf("%-36s %13s %s\n", "hue ramp interrupted", "",
+           verdict(status().find("\"rgb\":{\"value\":\"#ff00ff\"}") != std::string::npos));
+
+    // 60 s hue turns, restarted before they complete
+    unsigned long rampStart = millis() - 60000;
+    bool clockwise = false;
+    Ticker::Timing ticks = Ticker::timing(RAMP_TICK);
+    duty("loop() hue ramp", [&rampStart, &clockwise]() {
+      if (millis() - rampStart < 50000) return;
+      web->request(clockwise ? "/light?rgb=hsv:0,255&ramp=0" : "/light?rgb=hsv:180,255&ramp=0");
+      web->handleClient();
+      web->request(clockwise ? "/light?rgb=hsv:179,255&ramp=60000" : "/light?rgb=hsv:1,255&ramp=60000");
+      web->handleClient();
+      clockwise = !clockwise;
+      rampStart = millis();
+    });
+    printf("%-36s %10.3f us/op\n", "hue ramp tick, RGB", tickCost(RAMP_TICK, ticks));
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+  }
+
+  // Average duty of a pin over 'duration' ms from now, weighted by time, and the duties it took
+  double averageDuty(uint8_t pin, unsigned long duration, int &low, int &high)
+  {
+    unsigned long start = millis(), last = start;
+    int value = HAL::pwm(pin);
+    HAL::recordPwm(true);
+    run(duration);
+    double sum = 0;
+    low = high = value;
+    for (const HAL::PwmChange &change : HAL::pwmTrace(0)) {
+      if (change.pin != pin || int32_t(change.time - (start + duration)) >= 0) continue;
+      sum += double(value) * (change.time - last);
+      last = change.time;
+      value = change.value;
+      low = std::min(low, value);
+      high = std::max(high, value);
+    }
+    HAL::recordPwm(false);
+    return (sum + double(value) * (start + duration - last)) / duration;
+  }
+
+  // Output stage: low duties in finer steps than PWMRANGE within each period, channels
+  // phase-shifted, frequency changes keeping the duty
+  void pwm()
+  {
+    const uint8_t pins[] = { D5, D4, D3, D2, D1 };   // CHANNELS order
+    const int lights = sizeof(pins) / sizeof(pins[0]);
+
+    // the first 40 levels: one duty step is several % of the light there; the high time of the
+    // period gives the fine duty, steady while the light is at rest
+    const uint32_t cycles = F_CPU / 1000;
+    double worst = 0;
+    uint32_t previous = 0;
+    int steps = 0, levels = 0, rounded = -1;
+    bool steady = true, monotonic = true;
+    for (int level = 1; level <= 40; ++level) {
+      char uri[48];
+      snprintf(uri, sizeof(uri), "/light?bulb=%d&ramp=0", level);
+      get(uri);
+      run(100);
+      int low, high;
+      averageDuty(PIN_BULB, 1600, low, high);
+      steady &= low == high;
+      uint32_t fine = (pgm_read_word(&ColorSpace::GAMMA[level]) * (PWMRANGE << 4) + 0x8000) >> 16;
+      fine = std::max(fine, 16U);
+      uint32_t time = HAL::waveform(PIN_BULB).high;
+      worst = std::max(worst, fabs(double(time) * (PWMRANGE << 4) / cycles - fine) / 16);
+      monotonic &= time >= previous;
+      levels += level == 1 || time > previous;
+      int duty = std::max(1U, (fine + 8) / 16);
+      steps += duty != rounded;
+      rounded = duty;
+      previous = time;
+    }
+    printf("%-36s %10.3f duty max error %3d levels (%d in whole steps) %s\n", "fine duty, levels 1-40", worst, levels,
+           steps, verdict(worst < 0.01 && steady && monotonic && levels > steps));
+    // a dim light at rest runs no ticker: as the lights off right before, the host caches as warm
+    get("/light?bulb=0&ramp=0");
+    run(100);
+    Duty dark = duty("loop() lights off", []() {});
+    get("/light?bulb=20&ramp=0");   // duty 3.75
+    Duty dim = duty("loop() dim light", []() {});
+    printf("%-36s %10.2f ticks/s %s\n", "dim light at rest (derived)", dim.events - dark.events,
+           verdict(dim.events - dark.events < 1));
+
+    // every channel a fifth of the period after the previous one
+    get("/light?all=128&ramp=0");
+    run(100);
+    const HAL::Waveform &bulb = HAL::waveform(PIN_BULB);
+    uint32_t period = bulb.high + bulb.low;
+    bool shifted = period == F_CPU / 1000;
+    for (int i = 0; i < lights; ++i) {
+      const HAL::Waveform &waveform = HAL::waveform(pins[i]);
+      int first = int(std::find(pins, pins + lights, waveform.align) - pins);
+      shifted &= i == 0 ? waveform.align < 0 || first < lights : first < lights &&
+                 waveform.phase == uint32_t((i - first + lights) % lights) * (period / lights);
+    }
+    printf("%-36s %10u cycles period %s\n", "phase-shifted channels, 1 kHz", period,
+           verdict(shifted && HAL::phaseLocked()));
+
+    // 500 Hz: twice the period, the same duties
+    int before = HAL::pwm(PIN_BULB);
+    get("/default?pwm_frequency=500");
+    std::string status = get("/status");
+    period = HAL::waveform(PIN_BULB).high + HAL::waveform(PIN_BULB).low;
+    printf("%-36s %10u cycles period, duty %d -> %d %s\n", "PWM frequency 500 Hz", period, before, HAL::pwm(PIN_BULB),
+           verdict(period == F_CPU / 500 && HAL::pwm(PIN_BULB) == before && field(status, "pwmFrequency") == "500"));
+    get("/default?pwm_frequency=1000");
+    get("/light?all=off&ramp=0");
+    run(1000);
+  }
+
+  // In-memory MQTT broker listening on the default port: answers CONNECT, SUBSCRIBE and PINGREQ,
+  // records what the device publishes, can refuse connections
+  struct Broker {
+    struct Message {
+      std::string topic, payload;
+      bool retain;
+    };
+    std::shared_ptr<WiFiClient::Connection> connection;
+    size_t parsed = 0;              // bytes of the device stream handled
+    bool refuse = false;
+    unsigned long attempts = 0, pings = 0;
+    std::vector<Message> published;
+    std::vector<std::string> subscriptions;
+
+    static std::string string(const std::string &body, size_t &offset)
+    {
+      size_t length = (uint8_t)body[offset] << 8 | (uint8_t)body[offset + 1];
+      offset += 2 + length;
+      return body.substr(offset - length, length);
+    }
+
+    void pump()
+    {
+      HALHeap::Untracked untracked;
+      if (!connection) return;
+      const std::string &stream = connection->stream;
+      for (;;) {
+        size_t length = 0, shift = 0, offset = parsed + 1;
+        do {
+          if (offset >= stream.size()) return;
+          length |= size_t(stream[offset] & 0x7F) << shift;
+          shift += 7;
+        } while (stream[offset++] & 0x80);
+        if (offset + length > stream.size()) return;
+        uint8_t type = stream[parsed];
+        std::string body = stream.substr(offset, length);
+        parsed = offset + length;
+        size_t position = 0;
+        switch (type & 0xF0) {
+          case 0x10: connection->incoming += std::string("\x20\x02\x00\x00", 4); break;
+          case 0x30: {
+            std::string topic = string(body, position);
+            published.push_back({ topic, body.substr(position), (type & 0x01) != 0 });
+            break;
+          }
+          case 0x80:
+            position = 2;
+            subscriptions.push_back(string(body, position));
+            connection->incoming += std::string("\x90\x03", 2) + body.substr(0, 2) + std::string(1, '\0');
+            break;
+          case 0xC0: ++pings; connection->incoming += std::string("\xD0\x00", 2); break;
+        }
+      }
+    }
+
+    void send(const std::string &topic, const std::string &payload)
+    {
+      HALHeap::Untracked untracked;
+      std::string body = std::string(1, char(topic.size() >> 8)) + char(topic.size()) + topic + payload;
+      connection->incoming += char(0x30);
+      for (size_t length = body.size(); ; ) {
+        connection->incoming += char((length & 0x7F) | (length > 0x7F ? 0x80 : 0));
+        if (!(length >>= 7)) break;
+      }
+      connection->incoming += body;
+    }
+
+    size_t count(const std::string &topic, size_t since = 0) const
+    {
+      size_t n = 0;
+      for (size_t i = since; i < published.size(); ++i) n += published[i].topic == topic;
+      return n;
+    }
+
+    const Message *last(const std::string &topic) const
+    {
+      for (size_t i = published.size(); i-- > 0;) {
+        if (published[i].topic == topic) return &published[i];
+      }
+      return nullptr;
+    }
+  };
+
+  // MQTT client against the in-memory broker: discovery, commands, states published during a
+  // ramp, silence while idle, reconnection with backoff while ramps keep their deadline
+  void mqtt()
+  {
+    static Broker broker;
+    WiFiClient::listen(1883, [](WiFiClient &client) {
+      ++broker.attempts;
+      if (broker.refuse) return false;
+      broker.connection = client.connection();
+      broker.parsed = 0;
+      return true;
+    });
+    // the broker handles what the device sent every ms, as a network would
+    static bool pumping;
+    static std::function<void()> pump = []() {
+      broker.pump();
+      if (pumping) HAL::at(millis() + 1, pump);
+    };
+    pumping = true;
+    HAL::at(millis() + 1, pump);
+    HAL::hostName("broker", IPAddress(192, 168, 1, 2), 30);
+    web->request("/light?all=off&ramp=0");
+    web->request("/default?mqtt=broker");
+    run(1000);
+    const std::string base = "annahand/c0ffee";
+    const Broker::Message *online = broker.last(base + "/status");
+    const Broker::Message *config = broker.last("homeassistant/light/annahand_c0ffee/rgbw/config");
+    printf("%-36s %10zu messages %s\n", "MQTT connect, discovery", broker.published.size(),
+           verdict(online && online->payload == "online" && online->retain && config && config->retain &&
+                  config->payload.find("\"cmd_t\":\"~/rgbw/set\"") != std::string::npos && broker.subscriptions.size() == 2 &&
+                  broker.count(base + "/bulb") == 1 && broker.count(base + "/rgbw") == 1 &&
+                  status().find("\"state\":\"connected\"") != std::string::npos));
+
+    size_t since = broker.published.size();
+    unsigned long pings = broker.pings;
+    run(60000);
+    printf("%-36s %10zu publishes %4lu pings %s\n", "MQTT 60 s idle", broker.published.size() - since, broker.pings - pings,
+           verdict(broker.published.size() == since && broker.pings - pings == 4));
+
+    since = broker.published.size();
+    broker.send(base + "/bulb/set", "{\"state\":\"ON\",\"brightness\":200,\"transition\":3}");
+    run(4000);
+    const Broker::Message *bulb = broker.last(base + "/bulb");
+    printf("%-36s %10zu publishes %s\n", "MQTT command, 3 s transition", broker.count(base + "/bulb", since),
+           verdict(broker.count(base + "/bulb", since) <= 3000 / 500 + 2 && bulb && bulb->retain &&
+                  bulb->payload == "{\"state\":\"ON\",\"brightness\":200}" && broker.count(base + "/rgbw", since) == 0));
+
+    broker.send(base + "/rgbw/set", "{\"state\":\"ON\",\"brightness\":128,\"color\":{\"r\":255,\"g\":0,\"b\":128,\"w\":0},\"transition\":0}");
+    run(1000);
+    const Broker::Message *rgbw = broker.last(base + "/rgbw");
+    printf("%-36s %13s %s\n", "MQTT colour command", "",
+           verdict(status().find("\"rgbw\":{\"value\":\"#80004000\"}") != std::string::npos && rgbw &&
+                  rgbw->payload.find("\"brightness\":128") != std::string::npos));
+
+    // the broker goes away: retries back off, a ramp started meanwhile ends on time
+    unsigned long attempts = broker.attempts;
+    broker.refuse = true;
+    broker.connection->open = false;
+    web->request("/light?bulb=0&ramp=2000");
+    unsigned long begin = millis();
+    run(60000);
+    unsigned long retries = broker.attempts - attempts;
+    long late = long(HAL::pwmChangedAt(PIN_BULB) - (begin + 2000));
+    broker.refuse = false;
+    run(40000);
+    bulb = broker.last(base + "/bulb");
+    printf("%-36s %10lu retries %4ld ms ramp end %s\n", "MQTT broker lost 60 s", retries, late,
+           verdict(retries >= 5 && retries <= 7 && late >= 0 && late <= 10 &&
+                  status().find("\"state\":\"connected\"") != std::string::npos && bulb && bulb->payload == "{\"state\":\"OFF\",\"brightness\":0}"));
+    duty("loop() idle, MQTT connected", []() {});
+
+    // the broker, then the AP go away: loop() sleeps as without a broker, at most 10000 calls to
+    // see it spin
+    broker.refuse = true;
+    broker.connection->open = false;
+    run(100);
+    WiFi.association(ULONG_MAX);
+    WiFi.begin();
+    unsigned long loops = 0, from = millis(), wakeups = HAL::wakeups();
+    for (; millis() - from < 10000 && loops < 10000; ++loops) loop();
+    double rate = double(HAL::wakeups() - wakeups) * 1000 / std::max(1UL, millis() - from);
+    printf("%-36s %10.2f wake-ups/s %6lu loop() in %lu ms %s\n", "MQTT broker set, AP down", rate, loops, millis() - from,
+           verdict(millis() - from >= 10000 && rate <= 100));
+    broker.refuse = false;
+    WiFi.association(2000);
+    WiFi.begin();
+    run(5000);
+
+    // a name the DNS never answers in time: loop() goes on, the lookup is given up and backs off
+    HAL::hostName("nowhere.local", IPAddress(), 10000);
+    web->request("/default?mqtt=nowhere.local");
+    attempts = broker.attempts;
+    unsigned long longest = 0;
+    from = millis();
+    wakeups = HAL::wakeups();
+    for (loops = 0; millis() - from < 30000 && loops < 30000; ++loops) {
+      unsigned long call = millis();
+      loop();
+      longest = std::max(longest, millis() - call);
+    }
+    rate = double(HAL::wakeups() - wakeups) * 1000 / std::max(1UL, millis() - from);
+    printf("%-36s %10lu ms longest loop() %6.2f wake-ups/s %s\n", "MQTT broker name unresolvable", longest, rate,
+           verdict(millis() - from >= 30000 && longest <= 1000 && rate <= 100 && broker.attempts == attempts &&
+                  status().find("\"state\":\"disconnected\"") != std::string::npos));
+    web->request("/default?mqtt=broker");
+    run(1000);
+    bool connected = status().find("\"state\":\"connected\"") != std::string::npos;
+    printf("%-36s %10s %s\n", "MQTT broker name resolved", connected ? "connected" : "not", verdict(connected));
+
+    pumping = false;
+    web->request("/default?mqtt=");
+    run(1000);
+    WiFiClient::listen(1883, WiFiClient::Listener());
+  }
+
+  // Recorded-style edge traces through the sensor pipeline: bounce, short pulses, double tap, hold
+  void sensor()
+  {
+    web->request("/light?all=off&ramp=0");
+    web->request("/default?bulb_rampOn=0&bulb_rampOff=0&sensor_present=none&sensor_absent=none"
+                 "&sensor_tap=toggle:bulb&sensor_double=none&sensor_hold=dim:bulb");
+    run(1000);
+
+    // contact bounce on press and release
+    const Edge bouncy[] = { {0, 1}, {1, 0}, {2, 1}, {4, 0}, {5, 1}, {120, 0}, {121, 1}, {123, 0} };
+    unsigned long start = millis();
+    replay(bouncy);
+    printf("%-36s %10ld ms %s\n", "sensor bouncy tap -> toggle", long(HAL::pwmChangedAt(PIN_BULB) - (start + 120)),
+           verdict(HAL::pwm(PIN_BULB) == PWMRANGE));
+
+    // a 3 ms pulse, shorter than the debounce time
+    const Edge pulse[] = { {0, 1}, {3, 0} };
+    start = millis();
+    replay(pulse);
+    printf("%-36s %10ld ms %s\n", "sensor 3 ms pulse -> toggle", long(HAL::pwmChangedAt(PIN_BULB) - (start + 3)),
+           verdict(HAL::pwm(PIN_BULB) == 0));
+
+    // two taps 150 ms apart
+    web->request("/default?sensor_double=rainbow");
+    run(100);
+    const Edge doubleTap[] = { {0, 1}, {80, 0}, {230, 1}, {300, 0} };
+    replay(doubleTap);
+    printf("%-36s %13s %s\n", "sensor double tap -> scene", "", verdict(status().find("\"scene\":\"rainbow\"") != std::string::npos));
+    web->request("/light?scene=off&bulb=255&ramp=0");
+    run(100);
+
+    // held 1.6 s: dims down from 255 for 1 s, then stays there
+    const Edge hold[] = { {0, 1}, {1600, 0} };
+    replay(hold, 50);
+    int held = HAL::pwm(PIN_BULB);
+    run(2000);
+    printf("%-36s %10d -> %d duty %s\n", "sensor hold -> dim", PWMRANGE, held,
+           verdict(held > 0 && held < PWMRANGE && HAL::pwm(PIN_BULB) == held));
+
+    web->request("/default?bulb_rampOn=3000&bulb_rampOff=3000&sensor_present=on&sensor_absent=off"
+                 "&sensor_tap=none&sensor_double=none&sensor_hold=none");
+    web->request("/light?all=off&ramp=0");
+    run(1000);
+  }
+
+  std::string sha256(const std::string &data)
+  {
+    HALHeap::Untracked untracked;
+    Sha256 sha;
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    sha.update(data.data(), data.size());
+    sha.finish(digest);
+    char hex[2 * Sha256::DIGEST_SIZE + 1];
+    for (int i = 0; i < Sha256::DIGEST_SIZE; ++i) snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    return hex;
+  }
+
+  std::string flashBytes(uint32_t address, size_t size)
+  {
+    HALHeap::Untracked untracked;
+    std::string bytes(size, '\0');
+    flash_hal_read(address, size, (uint8_t *)&bytes[0]);
+    return bytes;
+  }
+
+  // The device restarted (HAL::Restart): eboot runs its command, then setup() until it does not restart
+  void boot()
+  {
+    for (;;) {
+      try {
+        HAL::bootloader();
+        setup();
+        return;
+      }
+      catch (const HAL::Restart &) {}
+    }
+  }
+
+  // POST /update of 'image' announced with the SHA-256 'hash': response code, and whether eboot has an image to install
+  int postImage(const std::string &image, const std::string &hash, bool &committed)
+  {
+    std::string uri;
+    {
+      HALHeap::Untracked untracked;
+      uri = "/update" + (hash.empty() ? std::string() : "?sha256=" + hash);
+    }
+    web->request(uri.c_str(), HTTP_POST, image);
+    web->handleClient();
+    eboot_command command;
+    committed = eboot_command_read(&command) == 0;
+    return web->response().code;
+  }
+
+  // Firmware images through /update and ArduinoOTA: corrupted, truncated, foreign and unhashed ones
+  // are rejected before anything is committed; a good one, smaller or larger than the running
+  // sketch, boots on trial, comes back to the previous sketch after a crash loop, or is kept once
+  // confirmed
+  void firmwareUpdate()
+  {
+    HAL::restartThrows(true);
+
+    // FIPS 180-4 vectors, the second one hashed in odd chunks
+    const std::string twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    Sha256 chunked;
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    for (size_t offset = 0; offset < twoBlocks.size(); offset += 7) chunked.update(twoBlocks.data() + offset, std::min(size_t(7), twoBlocks.size() - offset));
+    chunked.finish(digest);
+    bool vectors = sha256("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" &&
+                   sha256("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" &&
+                   sha256(twoBlocks) == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" &&
+                   digest[0] == 0x24 && digest[31] == 0xc1;
+    printf("%-36s %13s %s\n", "SHA-256 test vectors", "", verdict(vectors));
+    Sha256 sha;
+    uint8_t chunk[HTTP_UPLOAD_BUFLEN] = {};
+    Sample hashing = measure("SHA-256, 2 KB upload chunk", 20000, []() {}, [&sha, &chunk]() { sha.update(chunk, sizeof(chunk)); });
+    printf("%-36s %10.1f MB/s\n", "SHA-256 throughput", HTTP_UPLOAD_BUFLEN / std::max(hashing.micros, 1e-3));
+
+    std::string image = HAL::sketchImage(2, 300000), hash = sha256(image);
+    std::string corrupted = image, truncated = image.substr(0, 200000), foreign = image;
+    corrupted[150000] ^= 0x10;
+    foreign[0] = 0;
+    struct Rejected { const char *name; const std::string &image; std::string hash; } rejected[] = {
+      { "/update corrupted -> rejected", corrupted, hash },
+      { "/update truncated -> rejected", truncated, hash },
+      { "/update not an image -> rejected", foreign, sha256(foreign) },
+      { "/update without sha256 -> rejected", image, "" },
+      { "/update malformed sha256 -> rejected", image, hash.substr(1) },
+    };
+    for (const Rejected &test : rejected) {
+      bool committed;
+      int code = postImage(test.image, test.hash, committed);
+      bool failed = status().find("\"update\":{\"state\":\"failed\"") != std::string::npos;
+      printf("%-36s %10d %s\n", test.name, code, verdict(code == 400 && !committed && failed));
+    }
+
+    // a good image, then 3 crashes on trial
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool committed;
+    int code = postImage(image, hash, committed);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%-36s %10d %s (%.1f ms for %zu KB, sketch copy included)\n", "/update good image -> installed", code,
+           verdict(code == 200 && committed), elapsed, image.size() / 1024);
+    try { run(5000); } catch (const HAL::Restart &) { boot(); }
+    bool trial = flashBytes(0, image.size()) == image && status().find("\"boot\":\"trial\"") != std::string::npos;
+    for (int crash = 0; crash < 3; ++crash) {
+      try { ESP.restart(); } catch (const HAL::Restart &) { boot(); }
+    }
+    printf("%-36s %13s %s\n", "update, 3 crashes on trial -> rollback", "",
+           verdict(trial && flashBytes(0, HAL::SKETCH_SIZE) == HAL::sketchImage(1) &&
+                  status().find("\"boot\":\"rolled back\"") != std::string::npos));
+
+    // an image larger than the running sketch: eboot installing it must not reach the copy of the
+    // running sketch, which comes back byte for byte
+    std::string larger = HAL::sketchImage(3, HAL::SKETCH_SIZE + 0x30000);
+    code = postImage(larger, sha256(larger), committed);
+    try { run(5000); } catch (const HAL::Restart &) { boot(); }
+    trial = ESP.getSketchSize() == larger.size() && flashBytes(0, larger.size()) == larger &&
+            status().find("\"boot\":\"trial\"") != std::string::npos;
+    for (int crash = 0; crash < 3; ++crash) {
+      try { ESP.restart(); } catch (const HAL::Restart &) { boot(); }
+    }
+    printf("%-36s %10d %s\n", "larger image, crashes -> rollback", code,
+           verdict(code == 200 && trial && ESP.getSketchSize() == HAL::SKETCH_SIZE &&
+                   flashBytes(0, HAL::SKETCH_SIZE) == HAL::sketchImage(1) &&
+                   status().find("\"boot\":\"rolled back\"") != std::string::npos));
+
+    // the same image gzipped (staged compressed, eboot inflates it), confirmed after a minute connected
+    std::string gzip = image;
+    gzip[0] = char(0x1F);
+    gzip[1] = char(0x8B);
+    code = postImage(gzip, sha256(gzip), committed);
+    try { run(5000); } catch (const HAL::Restart &) { boot(); }
+    trial = status().find("\"boot\":\"trial\"") != std::string::npos;
+    run(61000);
+    uint32_t record = 0;
+    ESP.rtcUserMemoryRead(32, &record, sizeof(record));   // UPDATE_RTC_BLOCK, cleared by the confirmation
+    printf("%-36s %10d %s\n", "/update gzip image -> confirmed", code,
+           verdict(code == 200 && trial && record == 0 && status().find("\"boot\":\"confirmed\"") != std::string::npos));
+
+    // the AP unreachable during the trial: no reboot, confirmed after 10 minutes of loop()
+    code = postImage(image, hash, committed);
+    WiFi.association(ULONG_MAX);
+    try { run(5000); } catch (const HAL::Restart &) { boot(); }
+    run(61000);
+    trial = status().find("\"boot\":\"trial\"") != std::string::npos;
+    bool restarted = false;
+    try { run(600000 - 61000 + 5000); } catch (const HAL::Restart &) { restarted = true; boot(); }
+    printf("%-36s %10d %s\n", "/update, AP down 10 min -> confirmed", code,
+           verdict(code == 200 && trial && !restarted && status().find("\"boot\":\"confirmed\"") != std::string::npos));
+    WiFi.association(2000);
+    WiFi.begin();
+    run(5000);
+
+    // ArduinoOTA goes through the same trial
+    get("/ota?action=on");
+    ArduinoOTAClass::simulated()->upload(image, 100000);
+    bool failed = status().find("\"error\":\"ArduinoOTA transfer failed\"") != std::string::npos;
+    try { ArduinoOTAClass::simulated()->upload(image); } catch (const HAL::Restart &) { boot(); }
+    printf("%-36s %13s %s\n", "ArduinoOTA truncated, then good", "",
+           verdict(failed && flashBytes(0, image.size()) == image && status().find("\"boot\":\"trial\"") != std::string::npos));
+    run(61000);
+    get("/ota?action=off");
+    run(100);
+    HAL::restartThrows(false);
+  }
+
+  // Restarts into the power-on state: the last targets within the first ramp tick, saved once the
+  // lights rest; the lights up and loop() running while the AP is unreachable
+  void fastBoot()
+  {
+    HAL::restartThrows(true);
+    get("/default?power_on=last");
+    get("/light?all=0&ramp=0");
+    get("/light?bulb=90&red=30&ramp=0");
+    run(6000);
+    unsigned long writes = HAL::flashWrites();
+    run(20000);
+    bool still = HAL::flashWrites() == writes;
+    HAL::recordPwm(true);
+    unsigned long restart = millis();
+    try { ESP.restart(); } catch (const HAL::Restart &) { boot(); }
+    run(5000);
+    long lit = -1;
+    for (const HAL::PwmChange &change : HAL::pwmTrace(0)) {
+      if (change.pin == PIN_BULB && change.value > 0 && lit < 0) lit = long(change.time - restart);
+    }
+    HAL::recordPwm(false);
+    std::string status = get("/status"), light = field(status, "light"), wifi = field(status, "wifi");
+    bool restored = status.find("\"bulb\":{\"value\":90,") != std::string::npos && status.find("\"red\":{\"value\":30,") != std::string::npos;
+    printf("%-36s %10s ms to light %6s ms to Wi-Fi %s\n", "boot, power-on last", light.c_str(), wifi.c_str(),
+           verdict(still && restored && lit >= 0 && lit <= 20 && atol(light.c_str()) == lit && atol(wifi.c_str()) > lit));
+
+    // with credentials saved no portal: loop() goes on, the switches answered, the station retrying
+    WiFi.association(ULONG_MAX);
+    unsigned long portals = WiFiManager::portals();
+    try { ESP.restart(); } catch (const HAL::Restart &) { boot(); }
+    run(1000);
+    bool on = HAL::pwm(PIN_BULB) > 0;
+    run(100000);
+    get("/light?bulb=0&ramp=0");
+    run(20);
+    bool answered = HAL::pwm(PIN_BULB) == 0;
+    WiFi.association(2000);
+    run(30000 + 5000);
+    status = get("/status");
+    printf("%-36s %10lu portal, lit %d, switched %d, Wi-Fi after %s ms %s\n", "boot, AP unreachable", WiFiManager::portals() - portals,
+           on, answered, field(status, "wifi").c_str(),
+           verdict(on && answered && WiFiManager::portals() == portals && atol(field(status, "wifi").c_str()) > 101000 &&
+                   atol(field(status, "wifi").c_str()) < 101000 + 30000 + 2000 + 100));
+    get("/default?power_on=default");
+    get("/light?all=0&ramp=0");
+    run(6000);
+    HAL::restartThrows(false);
+  }
+
+  // Output of "program rollover <start>"
+  std::string capture(uint64_t start)
+  {
+    fflush(stdout);
+    std::string output, command = std::string(program) + " rollover " + std::to_string(start);
+    FILE *pipe = popen(command.c_str(), "r");
+    if (!pipe) return output;
+    char buffer[4096];
+    for (size_t length; (length = fread(buffer, 1, sizeof(buffer), pipe)) > 0;) output.append(buffer, length);
+    pclose(pipe);
+    return output;
+  }
+
+  // The same run from boot with the clock starting far from the millis() rollover, then rolling
+  // over at a different point of it each time: the PWM changes and the restart must not move
+  void rollover()
+  {
+    std::string reference = capture(1000000);
+    int identical = 0, runs = 0;
+    for (uint64_t before = 1; before < 40000; before += 1777, ++runs) identical += capture((1ULL << 32) - before) == reference;
+    printf("%-36s %4d/%d runs %6ld changes %s\n", "millis() rollover, 30 s from boot", identical, runs,
+           long(std::count(reference.begin(), reference.end(), '\n')), verdict(identical == runs && reference.find("restart") != std::string::npos));
+  }
+
+  int bench()
+  {
+    const auto nothing = []() {};
+
+    // let the power-on ramps finish
+    web->request("/light?all=off&ramp=0");
+    settle();
+    for (int i = 0; i < 200; ++i) loop();
+
+    printf("%-36s %13s %18s\n", "benchmark", "time", "heap");
+    Duty idle = duty("loop() idle", nothing);
+    // no more than the original loop(), a delay(50) each
+    printf("%-36s %10.2f wake-ups/s %s\n", "idle wake-ups, delay(50) baseline 20", idle.wakeups, verdict(idle.wakeups <= 20));
+
+    // restart the 60 s ramps before they complete
+    unsigned long rampStart = millis() - 60000;
+    Ticker::Timing ticks = Ticker::timing(RAMP_TICK);
+    duty("loop() 5 ramps", [&rampStart]() {
+      if (millis() - rampStart < 50000) return;
+      web->request("/light?all=off&ramp=0");
+      web->handleClient();
+      web->request("/light?all=on&ramp=60000");
+      web->handleClient();
+      rampStart = millis();
+    });
+    // the ticker callbacks themselves, timed as they run
+    printf("%-36s %10.3f us/op\n", "ramp tick, 5 lights", tickCost(RAMP_TICK, ticks));
+
+    // a frame is one tick of the scene player and of the ramps it drives
+    web->request("/light?scene=rainbow");
+    web->handleClient();
+    ticks = Ticker::timing(RAMP_TICK);
+    duty("loop() rainbow scene", nothing);
+    double frame = tickCost(RAMP_TICK, ticks);
+    printf("%-36s %10.3f us/op %8.0f frames/s\n", "scene frame", frame, 1e6 / std::max(frame, 1e-3));
+    web->request("/light?scene=off&all=off&ramp=0");
+    web->handleClient();
+    colors(idle);
+    pwm();
+
+    request("/status render", "/status");
+    request("/light parse (channels)", "/light?bulb=10&red=20&green=30&blue=40&white=50&ramp=0");
+    request("/light parse (all=#hex)", "/light?all=%230a141e2832&ramp=0");
+    request("/light parse (rgb=#hex)", "/light?rgb=%23102030");
+    request("/light parse (rgbw=toggle)", "/light?rgbw=toggle&ramp=100");
+    request("/default parse", "/default?bulb=255&bulb_rampOn=3000&white_rampOff=3000&green_delay=0");
+    pages();
+    request("/metrics render", "/metrics");
+    printf("%-36s %10zu bytes\n", "/metrics", web->response().body.size());
+    printf("%-36s %10zu bytes\n", "heap high-water", HAL::heap().highWater);
+    scheduler();
+    events();
+    sensor();
+    udpControl();
+    mqtt();
+    concurrency();
+    keepAlive();
+    load("load, 8 automations for 60 s", synthesize(8, 60000, 3));
+    {
+      // a dashboard slider dragged while another automation toggles the bulb
+      std::istringstream trace("/light?white=10&ramp=300\nwait 40\n/light?white=60&ramp=300\nwait 40\n"
+                               "/light?white=120&ramp=300\n/light?bulb=toggle&ramp=1000\nwait 40\n/status\n"
+                               "/light?white=200&ramp=300\nwait 40\n/light?bulb=toggle&ramp=1000\n/light?white=255&ramp=300\n");
+      WiFiUDP client;
+      load("replay, slider and toggles", schedule(trace, millis(), client) + 1);
+    }
+    powerSave(idle);
+    persistence();
+    snapshot();
+    rollover();
+    firmwareUpdate();
+    fastBoot();
+    // the devices of the group are forked from a process that did not run the sketch yet
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      execl(program, program, "group", (char *)nullptr);
+      _exit(1);
+    }
+    int status = 1;
+    waitpid(pid, &status, 0);
+    return failures || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ? 1 : 0;
+  }
+
+  // Group mode: device 0 is the controller, the others run the sketch with their own boot time
+  // and clock drift
+  const int GROUP_SIZE = 4;
+  const unsigned long GROUP_LATENCIES[GROUP_SIZE] = { 3, 27, 11, 45 };   // ms - to each device, unicast
+
+  uint32_t readTime(const uint8_t *bytes)
+  {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+  }
+
+  // Group clock now and master, from the next beacon heard
+  bool groupClock(WiFiUDP &client, uint32_t &clock, uint32_t &master)
+  {
+    while (client.parsePacket() > 0) {}
+    for (int i = 0; i < 2000; ++i, HAL::advance(1)) {
+      while (client.parsePacket() > 0) {
+        uint8_t packet[16];
+        if (client.read(packet, sizeof(packet)) != 13 || packet[0] != 7) continue;
+        clock = readTime(packet + 5);
+        master = readTime(packet + 9);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Bulb command to a device, or to all of them through the multicast group; 'start' on the group clock, 0 for at once
+  void groupCommand(WiFiUDP &client, int device, uint8_t value, uint16_t ramp, uint32_t start = 0)
+  {
+    uint8_t packet[16] = { uint8_t(start ? 0x41 : 0x01), 0, 0x01, uint8_t(ramp >> 8), uint8_t(ramp) };
+    size_t length = 5;
+    for (int shift = 24; start && shift >= 0; shift -= 8) packet[length++] = uint8_t(start >> shift);
+    packet[length++] = value;
+    client.beginPacket(device ? IPAddress(127, 0, 0, 1 + device) : SYNC_GROUP, UDP_LIGHT_PORT);
+    client.write(packet, length);
+    client.endPacket();
+  }
+
+  // ms between the first and the last device starting (or ending) a bulb ramp since 'since', -1 if one did not
+  long groupSpread(int first, int last, unsigned long since, bool end)
+  {
+    unsigned long earliest = ULONG_MAX, latest = 0;
+    for (int device = first; device <= last; ++device) {
+      unsigned long time = ULONG_MAX;
+      for (const HAL::PwmChange &change : HAL::pwmTrace(device)) {
+        if (change.pin != PIN_BULB || change.time < since) continue;
+        if (time == ULONG_MAX || end) time = change.time;
+      }
+      if (time == ULONG_MAX) return -1;
+      earliest = std::min(earliest, time);
+      latest = std::max(latest, time);
+    }
+    return long(latest - earliest);
+  }
+
+  // Bulbs off at once, then 'command' at the current time
+  template<typename Command>
+  unsigned long groupRun(WiFiUDP &client, Command command)
+  {
+    groupCommand(client, 0, 0, 0);
+    HAL::advance(500);
+    unsigned long since = millis();
+    command();
+    HAL::advance(3000);
+    return since;
+  }
+
+  int group()
+  {
+    const long ppm[GROUP_SIZE] = { 40, -30, 15, -45 };
+    for (int i = 0; i < GROUP_SIZE; ++i) HAL::spawn(800 * i + 100 * (i % 2), ppm[i], setup, loop);
+    WiFiUDP client;
+    client.beginMulticast(IPAddress(127, 0, 0, 1), SYNC_GROUP, UDP_LIGHT_PORT);
+    HAL::advance(15000);
+    uint32_t clock = 0, master = 0;
+    bool heard = groupClock(client, clock, master);
+    printf("%-36s %10x %s\n", "group master elected", master, verdict(heard && master == 0x00C0FFEF));
+
+    // the same ramp started by a unicast command to each device, as many senders or HTTP requests would
+    unsigned long since = groupRun(client, [&client]() {
+      for (int i = 0; i < GROUP_SIZE; ++i) {
+        HAL::at(millis() + GROUP_LATENCIES[i], [&client, i]() { groupCommand(client, i + 1, 255, 2000); });
+      }
+    });
+    printf("%-36s %10ld ms\n", "group ramp start spread, unicast", groupSpread(1, GROUP_SIZE, since, false));
+
+    // one multicast command scheduled 200 ms ahead
+    since = groupRun(client, [&client, &clock, &master]() {
+      groupClock(client, clock, master);
+      groupCommand(client, 0, 255, 2000, clock + 200);
+    });
+    long start = groupSpread(1, GROUP_SIZE, since, false), end = groupSpread(1, GROUP_SIZE, since, true);
+    printf("%-36s %10ld ms start %4ld ms end %s\n", "group ramp spread, UDP_AT", start, end,
+           verdict(start >= 0 && start <= 2 && end <= 2));
+
+    // scheduled for now but delivered late, by as much as the unicast commands: the shortened ramps
+    // end together, within the ramp tick they are stepped by
+    since = groupRun(client, [&client, &clock, &master]() {
+      groupClock(client, clock, master);
+      for (int i = 0; i < GROUP_SIZE; ++i) {
+        uint32_t now = clock;
+        HAL::at(millis() + GROUP_LATENCIES[i], [&client, i, now]() { groupCommand(client, i + 1, 255, 2000, now); });
+      }
+    });
+    end = groupSpread(1, GROUP_SIZE, since, true);
+    printf("%-36s %10ld ms end %s\n", "group UDP_AT delivered 3-45 ms late", end, verdict(end >= 0 && end <= 10));
+
+    // the master is powered off: the next one takes over, its clock carries on
+    HAL::stop(1);
+    HAL::advance(10000);
+    heard = groupClock(client, clock, master);
+    since = groupRun(client, [&client, &clock, &master]() {
+      groupClock(client, clock, master);
+      groupCommand(client, 0, 255, 2000, clock + 200);
+    });
+    start = groupSpread(2, GROUP_SIZE, since, false);
+    printf("%-36s %10ld ms start, master %x %s\n", "group master lost", start, master,
+           verdict(heard && master == 0x00C0FFF0 && start >= 0 && start <= 2));
+    for (int i = 1; i <= GROUP_SIZE; ++i) HAL::stop(i);
+    return failures ? 1 : 0;
+  }
+
+  // Random light commands and sensor presses for 30 s from boot, then a reboot request
+  int rollover(uint64_t start)
+  {
+    static const char *const lights[] = { "bulb", "red", "green", "blue", "white", "rgbw", "all" };
+    HAL::startClock(start);
+    HAL::restartThrows(true);
+    HAL::recordPwm(true);
+    uint32_t boot = millis(), seed = 7;
+    setup();
+    web = &ESP8266WebServer::simulated();
+    uint32_t t = boot + 100;
+    HAL::at(t, []() { web->request("/default?bulb_delay=1500&white_delay=4000"); });
+    while (uint32_t(t - boot) < 30000) {
+      t += 50 + random(seed, 700);
+      char uri[64];
+      snprintf(uri, sizeof(uri), "/light?%s=%u&ramp=%u", lights[random(seed, 7)], random(seed, 256), random(seed, 3000));
+      std::string request(uri);
+      HAL::at(t, [request]() { web->request(request.c_str()); });
+      if (random(seed, 6) == 0) {
+        HAL::at(t + 20, []() { HAL::setInput(PIN_SENSOR, HIGH); });
+        HAL::at(t + 40 + random(seed, 900), []() { HAL::setInput(PIN_SENSOR, LOW); });
+      }
+    }
+    HAL::at(t + 1000, []() { web->request("/reboot"); });
+    try {
+      run(uint32_t(t - millis()) + 10000);
+    }
+    catch (const HAL::Restart &) {
+      printf("restart %u\n", uint32_t(millis() - boot));
+    }
+    for (const HAL::PwmChange &change : HAL::pwmTrace(0)) printf("%u %u %d\n", uint32_t(change.time - boot), change.pin, change.value);
+    return 0;
+  }
+
+  // Requests are delivered at their virtual time, while loop() runs (or sleeps) as usual
+  // Load mode: the lights settle, then synthetic automations or a trace replayed from a file
+  int loadMode(const char *trace, int clients, unsigned long seconds, uint32_t seed)
+  {
+    get("/light?all=off&ramp=0");
+    run(1000);
+    if (!trace) {
+      char name[64];
+      snprintf(name, sizeof(name), "load, %d automations for %lu s", clients, seconds);
+      return load(name, synthesize(clients, seconds * 1000, seed)) ? 0 : 1;
+    }
+    std::ifstream in(trace);
+    if (!in) {
+      fprintf(stderr, "cannot read %s\n", trace);
+      return 1;
+    }
+    WiFiUDP client;
+    client.begin(4211);
+    return load(trace, schedule(in, millis(), client) + 1) ? 0 : 1;
+  }
+
+  int serve()
+  {
+    WiFiUDP client;
+    client.begin(4211);
+    unsigned long t = schedule(std::cin, millis(), client);
+    web->onResponse([](const ESP8266WebServer::Response &response) {
+      printf("%lu %d %s\n%s\n", millis(), response.code, response.contentType.c_str(), response.body.c_str());
+    });
+    run(t - millis() + 1);
+    settle();
+    while (client.parsePacket() > 0) {
+      printf("udp ");
+      for (int byte; (byte = client.read()) >= 0;) printf("%02x", byte);
+      printf("\n");
+    }
+    return 0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::string mode = argc > 1 ? argv[1] : "bench";
+  program = argv[0];
+  if (mode == "group") return group();
+  if (mode == "rollover") return rollover(argc > 2 ? strtoull(argv[2], NULL, 10) : 0);
+  setup();
+  web = &ESP8266WebServer::simulated();
+  if (mode == "bench") return bench();
+  if (mode == "serve") return serve();
+  if (mode == "load") {
+    return loadMode(nullptr, argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? strtoul(argv[3], NULL, 10) : 60,
+                argc > 4 ? strtoul(argv[4], NULL, 10) : 1);
+  }
+  if (mode == "replay" && argc > 2) return loadMode(argv[2], 0, 0, 0);
+  fprintf(stderr, "usage: %s [bench|group|rollover ms|serve|load [clients [s [seed]]]|replay trace]\n", argv[0]);
+  return 1;
+}
@@ -0,0 +1,18 @@
+// Host replacement for the subset of the NONOS SDK user_interface.h used by AnnaHand.
+
+#ifndef NATIVE_HAL_USER_INTERFACE_H
+#define NATIVE_HAL_USER_INTERFACE_H
+
+#include <stdint.h>
+
+struct station_config {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  uint8_t bssid_set;
+  uint8_t bssid[6];
+};
+
+bool wifi_station_get_config(struct station_config *config);
+void system_restore();
+
+#endif
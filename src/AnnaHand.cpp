@@ -1,7 +1,9 @@
-// Lolin Wemos D1 R2 flash size 0fs
+// Lolin Wemos D1 R2 flash size 4M1M (FS region holds the settings log, no filesystem is mounted)
 
 #define ENABLE_ARDUINOOTA
 #define ENABLE_UPDATE
+#define ENABLE_MQTT
+#define ENABLE_POWER_SAVE
 
 #ifdef ENABLE_ARDUINOOTA
 # define NO_GLOBAL_ARDUINOOTA
@@ -12,6 +14,18 @@
 #include <WiFiClient.h>
 #include <EEPROM.h>
 #include <ESP8266WebServer.h>
+#include <WiFiUdp.h>
+#include <Ticker.h>
+#include <FlashLog.h>
+#include <FirmwareUpdate.h>
+#include <ColorSpace.h>
+#include <core_esp8266_waveform.h>
+#include <coredecls.h>        // esp_delay(), esp_schedule()
+#ifdef ENABLE_MQTT
+# include <MqttClient.h>
+# include <lwip/dns.h>
+#endif
+#include "WebAssets.h"  // generated from web/ by tools/web_assets.py
 
 #define SERIAL_DEBUG false               // Enable / Disable log - activer / désactiver le journal
 
@@ -33,287 +47,2099 @@
 #define URI_INFO "/info"
 #define URI_LIGHT "/light"
 #define URI_DEFAULT "/default"
+#define URI_EVENTS "/events"
+#define URI_METRICS "/metrics"
+#define URI_SNAPSHOT "/snapshot"
+
+// Idle scheduling - loop() sleeps until the next deadline instead of a fixed period. A sensor edge
+// wakes it at once (esp_schedule()), a frame does not: lwIP queues it without waking the loop task,
+// so the sockets are polled meanwhile, every IDLE_POLL while clients are about or the lights move
+// (see idlePoll()), else every IDLE_POLL_QUIET as the former delay(50) loop did.
+#define IDLE_MAX_SLEEP   1000  // ms - longest sleep when nothing is scheduled
+#define IDLE_POLL        10    // ms - socket poll period while sleeping, the radio awake
+#define IDLE_POLL_QUIET  50    // ms - the same with no client about
+#define IDLE_ACTIVE      5000  // ms - clients are about that long after a request or a datagram
+static unsigned long idleClientSeen = 0;   // millis() of the last request or command datagram
+#define OTA_POLL_PERIOD  10    // ms - ArduinoOTA must be polled for its UDP packets
+
+// Metrics - counters and histograms updated in place (an increment and a few compares per event),
+// only formatted when /metrics is scraped
+#define METRIC_BUCKETS 8   // histogram buckets, x4 apart from 16 us, the last one is +Inf
+
+struct Histogram
+{
+  uint32_t counts[METRIC_BUCKETS];
+  uint64_t sum;     // us
+  uint32_t max;     // us
+  void add(uint32_t us)
+  {
+    size_t bucket = 0;
+    while (bucket < METRIC_BUCKETS - 1 && us > (16UL << (2 * bucket))) ++bucket;
+    ++counts[bucket];
+    sum += us;
+    if (us > max) max = us;
+  }
+};
+
+static const char* const METRIC_URIS[] = { URI_ROOT, URI_INFO, URI_USAGE, URI_STATUS, URI_EVENTS, URI_METRICS, URI_LIGHT,
+                                           URI_DEFAULT, URI_WIFI, URI_REBOOT, URI_OTA, URI_UPDATE };
+#define METRIC_URI_COUNT (sizeof(METRIC_URIS) / sizeof(METRIC_URIS[0]))
+
+struct UriMetrics
+{
+  uint32_t requests;
+  uint64_t sum;     // us - handler time
+  uint32_t max;     // us
+};
+
+static struct Metrics
+{
+  Histogram loop;           // loop() without its sleep
+  Histogram rampJitter;     // deviation of the ramp tick period from RAMP_TICK
+  uint32_t lastTick;        // us - 0 when the ramp ticker is stopped
+  UriMetrics uris[METRIC_URI_COUNT + 1];   // the last one is any other URI
+  uint32_t httpTimeouts;    // connections closed before sending their request
+  uint32_t udpDatagrams;
+  uint32_t heapFreeMin;     // bytes
+  uint32_t wifiDisconnects;
+  uint32_t mqttConnects;    // connection attempts
+  uint32_t mqttPublishes;   // light states
+  uint32_t bootStart;       // us - micros() when setup() started
+  uint32_t bootLight;       // us after bootStart of the first light output, 0 until then
+  uint32_t bootWifi;        // ms after setup() started of the first Wi-Fi connection, 0 until then
+
+  void request(const char* uri, uint32_t us)
+  {
+    size_t i = 0;
+    while (i < METRIC_URI_COUNT && strcmp(uri, METRIC_URIS[i]) != 0) ++i;
+    ++uris[i].requests;
+    uris[i].sum += us;
+    if (us > uris[i].max) uris[i].max = us;
+  }
+} metrics;
+
+// HTTP connections - the core reads a request with a blocking stream timeout, serves one connection
+// at a time and keeps it until the client closes it. Connections are accepted here instead, wait in
+// slots (each with its own timeout) until their request head and a short body have arrived, are
+// only then handed to the core, and go back to their slot after the response if both sides keep
+// them alive: the client's next request waits there too, an idle one gives its slot up to a new
+// connection. A longer body does not fit in the TCP window of a slot: an /update or /snapshot
+// upload is read by the core as it arrives, any other request is answered 413 without reading it.
+#define HTTP_CLIENTS       4     // connections waiting for their request, the next ones stay in the TCP backlog
+#define HTTP_HEAD_TIMEOUT  2000  // ms - a connection that has not sent its request by then is closed
+#define HTTP_HEAD_PEEK     512   // bytes - a longer head is handed over without looking for its end
+#define HTTP_BODY_WAIT     1024  // bytes - a body up to this size is waited for in the slot, a longer one refused
+
+class LightServer : public ESP8266WebServer
+{
+  public:
+    LightServer(int port): ESP8266WebServer(port) {}
+    // Accepts, checks and serves the connections, never waits for one
+    void poll()
+    {
+      unsigned long currentTime = millis();
+      for (Connection& connection : m_connections) {
+        // a kept connection closed by its client, or idle with a new one waiting
+        if (connection.kept && !connection.client.available() && (!connection.client.connected() || _server.hasClient())) {
+          release(connection);
+        }
+        if (!connection.client && _server.hasClient()) {
+          connection.client = _server.accept();
+          connection.kept = false;
+          wait(connection, currentTime);
+        }
+        if (!connection.client) continue;
+        if (requestReceived(connection)) {
+          keepAlive(connection.keep);
+          _currentClient = connection.client;
+          connection.client = WiFiClient();
+          _currentStatus = HC_WAIT_READ;
+          _statusChange = currentTime;
+          uint32_t start = micros();
+          handleClient();
+          metrics.request(uri().c_str(), micros() - start);
+          idleClientSeen = millis();
+          // not waiting for the client to close: kept alive (the core said so in the response, and
+          // it ended with a length), else released, a /events subscriber keeps its own copy
+          if (_keepAlive && _contentLength != CONTENT_LENGTH_UNKNOWN && _currentClient.connected()) {
+            connection.client = _currentClient;
+            connection.kept = true;
+            wait(connection, millis());
+          }
+          _currentClient = WiFiClient();
+          _currentStatus = HC_NONE;
+        }
+        else if ((uint32_t)(currentTime - connection.accepted) >= HTTP_HEAD_TIMEOUT) {
+          if (!connection.kept) ++metrics.httpTimeouts;
+          release(connection);
+        }
+      }
+    }
+    // A new connection or new bytes on a waiting one: poll() has work to do
+    bool busy()
+    {
+      bool free = false;
+      for (Connection& connection : m_connections) {
+        if (!connection.client) free = true;
+        else if (connection.client.available() != connection.seen) return true;
+        else if (connection.kept && !connection.seen) free = true;
+      }
+      return free && _server.hasClient();
+    }
+    // A connection in a slot, waiting for its request or kept for the next one
+    bool active()
+    {
+      for (Connection& connection : m_connections) {
+        if (connection.client) return true;
+      }
+      return false;
+    }
+    // Time (ms) until poll() has something to do: a connection timeout
+    unsigned long nextUpdate(unsigned long currentTime)
+    {
+      unsigned long next = IDLE_MAX_SLEEP;
+      for (Connection& connection : m_connections) {
+        if (connection.client) next = MIN(next, (unsigned long)MAX(0, (int32_t)(connection.accepted + HTTP_HEAD_TIMEOUT - currentTime)));
+      }
+      return next;
+    }
+  protected:
+    struct Connection
+    {
+      WiFiClient client;
+      unsigned long accepted;   // or served its last request
+      int seen;                 // bytes available at the last check
+      int needed;               // bytes of the request (head and body), 0 until the head is in
+      bool keep;                // the request asks to keep the connection
+      bool kept;                // served a request, waiting for the next one
+    };
+    void wait(Connection& connection, unsigned long currentTime)
+    {
+      connection.accepted = currentTime;
+      connection.seen = 0;
+      connection.needed = 0;
+      connection.keep = false;
+    }
+    void release(Connection& connection)
+    {
+      connection.client.stop();
+      connection.client = WiFiClient();
+      connection.kept = false;
+    }
+    // The request head (up to the blank line) and a body of up to HTTP_BODY_WAIT have arrived, the
+    // core can read them without waiting; a longer body is refused here, unless it is an upload
+    bool requestReceived(Connection& connection)
+    {
+      int available = connection.client.available();
+      if (available == connection.seen) return false;
+      connection.seen = available;
+      if (connection.needed) return available >= connection.needed;
+      if (available >= HTTP_HEAD_PEEK) return true;
+      char head[HTTP_HEAD_PEEK];
+      size_t length = connection.client.peekBytes((uint8_t*)head, available), end = 0;
+      for (size_t i = 3; i < length && !end; ++i) {
+        if (head[i - 3] == '\r' && head[i - 2] == '\n' && head[i - 1] == '\r' && head[i] == '\n') end = i + 1;
+      }
+      if (!end) return false;
+      // HTTP/1.1 keeps the connection unless told otherwise, HTTP/1.0 only when asked to
+      const char* line = (const char*)memchr(head, '\r', end);
+      bool http11 = line - head >= 8 && memcmp(line - 8, "HTTP/1.1", 8) == 0;
+      const char* value = field(head, end, "Connection");
+      connection.keep = http11 ? !value || strncasecmp(value, "close", 5) != 0 : value && strncasecmp(value, "keep-alive", 10) == 0;
+      value = field(head, end, "Content-Length");
+      unsigned long body = value ? strtoul(value, NULL, 10) : 0;
+      if (body > HTTP_BODY_WAIT && isUpload(head)) return true;
+      if (body > HTTP_BODY_WAIT) {
+        static const char TOO_LARGE[] = "HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        connection.client.write((const uint8_t*)TOO_LARGE, sizeof(TOO_LARGE) - 1);
+        release(connection);
+        return false;
+      }
+      connection.needed = end + body;
+      return available >= connection.needed;
+    }
+    // The request line of 'head' is a POST to a URI taking a file upload
+    static bool isUpload(const char* head)
+    {
+      static const char* const uris[] = { URI_UPDATE, URI_SNAPSHOT };
+      if (strncmp(head, "POST ", 5) != 0) return false;
+      for (const char* uri : uris) {
+        size_t length = strlen(uri);
+        if (strncmp(head + 5, uri, length) == 0 && (head[5 + length] == ' ' || head[5 + length] == '?')) return true;
+      }
+      return false;
+    }
+    // Value of the header field 'name' in the request head, NULL if absent
+    static const char* field(const char* head, size_t end, const char* name)
+    {
+      size_t length = strlen(name);
+      for (const char* line = head; line && line + length + 1 < head + end; ) {
+        const char* next = (const char*)memchr(line, '\n', head + end - line);
+        if (next && strncasecmp(line, name, length) == 0 && line[length] == ':') {
+          const char* value = line + length + 1;
+          while (*value == ' ') ++value;
+          return value;
+        }
+        line = next ? next + 1 : NULL;
+      }
+      return NULL;
+    }
+
+    Connection m_connections[HTTP_CLIENTS];
+};
+LightServer server ( WEB_SERVER_PORT );
+
+#define OTA_TIMER (10*60)
+#define FLASH_TIMER (10)
+#define REBOOT_TIMER (3)
+#define OTA_REBOOT_TIMER (1)
+
+unsigned long rebootRequested = 0;   // millis() deadline, 0 if none
+unsigned long otaOnTimer = 0;
+
+// Firmware updates - /update and ArduinoOTA images go through FirmwareUpdate: a new image runs on
+// trial and is confirmed once connected for UPDATE_CONFIRM_TIME, or once loop() kept running for
+// UPDATE_CONFIRM_OFFLINE without the AP (an outage is no reason to roll back). The previous one
+// comes back after UPDATE_BOOT_ATTEMPTS boots without that: crashes or watchdog resets.
+#define UPDATE_BOOT_ATTEMPTS 3        // boots - of an image on trial before rolling back
+#define UPDATE_CONFIRM_TIME  60000    // ms - connected uptime confirming an image on trial
+#define UPDATE_CONFIRM_OFFLINE 600000 // ms - uptime confirming it without Wi-Fi
+#define UPDATE_RTC_BLOCK     32       // RTC user memory block of the trial record, after the eboot command
+
+FirmwareUpdate firmware(UPDATE_RTC_BLOCK, UPDATE_BOOT_ATTEMPTS);
+static unsigned long bootTime = 0;
+
+#define PIN_SENSOR          D0  // GPIO16
+#define PIN_LED_HAND_LIGHT  D5  // GPIO14
+#define PIN_LED_HAND_RGBW_R D4  // GPIO2 (builtin led)
+#define PIN_LED_HAND_RGBW_G D3  // GPIO0
+#define PIN_LED_HAND_RGBW_B D2  // GPIO4
+#define PIN_LED_HAND_RGBW_W D1  // GPIO5
+#define LIGHT_COUNT 5
+
+// Light channels: URI_LIGHT / URI_DEFAULT argument name, pin and groups, in Lights order
+enum { GROUP_ALL = 0x01, GROUP_RGBW = 0x02, GROUP_RGB = 0x04 };
+#define CHANNEL_NAME_SIZE 8
+struct Channel
+{
+  char name[CHANNEL_NAME_SIZE];
+  uint8_t pin;
+  uint8_t groups;
+};
+static constexpr Channel CHANNELS[LIGHT_COUNT] PROGMEM = {
+  { "bulb",  PIN_LED_HAND_LIGHT,  GROUP_ALL },
+  { "red",   PIN_LED_HAND_RGBW_R, GROUP_ALL | GROUP_RGBW | GROUP_RGB },
+  { "green", PIN_LED_HAND_RGBW_G, GROUP_ALL | GROUP_RGBW | GROUP_RGB },
+  { "blue",  PIN_LED_HAND_RGBW_B, GROUP_ALL | GROUP_RGBW | GROUP_RGB },
+  { "white", PIN_LED_HAND_RGBW_W, GROUP_ALL | GROUP_RGBW },
+};
+
+// Mask of the Lights indices belonging to a group, resolved at compile time
+static constexpr uint8_t groupLights(uint8_t group, size_t i = 0)
+{
+  return i == LIGHT_COUNT ? 0 : ((CHANNELS[i].groups & group) ? 1 << i : 0) | groupLights(group, i + 1);
+}
+
+// Light defaults are kept in RAM and appended to a log in the FS flash region once they stop changing
+#define SETTINGS_VERSION 7     // 2 appended the sensor scene to the records of version 1, 3 the sensor actions, 4 the MQTT broker, 5 the power latency, 6 the PWM frequency, 7 the power-on state
+#define SETTINGS_QUIET   5000  // ms - a burst of /default requests is flushed once
+#define SETTINGS_SECTORS 4     // log size, one erase every 32 flushes
+#define SETTINGS_SLOT    128   // bytes - log header + Settings
+#define LEGACY_EEPROM_SIZE 64  // bytes per light in the EEPROM sector of version 1.01
+
+// Ramps are stepped by a timer at a fixed rate, independently of loop() and HTTP handling
+#define RAMP_TICK  10  // ms - 100 Hz
+
+// PWM output - the core waveform generator, one waveform per channel at pwmFrequency, see Ramps
+#define PWM_FREQUENCY     1000  // Hz - default
+#define PWM_FREQUENCY_MIN 100   // Hz
+#define PWM_FREQUENCY_MAX 4000  // Hz - 20000 CPU cycles, some 20 a duty step
+#define PWM_FINE_BITS     4     // duty bits below one step, in the high time of every period
+
+static uint16_t pwmFrequency = PWM_FREQUENCY;
+static uint32_t pwmPeriod = microsecondsToClockCycles(1000000UL) / PWM_FREQUENCY;   // CPU cycles
+
+// Duty cycle in 1 / 2^PWM_FINE_BITS steps for a brightness in 8.8 fixed point, interpolated
+// between ColorSpace::GAMMA entries
+static int gammaDuty(unsigned int level)
+{
+  unsigned int index = level >> 8, fraction = level & 0xFF;
+  uint32_t duty = pgm_read_word(&ColorSpace::GAMMA[index]);
+  if (fraction && index < 255) {
+    duty += ((pgm_read_word(&ColorSpace::GAMMA[index + 1]) - duty) * fraction) >> 8;
+  }
+  duty = (duty * (PWMRANGE << PWM_FINE_BITS) + 0x8000) >> 16;
+  // a light that is on never goes fully dark
+  return (level && duty < (1 << PWM_FINE_BITS)) ? 1 << PWM_FINE_BITS : duty;
+}
+
+static Ticker rampTicker;
+static void rampTick();
+
+// Persistent defaults of a light, as stored in the settings log
+struct LightSettings
+{
+  uint16_t value;
+  uint16_t rampOn;
+  uint16_t rampOff;
+  uint16_t last;         // version 7, target when saved (power-on state POWER_ON_LAST), 0 before
+  uint32_t delay;
+};
+
+// Ramps of all the lights, one array per field: a tick steps the running ones in a single loop
+// over their mask, one add (16.16 fixed point, the increment is computed when the ramp starts)
+// and one duty lookup each, and costs nothing for the lights at rest. Red, green and blue ramping
+// together (blend()) go through HSV instead: one conversion a tick, the hue taking the shorter way
+// round, so that a fade between two colours stays saturated instead of crossing greys.
+// The duty keeps PWM_FINE_BITS more than PWMRANGE: the waveform generator times the high part of
+// every period in CPU cycles, some 5 a fine step at 1 kHz, so the low duties get the extra
+// resolution in each period instead of alternating between two duties (a light at rest costs no
+// tick). At the higher frequencies a fine step is down to a cycle or two and the generator's edge
+// timing drops the extra bits. The waveforms of the channels start a fifth of the period after each
+// other (the phase locked generator, see setup()), so that the LED drivers do not all switch on at
+// once.
+#define COLOR_LIGHTS groupLights(GROUP_RGB)   // red, green and blue, in Lights order
+struct Ramps
+{
+  uint32_t level[LIGHT_COUNT];       // brightness, 16.16 fixed point
+  int32_t step[LIGHT_COUNT];         // level increment per tick
+  uint32_t remaining[LIGHT_COUNT];   // ticks to the target
+  uint32_t ticks[LIGHT_COUNT];       // ticks of the whole ramp
+  uint8_t target[LIGHT_COUNT];
+  int duty[LIGHT_COUNT];             // last written (0..PWMRANGE, rounded), -1 before the first write
+  int fine[LIGHT_COUNT];             // last written, 1 / 2^PWM_FINE_BITS steps
+  uint8_t running;                   // mask of Lights indices
+  uint8_t colored;                   // COLOR_LIGHTS when they ramp in HSV, else 0
+  int32_t hsv[3];                    // hue, saturation, value (0-255), 16.16 fixed point
+  int32_t hsvStep[3];
+
+  int value(size_t i) const { return (level[i] + 0x8000) >> 16; }
+
+  void start(size_t i, uint8_t value, uint32_t count)
+  {
+    if (colored & (1 << i)) unblend();
+    target[i] = value;
+    if (count > 0 && value != this->value(i)) {
+      step[i] = (((int32_t)value << 16) - (int32_t)level[i]) / (int32_t)count;
+      ticks[i] = remaining[i] = count;
+      running |= 1 << i;
+    }
+    else {
+      ticks[i] = remaining[i] = 0;
+      running &= ~(1 << i);
+      level[i] = (uint32_t)value << 16;
+      write(i);
+    }
+  }
+
+  bool active() const { return running; }
+
+  // One RAMP_TICK step of every running ramp, returns true while one is left
+  bool tick()
+  {
+    for (uint8_t lights = running & ~colored; lights; lights &= lights - 1) {
+      int i = __builtin_ctz(lights);
+      level[i] = --remaining[i] ? level[i] + step[i] : (uint32_t)target[i] << 16;
+      if (!remaining[i]) running &= ~(1 << i);
+      write(i);
+    }
+    if (colored) tickColor();
+    return active();
+  }
+
+  // The ramps just started on 'lights' interpolate the colour instead of each channel, if they
+  // include red, green and blue and those that move take as long
+  void blend(uint8_t lights)
+  {
+    if ((lights & COLOR_LIGHTS) != COLOR_LIGHTS) return;
+    uint32_t count = 0;
+    uint16_t from[3], to[3];
+    for (size_t i = 0, k = 0; i < LIGHT_COUNT; ++i) {
+      if (!(COLOR_LIGHTS & (1 << i))) continue;
+      if (running & (1 << i)) {
+        if (count && remaining[i] != count) return;
+        count = remaining[i];
+      }
+      from[k] = (level[i] + 0x80) >> 8;
+      to[k++] = target[i] << 8;
+    }
+    if (count < 2) return;
+    uint16_t hue[2], value[2];
+    uint8_t saturation[2];
+    ColorSpace::rgbToHsv(from, hue[0], saturation[0], value[0]);
+    ColorSpace::rgbToHsv(to, hue[1], saturation[1], value[1]);
+    // from or to black or grey, only the brightness or the saturation changes
+    if (!value[0]) saturation[0] = saturation[1];
+    if (!value[1]) saturation[1] = saturation[0];
+    if (!saturation[0]) hue[0] = hue[1];
+    if (!saturation[1]) hue[1] = hue[0];
+    int32_t turn = (int32_t)hue[1] - hue[0];
+    if (turn > ColorSpace::HUE_RANGE / 2) turn -= ColorSpace::HUE_RANGE;
+    else if (turn < -ColorSpace::HUE_RANGE / 2) turn += ColorSpace::HUE_RANGE;
+    hsv[0] = (int32_t)hue[0] << 16;
+    hsv[1] = (int32_t)saturation[0] << 16;
+    hsv[2] = (int32_t)value[0] << 8;
+    hsvStep[0] = (turn << 16) / (int32_t)count;
+    hsvStep[1] = (((int32_t)saturation[1] - saturation[0]) << 16) / (int32_t)count;
+    hsvStep[2] = (((int32_t)value[1] - value[0]) << 8) / (int32_t)count;
+    for (uint8_t rest = COLOR_LIGHTS; rest; rest &= rest - 1) {
+      int i = __builtin_ctz(rest);
+      ticks[i] = remaining[i] = count;
+    }
+    running |= COLOR_LIGHTS;
+    colored = COLOR_LIGHTS;
+  }
+
+  // Back to a linear ramp per channel, from where the colour is to the same targets
+  void unblend()
+  {
+    for (uint8_t lights = colored; lights; lights &= lights - 1) {
+      int i = __builtin_ctz(lights);
+      step[i] = (((int32_t)target[i] << 16) - (int32_t)level[i]) / (int32_t)remaining[i];
+    }
+    colored = 0;
+  }
+
+  void tickColor()
+  {
+    uint16_t rgb[3];
+    bool done = --remaining[__builtin_ctz(colored)] == 0;
+    if (!done) {
+      for (int k = 0; k < 3; ++k) hsv[k] += hsvStep[k];
+      if (hsv[0] < 0) hsv[0] += ColorSpace::HUE_RANGE << 16;
+      else if (hsv[0] >= ColorSpace::HUE_RANGE << 16) hsv[0] -= ColorSpace::HUE_RANGE << 16;
+      ColorSpace::hsvToRgb(hsv[0] >> 16, hsv[1] >> 16, hsv[2] >> 8, rgb);
+    }
+    for (size_t i = 0, k = 0; i < LIGHT_COUNT; ++i) {
+      if (!(colored & (1 << i))) continue;
+      remaining[i] = remaining[__builtin_ctz(colored)];
+      level[i] = done ? (uint32_t)target[i] << 16 : (uint32_t)rgb[k++] << 8;
+      write(i);
+    }
+    if (done) {
+      running &= ~colored;
+      colored = 0;
+    }
+  }
+
+  void write(size_t i)
+  {
+    int value = gammaDuty((level[i] + 0x80) >> 8);
+    if (value == fine[i] && duty[i] >= 0) return;
+    fine[i] = value;
+    duty[i] = value ? MAX(1, (value + (1 << (PWM_FINE_BITS - 1))) >> PWM_FINE_BITS) : 0;
+    output(i);
+  }
+
+  // The duty of a light to its pin: a waveform following the first light that has one, by a fifth
+  // of the period a light in between (the core only aligns a waveform as it starts)
+  void output(size_t i)
+  {
+    if (!metrics.bootLight && duty[i] > 0) metrics.bootLight = MAX(1, (uint32_t)(micros() - metrics.bootStart));
+    uint8_t pin = pgm_read_byte(&CHANNELS[i].pin);
+    if (duty[i] <= 0 || duty[i] >= PWMRANGE) {
+      stopWaveform(pin);
+      digitalWrite(pin, duty[i] > 0 ? HIGH : LOW);
+      return;
+    }
+    size_t first = 0;
+    while (first < LIGHT_COUNT && (first == i || duty[first] <= 0 || duty[first] >= PWMRANGE)) ++first;
+    int8_t align = first < LIGHT_COUNT ? pgm_read_byte(&CHANNELS[first].pin) : -1;
+    uint32_t phase = first < LIGHT_COUNT ? (i + LIGHT_COUNT - first) % LIGHT_COUNT * (pwmPeriod / LIGHT_COUNT) : 0;
+    uint32_t high = ((uint64_t)fine[i] * pwmPeriod + (PWMRANGE << (PWM_FINE_BITS - 1))) / (PWMRANGE << PWM_FINE_BITS);
+    startWaveformClockCycles(pin, high, pwmPeriod - high, 0, align, phase, true);
+  }
+
+  // After a frequency change: every waveform again, in phase
+  void restart()
+  {
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) stopWaveform(pgm_read_byte(&CHANNELS[i].pin));
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+      if (duty[i] > 0) output(i);
+    }
+  }
+};
+static Ramps ramps;
+
+// Clamped to PWM_FREQUENCY_MIN..PWM_FREQUENCY_MAX, the lights keep their duty
+static void setPwmFrequency(unsigned long frequency)
+{
+  frequency = MAX(PWM_FREQUENCY_MIN, MIN(frequency, PWM_FREQUENCY_MAX));
+  if (frequency == pwmFrequency) return;
+  pwmFrequency = frequency;
+  pwmPeriod = microsecondsToClockCycles(1000000UL) / frequency;
+  ramps.restart();
+}
+
+class Light
+{
+  public:
+    constexpr Light(uint8_t index): m_index(index) {}
+    void begin()
+    {
+      pinMode(pgm_read_byte(&CHANNELS[m_index].pin), OUTPUT);
+      ramps.duty[m_index] = -1;
+    }
+    int currentValue() const { return ramps.value(m_index); }
+    int currentProgression() const
+    {
+      uint32_t ticks = ramps.ticks[m_index];
+      return ticks > 0 ? (ticks - ramps.remaining[m_index]) * 100 / ticks : 100;
+    }
+    int currentTarget() const { return ramps.target[m_index]; }
+    void setDefault(unsigned short value) { m_defaultValue = value; }
+    void setDefaultRampOn(unsigned short rampOn) { m_defaultRampOn = rampOn; }
+    void setDefaultRampOff(unsigned short rampOff) { m_defaultRampOff = rampOff; }
+    void setDefaultDelay(unsigned int value) { m_defaultDelay = value; }
+    void defaultValues(unsigned short &value, unsigned short &rampOn, unsigned short &rampOff, unsigned int &delay)
+    {
+      value = m_defaultValue;
+      rampOn = m_defaultRampOn;
+      rampOff = m_defaultRampOff;
+      delay = m_defaultDelay;
+    }
+    void settings(LightSettings &settings) const
+    {
+      settings.value = m_defaultValue;
+      settings.rampOn = m_defaultRampOn;
+      settings.rampOff = m_defaultRampOff;
+      settings.last = currentTarget();
+      settings.delay = m_defaultDelay;
+    }
+    void setSettings(const LightSettings &settings)
+    {
+      m_defaultValue = MIN(settings.value, 255);
+      m_defaultRampOn = settings.rampOn;
+      m_defaultRampOff = settings.rampOff;
+      m_defaultDelay = settings.delay;
+    }
+    void setDimming(bool on, int ramp = -1) {
+      if (on) setDimming(m_defaultValue, ramp);
+      else setDimming((unsigned short)0, ramp);
+    }
+    void setDimming(unsigned short value, int ramp = -1)
+    {
+      if (ramp < 0) ramp = value?m_defaultRampOn:m_defaultRampOff;
+      m_delayTimeout = millis() + m_defaultDelay;
+      ramps.start(m_index, MIN(value, 255), ramp / RAMP_TICK);
+      if (ramps.active() && !rampTicker.active()) rampTicker.attach_ms(RAMP_TICK, rampTick);
+    }
+    // Auto-off, ramps are stepped by Ramps::tick()
+    void update()
+    {
+      unsigned long currentUpdate = millis();
+      if (m_defaultDelay > 0 && currentTarget() > 0 && (int32_t)(currentUpdate - m_delayTimeout) >= 0) {
+        setDimming(false);
+      }
+    }
+    // Time (ms) until update() has something to do: auto-off
+    unsigned long nextUpdate(unsigned long currentTime) const
+    {
+      unsigned long next = IDLE_MAX_SLEEP;
+      if (m_defaultDelay > 0 && currentTarget() > 0) {
+        next = MIN(next, (unsigned long)MAX(0, (int32_t)(m_delayTimeout - currentTime)));
+      }
+      return next;
+    }
+  protected:
+    uint8_t m_index;                          // in Lights, CHANNELS and ramps
+    unsigned long m_delayTimeout = 0;         // millis()
+    unsigned short m_defaultValue = 255;
+    unsigned short m_defaultRampOn = 3000;
+    unsigned short m_defaultRampOff = 3000;
+    unsigned int m_defaultDelay = 0;
+};
+static Light Lights[LIGHT_COUNT] = { Light(0), Light(1), Light(2), Light(3), Light(4) };
+
+// Channel name, copied out of flash
+static const char* channelName(size_t i, char (&name)[CHANNEL_NAME_SIZE])
+{
+  memcpy_P(name, CHANNELS[i].name, CHANNEL_NAME_SIZE);
+  return name;
+}
+
+// Index of the channel named by the first 'length' characters of 'name', -1 if none
+static int findChannel(const char* name, size_t length)
+{
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (length < CHANNEL_NAME_SIZE && strncmp_P(name, CHANNELS[i].name, length) == 0 && pgm_read_byte(&CHANNELS[i].name[length]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Scenes: keyframe sequences played on a set of lights. Each keyframe is a linear ramp (Light::setDimming)
+// from the previous values to its own; the player is stepped by rampTick() and starts at most one
+// keyframe per tick, so a tick costs the same with or without a scene.
+#define SCENE_UNIT 100      // ms - unit of keyframe durations
+#define SCENE_NONE 0xFF
+
+struct Keyframe
+{
+  uint16_t duration;              // SCENE_UNIT - time to reach the values
+  uint8_t values[LIGHT_COUNT];    // Lights order, only the lights of the scene are used
+};
+//                                           bulb  red green blue white
+static const Keyframe BREATHE[] PROGMEM = { {   20, { 255,   0,   0,   0,   0 } },
+                                            {   25, {  16,   0,   0,   0,   0 } } };
+static const Keyframe RAINBOW[] PROGMEM = { {   30, {   0, 255,   0,   0,   0 } },
+                                            {   30, {   0, 255, 255,   0,   0 } },
+                                            {   30, {   0,   0, 255,   0,   0 } },
+                                            {   30, {   0,   0, 255, 255,   0 } },
+                                            {   30, {   0,   0,   0, 255,   0 } },
+                                            {   30, {   0, 255,   0, 255,   0 } } };
+static const Keyframe SUNRISE[] PROGMEM = { {    0, {   0,   0,   0,   0,   0 } },
+                                            { 3000, {   0,  64,   4,   0,   0 } },    // deep red
+                                            { 3000, {   0, 255,  80,   0,  16 } },    // orange
+                                            { 3000, {  96, 255, 160,  32, 128 } },    // warm white
+                                            { 3000, { 255, 255, 200,  96, 255 } } };
+static const Keyframe SUNSET[] PROGMEM =  { { 3000, {  64, 255,  80,   0,  16 } },
+                                            { 3000, {   0,  64,   4,   0,   0 } },
+                                            { 1200, {   0,   0,   0,   0,   0 } } };
+
+struct Scene
+{
+  char name[CHANNEL_NAME_SIZE];
+  uint8_t lights;                 // mask of Lights indices
+  bool loop;
+  uint8_t count;
+  const Keyframe* keyframes;
+};
+#define KEYFRAMES(keyframes) sizeof(keyframes) / sizeof(Keyframe), keyframes
+static const Scene SCENES[] PROGMEM = {
+  { "breathe", 0x01,                     true,  KEYFRAMES(BREATHE) },   // bulb
+  { "rainbow", groupLights(GROUP_RGB),   true,  KEYFRAMES(RAINBOW) },
+  { "sunrise", groupLights(GROUP_ALL),   false, KEYFRAMES(SUNRISE) },   // 20 min
+  { "sunset",  groupLights(GROUP_ALL),   false, KEYFRAMES(SUNSET) },    // 12 min
+};
+#define SCENE_COUNT (sizeof(SCENES) / sizeof(Scene))
+
+// Index of a scene, SCENE_NONE if unknown
+static uint8_t findScene(const char* name)
+{
+  for (size_t i = 0; i < SCENE_COUNT; ++i) {
+    if (strcmp_P(name, SCENES[i].name) == 0) return i;
+  }
+  return SCENE_NONE;
+}
+
+static const char* sceneName(uint8_t scene, char (&name)[CHANNEL_NAME_SIZE])
+{
+  if (scene < SCENE_COUNT) memcpy_P(name, SCENES[scene].name, CHANNEL_NAME_SIZE);
+  else name[0] = '\0';
+  return name;
+}
+
+class ScenePlayer
+{
+  public:
+    uint8_t scene() const { return m_scene; }
+    void start(uint8_t scene)
+    {
+      if (scene >= SCENE_COUNT) return;
+      memcpy_P(&m_current, &SCENES[scene], sizeof(m_current));
+      m_scene = scene;
+      m_keyframe = 0;
+      m_remaining = 0;
+      if (!rampTicker.active()) rampTicker.attach_ms(RAMP_TICK, rampTick);
+    }
+    // The scene stops as soon as one of its lights is set by something else
+    void stop(uint8_t lights = 0xFF)
+    {
+      if (m_scene != SCENE_NONE && (m_current.lights & lights)) m_scene = SCENE_NONE;
+    }
+    // One RAMP_TICK step, returns true while playing
+    bool tick()
+    {
+      if (m_scene == SCENE_NONE) return false;
+      if (m_remaining > 0) {
+        --m_remaining;
+        return true;
+      }
+      if (m_keyframe == m_current.count) {
+        if (!m_current.loop) {
+          m_scene = SCENE_NONE;
+          return false;
+        }
+        m_keyframe = 0;
+      }
+      Keyframe keyframe;
+      memcpy_P(&keyframe, &m_current.keyframes[m_keyframe++], sizeof(keyframe));
+      unsigned long duration = (unsigned long)keyframe.duration * SCENE_UNIT;
+      for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+        if (m_current.lights & (1 << i)) Lights[i].setDimming((unsigned short)keyframe.values[i], duration);
+      }
+      ramps.blend(m_current.lights);
+      // the next keyframe starts on the tick the ramp ends
+      m_remaining = duration / RAMP_TICK;
+      if (m_remaining > 0) --m_remaining;
+      return true;
+    }
+  protected:
+    Scene m_current;
+    uint8_t m_scene = SCENE_NONE;
+    uint8_t m_keyframe = 0;
+    unsigned long m_remaining = 0;    // ticks before the next keyframe
+};
+static ScenePlayer scenes;
+
+// Sensor gestures and the action each one triggers, see SensorInput
+enum SensorEvent { SENSOR_TAP, SENSOR_DOUBLE_TAP, SENSOR_HOLD, SENSOR_PRESENT, SENSOR_ABSENT, SENSOR_EVENTS };
+enum SensorActionType { ACTION_NONE, ACTION_ON, ACTION_OFF, ACTION_TOGGLE, ACTION_DIM, ACTION_SCENE };
+struct SensorAction
+{
+  uint8_t type;
+  uint8_t target;       // mask of Lights indices, scene index for ACTION_SCENE
+};
+// by default the lights follow the sensor, as in version 1.01
+static SensorAction sensorActions[SENSOR_EVENTS] = {
+  { ACTION_NONE, 0 }, { ACTION_NONE, 0 }, { ACTION_NONE, 0 },
+  { ACTION_ON, groupLights(GROUP_ALL) }, { ACTION_OFF, groupLights(GROUP_ALL) },
+};
+static uint32_t sensorTimeout = 0;    // ms - released for that long before SENSOR_ABSENT
+
+// Ticker callback: steps every ramp and the scene, stops the ticker once they are all complete
+static void rampTick()
+{
+  uint32_t now = micros();
+  if (metrics.lastTick) metrics.rampJitter.add(abs((int32_t)(now - metrics.lastTick - RAMP_TICK * 1000)));
+  metrics.lastTick = now;
+  bool ramping = ramps.tick();
+  ramping |= scenes.tick();
+  if (!ramping) {
+    rampTicker.detach();
+    metrics.lastTick = 0;
+  }
+}
+
+static FlashLog<SETTINGS_SLOT> settingsLog;
+static bool settingsDirty = false;
+static unsigned long settingsChanged = 0;
+
+static void settingsModified()
+{
+  settingsDirty = true;
+  settingsChanged = millis();
+}
+
+// MQTT broker, see the MQTT client; an empty host disables it
+#define MQTT_PORT      1883
+#define MQTT_HOST_SIZE 24     // bytes, with the terminating NUL
+static char mqttHost[MQTT_HOST_SIZE] = "";
+static uint16_t mqttPort = MQTT_PORT;
+
+// Radio power saving while the lights are dark, see the power section; 0 leaves the radio to the SDK
+static uint16_t powerLatency = 0;     // ms - budget for a request reaching a dark device
+
+// State of the lights at power-on, set first thing in setup(): their defaults (ramping up as ever),
+// their last targets, or dark. The last targets are saved with the settings once the lights have
+// been still for SETTINGS_QUIET, in POWER_ON_LAST mode only.
+enum PowerOn { POWER_ON_DEFAULT, POWER_ON_LAST, POWER_ON_OFF, POWER_ON_COUNT };
+static const char* const POWER_ON_NAMES[POWER_ON_COUNT] = { "default", "last", "off" };
+static uint8_t powerOn = POWER_ON_DEFAULT;
+static uint8_t powerOnValues[LIGHT_COUNT];   // the last targets of the latest settings record
+
+// Payload of a settings log record
+struct Settings
+{
+  LightSettings lights[LIGHT_COUNT];
+  uint8_t sensorScene;                          // version 2, scene of SENSOR_PRESENT
+  uint8_t powerOn;                              // version 7, PowerOn - 0 (POWER_ON_DEFAULT) before
+  uint8_t reserved[2];
+  SensorAction sensorActions[SENSOR_EVENTS];    // version 3
+  uint16_t pwmFrequency;                        // version 6, Hz - 0 (the default) in older records
+  uint32_t sensorTimeout;
+  char mqttHost[MQTT_HOST_SIZE];                // version 4
+  uint16_t mqttPort;
+  uint16_t powerLatency;                        // version 5, 0 in the records of version 4
+};
+
+// The current settings as a record
+static void currentSettings(Settings& settings)
+{
+  memset(&settings, 0, sizeof(settings));
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) Lights[i].settings(settings.lights[i]);
+  const SensorAction& present = sensorActions[SENSOR_PRESENT];
+  settings.sensorScene = present.type == ACTION_SCENE ? present.target : SCENE_NONE;
+  memcpy(settings.sensorActions, sensorActions, sizeof(sensorActions));
+  settings.pwmFrequency = pwmFrequency != PWM_FREQUENCY ? pwmFrequency : 0;
+  settings.sensorTimeout = sensorTimeout;
+  memcpy(settings.mqttHost, mqttHost, sizeof(mqttHost));
+  settings.mqttPort = mqttPort;
+  settings.powerLatency = powerLatency;
+  settings.powerOn = powerOn;
+}
+
+static void saveSettings()
+{
+  Settings settings;
+  currentSettings(settings);
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) powerOnValues[i] = settings.lights[i].last;
+  settingsLog.write(&settings, sizeof(settings), SETTINGS_VERSION);
+  settingsDirty = false;
+}
+
+// A settings record of 'length' bytes: older versions are a prefix of the current record, the
+// fields they lack keep their value
+static void applySettings(const Settings& settings, size_t length)
+{
+  for (size_t i = 0; i < LIGHT_COUNT && (i + 1) * sizeof(LightSettings) <= length; ++i) {
+    Lights[i].setSettings(settings.lights[i]);
+    powerOnValues[i] = MIN(settings.lights[i].last, 255);
+  }
+  if (length > offsetof(Settings, powerOn)) powerOn = settings.powerOn < POWER_ON_COUNT ? settings.powerOn : POWER_ON_DEFAULT;
+  if (length >= offsetof(Settings, mqttHost)) {
+    for (int i = 0; i < SENSOR_EVENTS; ++i) {
+      const SensorAction& action = settings.sensorActions[i];
+      if (action.type < ACTION_SCENE || (action.type == ACTION_SCENE && action.target < SCENE_COUNT)) sensorActions[i] = action;
+    }
+    sensorTimeout = settings.sensorTimeout;
+    setPwmFrequency(settings.pwmFrequency ? settings.pwmFrequency : PWM_FREQUENCY);
+  }
+  else if (length > offsetof(Settings, sensorScene) && settings.sensorScene < SCENE_COUNT) {
+    sensorActions[SENSOR_PRESENT].type = ACTION_SCENE;
+    sensorActions[SENSOR_PRESENT].target = settings.sensorScene;
+  }
+  if (length >= sizeof(Settings)) {
+    memcpy(mqttHost, settings.mqttHost, sizeof(mqttHost));
+    mqttHost[sizeof(mqttHost) - 1] = '\0';
+    mqttPort = settings.mqttPort;
+    powerLatency = settings.powerLatency;
+  }
+}
+
+// Latest record of the settings log, or on first boot the EEPROM layout of version 1.01
+static void loadSettings()
+{
+  // without an FS region (or too small) settings only live until the next reboot
+  if (FS_PHYS_SIZE < SETTINGS_SECTORS * FLASH_SECTOR_SIZE || !settingsLog.begin(FS_PHYS_ADDR, SETTINGS_SECTORS)) return;
+  if (settingsLog.valid()) {
+    Settings settings;
+    uint16_t version = 0;
+    size_t length = settingsLog.read(&settings, sizeof(settings), version);
+    if (version <= SETTINGS_VERSION) applySettings(settings, length);
+    return;
+  }
+  // flag (0 when written), value, rampOn, rampOff, delay; value and rampOn overlapped, only the low byte of value survived
+  EEPROM.begin(LIGHT_COUNT * LEGACY_EEPROM_SIZE);
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    int base = i * LEGACY_EEPROM_SIZE;
+    if (EEPROM.read(base) != 0) continue;
+    LightSettings settings = {};
+    settings.value = EEPROM.read(base + 1);
+    EEPROM.get<uint16_t>(base + 2, settings.rampOn);
+    EEPROM.get<uint16_t>(base + 4, settings.rampOff);
+    EEPROM.get<uint32_t>(base + 6, settings.delay);
+    Lights[i].setSettings(settings);
+  }
+  EEPROM.end();
+  saveSettings();
+}
+
+static void powerOnLights()
+{
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (powerOn == POWER_ON_DEFAULT) Lights[i].setDimming(true);
+    else if (powerOn == POWER_ON_LAST) Lights[i].setDimming((unsigned short)powerOnValues[i]);
+  }
+}
+
+// In POWER_ON_LAST mode: the lights came to rest away from the targets last saved
+static bool powerOnChanged()
+{
+  if (powerOn != POWER_ON_LAST || ramps.running || scenes.scene() != SCENE_NONE) return false;
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (ramps.target[i] != powerOnValues[i]) return true;
+  }
+  return false;
+}
+
+// Groups of URI_LIGHT besides the channel names, as bit masks of Lights indices
+struct LightGroup
+{
+  char name[CHANNEL_NAME_SIZE];
+  uint8_t lights;
+};
+static const LightGroup LIGHT_GROUPS[] PROGMEM = {
+  { "all",  groupLights(GROUP_ALL) },
+  { "rgbw", groupLights(GROUP_RGBW) },
+  { "rgb",  groupLights(GROUP_RGB) },
+};
+#define LIGHT_COMMANDS 16   // max channel / group arguments in one request
+
+// Mask of the lights named by a channel or a group, 0 if unknown
+static uint8_t findLights(const char* name)
+{
+  int channel = findChannel(name, strlen(name));
+  if (channel >= 0) return 1 << channel;
+  for (const LightGroup& group : LIGHT_GROUPS) {
+    if (strcmp_P(name, group.name) == 0) return pgm_read_byte(&group.lights);
+  }
+  return 0;
+}
+
+static int hexDigit(char ch)
+{
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return 0;
+}
+
+// Next two hex digits of a colour, 0 once the string is exhausted
+static unsigned short nextHexByte(const char*& hex)
+{
+  unsigned short value = 0;
+  for (int i = 0; i < 2 && *hex; ++i) value = value * 16 + hexDigit(*hex++);
+  return value;
+}
+
+// Perceived red, green, blue of hsv:<hue 0-360>,<saturation 0-255>[,<value 0-255>], ct:<kelvin>[,<value>],
+// xy:<x>,<y>[,<value>] (CIE 1931) or rgb:RRGGBB; false for anything else
+static bool parseColor(const char* command, uint8_t rgb[3])
+{
+  const char* colon = strchr(command, ':');
+  if (!colon) return false;
+  char* next;
+  long first = strtol(colon + 1, &next, 10), second = 0;
+  int value = 255;
+  if (strncmp(command, "hsv:", 4) == 0) {
+    second = *next == ',' ? strtol(next + 1, &next, 10) : 255;
+    if (*next == ',') value = atoi(next + 1);
+    uint16_t color[3];
+    ColorSpace::hsvToRgb((uint32_t)(first % 360 + 360) % 360 * ColorSpace::HUE_RANGE / 360, MIN(MAX(second, 0), 255), 0xFF00, color);
+    for (int k = 0; k < 3; ++k) rgb[k] = (color[k] + 0x80) >> 8;
+  }
+  else if (strncmp(command, "ct:", 3) == 0) {
+    if (*next == ',') value = atoi(next + 1);
+    ColorSpace::kelvinToRgb(MIN(MAX(first, 0), 0xFFFF), rgb);
+  }
+  else if (strncmp(command, "xy:", 3) == 0) {
+    const char* y = strchr(colon + 1, ',');
+    if (!y) return false;
+    const char* rest = strchr(y + 1, ',');
+    if (rest) value = atoi(rest + 1);
+    ColorSpace::xyToRgb(MIN(MAX(atof(colon + 1), 0.0), 1.0) * 10000, MIN(MAX(atof(y + 1), 0.0), 1.0) * 10000, rgb);
+  }
+  else if (strncmp(command, "rgb:", 4) == 0) {
+    const char* hex = colon + 1;
+    for (int k = 0; k < 3; ++k) rgb[k] = nextHexByte(hex);
+  }
+  else {
+    return false;
+  }
+  value = MIN(MAX(value, 0), 255);
+  for (int k = 0; k < 3; ++k) rgb[k] = rgb[k] * value / 255;
+  return true;
+}
+
+// A colour on the red, green and blue channels of 'lights'; with the white channel, the white
+// common to the three moves to it
+static void applyColor(uint8_t lights, uint8_t rgb[3], int ramp)
+{
+  const uint8_t white = groupLights(GROUP_RGBW) & ~COLOR_LIGHTS;
+  uint8_t whiteValue = (lights & white) ? ColorSpace::extractWhite(rgb) : 0;
+  for (size_t i = 0, k = 0; i < LIGHT_COUNT; ++i) {
+    if (COLOR_LIGHTS & (1 << i)) {
+      if (lights & (1 << i)) Lights[i].setDimming((unsigned short)rgb[k], ramp);
+      ++k;
+    }
+    else if (lights & white & (1 << i)) {
+      Lights[i].setDimming((unsigned short)whiteValue, ramp);
+    }
+  }
+}
+
+// on, off, toggle, a value (0-255), a colour (#RRGGBB..., one byte per light in Lights order) or
+// a colour of parseColor() for the red, green, blue and white channels
+static void applyLight(uint8_t lights, const char* command, int ramp)
+{
+  uint8_t rgb[3];
+  scenes.stop(lights);
+  if (parseColor(command, rgb)) {
+    applyColor(lights, rgb, ramp);
+  }
+  else if (strcmp(command, "on") == 0 || strcmp(command, "off") == 0 || strcmp(command, "toggle") == 0) {
+    bool on = command[1] == 'n';
+    if (command[0] == 't') {
+      on = true;
+      for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+        if ((lights & (1 << i)) && Lights[i].currentValue()) on = false;
+      }
+    }
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+      if (lights & (1 << i)) Lights[i].setDimming(on, ramp);
+    }
+  }
+  else if (command[0] == '#') {
+    const char* hex = command + 1;
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+      if (lights & (1 << i)) Lights[i].setDimming(nextHexByte(hex), ramp);
+    }
+  }
+  else {
+    unsigned short value = atoi(command);
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+      if (lights & (1 << i)) Lights[i].setDimming(value, ramp);
+    }
+  }
+  ramps.blend(lights);
+}
+
+// Arguments are read once, in query order, without copies; a scene starts after the channel commands
+static void light_handler() {
+  struct { uint8_t lights; const char* command; } commands[LIGHT_COMMANDS];
+  int count = 0, ramp = -1;
+  const char* scene = NULL;
+  for (int i = 0; i < server.args(); ++i) {
+    const char* name = server.argName(i).c_str();
+    const char* value = server.arg(i).c_str();
+    if (strcmp(name, "ramp") == 0) {
+      ramp = atoi(value);
+      continue;
+    }
+    if (strcmp(name, "scene") == 0) {
+      scene = value;
+      continue;
+    }
+    uint8_t lights = findLights(name);
+    if (lights && *value && count < LIGHT_COMMANDS) {
+      commands[count].lights = lights;
+      commands[count].command = value;
+      ++count;
+    }
+  }
+  for (int i = 0; i < count; ++i) applyLight(commands[i].lights, commands[i].command, ramp);
+  if (scene && strcmp(scene, "off") == 0) scenes.stop();
+  else if (scene) scenes.start(findScene(scene));
+  server.send(200);
+}
+
+// UDP control: one binary command per datagram, for senders updating faster than HTTP allows
+// (slider drags, music sync), read from loop() and while it sleeps. Only UDP_STATUS is answered.
+//   byte 0     opcode, | UDP_AT for a command scheduled on the group clock
+//   byte 1     sequence, a datagram behind the previous one (by 1-127) is late and dropped, 0 is never dropped
+//   byte 2     lights, bit i is Lights[i]
+//   byte 3-4   ramp (ms, big endian), 0xFFFF for the light defaults
+//   byte 5-8   UDP_AT only: start time on the group clock (ms, big endian), the payload follows
+//   byte 5...  UDP_SET: one value (0-255) per light of the mask, in Lights order
+//              UDP_SCENE: scene index, SCENE_NONE stops the scene
+// The status reply has the same header (opcode | UDP_REPLY, all lights) then the current values, the scene
+// and the group clock.
+//
+// Group mode: the devices of a network share a clock so that one UDP_AT command, sent to the
+// multicast group, starts the same ramp at the same instant on all of them. The device with the
+// lowest chip id among those heard beacons its clock (UDP_SYNC: header, clock, chip id) every
+// SYNC_BEACON; the others keep the largest of the last SYNC_SAMPLES offsets measured, the one
+// least delayed by the network. A device hearing nobody for SYNC_TIMEOUT keeps the time itself,
+// from where its clock is. A command arriving after its start time runs at once with its ramp
+// shortened by the delay, so that it ends in step with the others.
+#define UDP_PORT      4210
+#define UDP_HEADER    5      // bytes
+#define UDP_WORD      4      // bytes - a group clock value or a chip id, big endian
+#define UDP_PACKET    (UDP_HEADER + UDP_WORD + LIGHT_COUNT + 1)
+#define UDP_BURST     8      // datagrams handled per call, the others wait for the next one
+#define UDP_SEQUENCE  1000   // ms - after that long without datagram, any sequence is accepted
+#define UDP_REPLY     0x80
+#define UDP_AT        0x40
+enum UdpOpcode { UDP_SET = 1, UDP_ON, UDP_OFF, UDP_TOGGLE, UDP_SCENE, UDP_STATUS, UDP_SYNC };
+
+#define SYNC_GROUP    239, 255, 65, 72   // multicast group, on UDP_PORT
+#define SYNC_BEACON   1000   // ms - clock beacon period of the master
+#define SYNC_TIMEOUT  3500   // ms - without beacon for that long, a device is its own master
+#define SYNC_SAMPLES  4      // beacons the offset is estimated from
+#define SYNC_WINDOW   15     // ms - polled every ms from that long before the next beacon is due: the offset is
+                             // taken when a beacon is read, up to IDLE_POLL late otherwise
+#define SYNC_PENDING  4      // scheduled commands waiting for their start, a command beyond runs at once
+#define SYNC_HORIZON  60000  // ms - commands scheduled further ahead are dropped
+
+struct SyncCommand
+{
+  uint32_t start;   // group clock
+  uint8_t opcode;
+  uint8_t lights;
+  int16_t rampMs;   // -1 for the light defaults
+  uint8_t length;   // payload bytes
+  uint8_t payload[LIGHT_COUNT];
+};
+
+static WiFiUDP udp;
+static uint8_t udpSequence = 0;
+static unsigned long udpReceived = 0;
+static uint32_t syncMaster = 0;                 // chip id of the device keeping the time, 0 while listening
+static unsigned long syncHeard = 0;             // millis() of the last beacon accepted
+static unsigned long syncSent = 0;              // millis() of the last beacon sent
+static uint32_t syncOffsets[SYNC_SAMPLES];      // group clock - millis() at the last beacons
+static uint8_t syncSamples = 0;                 // beacons in syncOffsets
+static uint32_t syncOffset = 0;
+static SyncCommand syncPending[SYNC_PENDING];   // by start time
+static uint8_t syncPendingCount = 0;
+
+static uint32_t syncClock(unsigned long currentTime) { return currentTime + syncOffset; }
+
+static const char* syncRole()
+{
+  return syncMaster == 0 ? "listening" : syncMaster == ESP.getChipId() ? "master" : "follower";
+}
+
+static void writeWord(uint8_t* bytes, uint32_t value)
+{
+  for (int i = 0; i < UDP_WORD; ++i) bytes[i] = value >> (24 - 8 * i);
+}
+
+static uint32_t readWord(const uint8_t* bytes)
+{
+  return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+// A clock beacon: follow the master with the lowest chip id heard, through its least delayed beacons
+static void syncBeacon(const uint8_t* packet, int length, unsigned long currentTime)
+{
+  if (length < UDP_HEADER + 2 * UDP_WORD) return;
+  uint32_t id = readWord(packet + UDP_HEADER + UDP_WORD);
+  if (syncMaster != 0 && (id > syncMaster || (id == syncMaster && syncMaster == ESP.getChipId()))) return;
+  if (id != syncMaster) syncSamples = 0;
+  syncMaster = id;
+  syncHeard = currentTime;
+  memmove(syncOffsets + 1, syncOffsets, (SYNC_SAMPLES - 1) * sizeof(syncOffsets[0]));
+  syncOffsets[0] = readWord(packet + UDP_HEADER) - currentTime;
+  syncSamples = MIN(syncSamples + 1, SYNC_SAMPLES);
+  syncOffset = syncOffsets[0];
+  for (int i = 1; i < syncSamples; ++i) {
+    if ((int32_t)(syncOffsets[i] - syncOffset) > 0) syncOffset = syncOffsets[i];
+  }
+}
+
+static void udpStatus(const uint8_t* packet)
+{
+  uint8_t reply[UDP_HEADER + LIGHT_COUNT + 1 + UDP_WORD] = { UDP_STATUS | UDP_REPLY, packet[1], groupLights(GROUP_ALL), 0, 0 };
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) reply[UDP_HEADER + i] = Lights[i].currentValue();
+  reply[UDP_HEADER + LIGHT_COUNT] = scenes.scene();
+  writeWord(reply + UDP_HEADER + LIGHT_COUNT + 1, syncClock(millis()));
+  udp.beginPacket(udp.remoteIP(), udp.remotePort());
+  udp.write(reply, sizeof(reply));
+  udp.endPacket();
+}
+
+// Run a command 'late' ms after its start time: its ramp is shortened as much
+static void runUdpCommand(const SyncCommand& command, uint32_t late)
+{
+  int rampMs = command.rampMs;
+  if (late > 0 && rampMs > 0) rampMs = late < (uint32_t)rampMs ? rampMs - late : 0;
+  switch (command.opcode) {
+    case UDP_SET: {
+      scenes.stop(command.lights);
+      const uint8_t* value = command.payload;
+      for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+        if (!(command.lights & (1 << i))) continue;
+        if (value == command.payload + command.length) break;
+        Lights[i].setDimming((unsigned short)*value++, rampMs);
+      }
+      ramps.blend(command.lights);
+      break;
+    }
+    case UDP_ON:     applyLight(command.lights, "on", rampMs); break;
+    case UDP_OFF:    applyLight(command.lights, "off", rampMs); break;
+    case UDP_TOGGLE: applyLight(command.lights, "toggle", rampMs); break;
+    case UDP_SCENE:
+      if (command.length == 0) break;
+      if (command.payload[0] == SCENE_NONE) scenes.stop();
+      else scenes.start(command.payload[0]);
+      break;
+  }
+}
+
+// Keep a command until its start time, in start order, false if too many are waiting
+static bool syncSchedule(const SyncCommand& command)
+{
+  if (syncPendingCount == SYNC_PENDING) return false;
+  int i = syncPendingCount++;
+  for (; i > 0 && (int32_t)(syncPending[i - 1].start - command.start) > 0; --i) syncPending[i] = syncPending[i - 1];
+  syncPending[i] = command;
+  return true;
+}
+
+// Runs the waiting datagrams, returns true if there was any
+static bool handleUdp()
+{
+  bool handled = false;
+  for (int burst = 0; burst < UDP_BURST && udp.parsePacket() > 0; ++burst) {
+    uint8_t packet[UDP_PACKET];
+    int length = udp.read(packet, sizeof(packet));
+    handled = true;
+    ++metrics.udpDatagrams;
+    if (length < UDP_HEADER) continue;
+    unsigned long currentTime = millis();
+    if (packet[0] != UDP_SYNC) idleClientSeen = currentTime;   // not the group's own beacons
+    if (packet[0] == UDP_STATUS) {
+      udpStatus(packet);
+      continue;
+    }
+    if (packet[0] == UDP_SYNC) {
+      syncBeacon(packet, length, currentTime);
+      continue;
+    }
+    uint8_t sequence = packet[1];
+    if (sequence != 0 && udpSequence != 0 && (int8_t)(sequence - udpSequence) <= 0 && (uint32_t)(currentTime - udpReceived) < UDP_SEQUENCE) continue;
+    udpSequence = sequence;
+    udpReceived = currentTime;
+    uint16_t ramp = packet[3] << 8 | packet[4];
+    int payload = packet[0] & UDP_AT ? UDP_HEADER + UDP_WORD : UDP_HEADER;
+    if (length < payload) continue;
+    SyncCommand command;
+    command.opcode = packet[0] & ~UDP_AT;
+    command.lights = packet[2] & groupLights(GROUP_ALL);
+    command.rampMs = ramp == 0xFFFF ? -1 : MIN(ramp, 0x7FFF);
+    command.length = MIN(length - payload, LIGHT_COUNT);
+    memcpy(command.payload, packet + payload, command.length);
+    uint32_t late = 0;
+    if (packet[0] & UDP_AT) {
+      command.start = readWord(packet + UDP_HEADER);
+      int32_t wait = command.start - syncClock(currentTime);
+      if (wait > SYNC_HORIZON) continue;
+      if (wait > 0 && syncSchedule(command)) continue;
+      late = MAX(0, -wait);
+    }
+    runUdpCommand(command, late);
+  }
+  return handled;
+}
+
+// Beacon the clock as master, run the scheduled commands due
+static void syncUpdate(unsigned long currentTime)
+{
+  uint32_t chipId = ESP.getChipId();
+  if (syncMaster != chipId && (uint32_t)(currentTime - syncHeard) >= SYNC_TIMEOUT) {
+    syncMaster = chipId;
+    syncSent = currentTime - SYNC_BEACON;
+  }
+  if (syncMaster == chipId && (uint32_t)(currentTime - syncSent) >= SYNC_BEACON) {
+    uint8_t beacon[UDP_HEADER + 2 * UDP_WORD] = { UDP_SYNC, 0, 0, 0, 0 };
+    writeWord(beacon + UDP_HEADER, syncClock(currentTime));
+    writeWord(beacon + UDP_HEADER + UDP_WORD, chipId);
+    udp.beginPacketMulticast(IPAddress(SYNC_GROUP), UDP_PORT, WiFi.localIP());
+    udp.write(beacon, sizeof(beacon));
+    udp.endPacket();
+    syncSent = currentTime;
+  }
+  uint32_t clock = syncClock(currentTime);
+  while (syncPendingCount > 0 && (int32_t)(clock - syncPending[0].start) >= 0) {
+    SyncCommand command = syncPending[0];
+    memmove(syncPending, syncPending + 1, --syncPendingCount * sizeof(syncPending[0]));
+    runUdpCommand(command, clock - command.start);
+    // restart the ramp ticks at the start time, so that they are in phase on every device too
+    if (rampTicker.active()) rampTicker.attach_ms(RAMP_TICK, rampTick);
+  }
+}
+
+// A follower about to hear the next beacon of its master: idle() polls every ms until then
+static bool syncListening(unsigned long currentTime)
+{
+  if (syncMaster == 0 || syncMaster == ESP.getChipId()) return false;
+  return (uint32_t)(currentTime - syncHeard) >= SYNC_BEACON - SYNC_WINDOW;
+}
+
+// Time (ms) until syncUpdate() has something to do
+static unsigned long syncNextUpdate(unsigned long currentTime)
+{
+  unsigned long next = IDLE_MAX_SLEEP;
+  if (syncMaster == ESP.getChipId()) next = MIN(next, (unsigned long)MAX(0, (int32_t)(syncSent + SYNC_BEACON - currentTime)));
+  else next = MIN(next, (unsigned long)MAX(0, (int32_t)(syncHeard + SYNC_TIMEOUT - currentTime)));
+  if (syncMaster != 0 && syncMaster != ESP.getChipId() && !syncListening(currentTime)) {
+    next = MIN(next, (unsigned long)MAX(0, (int32_t)(syncHeard + SYNC_BEACON - SYNC_WINDOW - currentTime)));
+  }
+  if (syncPendingCount > 0) next = MIN(next, (unsigned long)MAX(0, (int32_t)(syncPending[0].start - syncClock(currentTime))));
+  return next;
+}
+
+// Sensor: edges are timestamped when they happen, by the pin interrupt or by a 1 ms sampling timer
+// on GPIO16 which has none, into a lock-free single producer / single consumer queue. loop()
+// debounces them, classifies the gestures and runs the action configured for each.
+#define SENSOR_SAMPLE    1     // ms - sampling period of a pin without interrupt
+#define SENSOR_QUEUE     16    // edges, power of two
+#define SENSOR_DEBOUNCE  30    // ms - edges following an accepted one are ignored for that long
+#define SENSOR_HOLD_TIME 600   // ms - a longer press is a hold
+#define SENSOR_TAP_GAP   300   // ms - longest release between the two taps of a double tap
+#define SENSOR_DIM_TIME  4000  // ms - a dim action goes from 0 to 255 in that time
+
+struct SensorEdge
+{
+  uint32_t time;    // millis()
+  uint8_t level;
+};
+static volatile SensorEdge sensorEdges[SENSOR_QUEUE];
+static volatile uint8_t sensorHead = 0;        // written by the producer only
+static volatile uint8_t sensorTail = 0;        // written by the consumer only
+static volatile bool sensorOverflow = false;
+static uint8_t sensorSampled = LOW;            // last level seen by the sampler
+static Ticker sensorTicker;
+
+static void IRAM_ATTR pushSensorEdge(uint8_t level)
+{
+  uint8_t head = sensorHead;
+  if ((uint8_t)(head - sensorTail) == SENSOR_QUEUE) {
+    sensorOverflow = true;
+    return;
+  }
+  sensorEdges[head % SENSOR_QUEUE].time = millis();
+  sensorEdges[head % SENSOR_QUEUE].level = level;
+  sensorHead = head + 1;   // publishes the edge
+  esp_schedule();          // wakes loop() up if it sleeps in idle()
+}
+
+static void IRAM_ATTR sensorInterrupt()
+{
+  pushSensorEdge(digitalRead(PIN_SENSOR));
+}
+
+static void sensorSample()
+{
+  uint8_t level = digitalRead(PIN_SENSOR);
+  if (level != sensorSampled) {
+    sensorSampled = level;
+    pushSensorEdge(level);
+  }
+}
+
+static bool sensorDimUp = false;
+
+static void runSensorAction(SensorEvent event)
+{
+  const SensorAction& action = sensorActions[event];
+  switch (action.type) {
+    case ACTION_ON:     applyLight(action.target, "on", -1); break;
+    case ACTION_OFF:    applyLight(action.target, "off", -1); break;
+    case ACTION_TOGGLE: applyLight(action.target, "toggle", -1); break;
+    case ACTION_SCENE:
+      scenes.stop();
+      scenes.start(action.target);
+      break;
+    case ACTION_DIM: {
+      // alternately up and down, except from the ends of the range
+      int low = 255, high = 0;
+      for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+        if (!(action.target & (1 << i))) continue;
+        low = MIN(low, Lights[i].currentValue());
+        high = MAX(high, Lights[i].currentValue());
+      }
+      sensorDimUp = low == 255 ? false : high == 0 ? true : !sensorDimUp;
+      scenes.stop(action.target);
+      for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+        if (!(action.target & (1 << i))) continue;
+        int target = sensorDimUp ? 255 : 0;
+        Lights[i].setDimming((unsigned short)target, SENSOR_DIM_TIME * abs(target - Lights[i].currentValue()) / 255);
+      }
+      break;
+    }
+  }
+}
+
+// End of a hold: a dim stops where it is
+static void releaseSensorAction()
+{
+  const SensorAction& action = sensorActions[SENSOR_HOLD];
+  if (action.type != ACTION_DIM) return;
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (action.target & (1 << i)) Lights[i].setDimming((unsigned short)Lights[i].currentValue(), 0);
+  }
+}
+
+// Debounce and gesture classification of the queued edges. The first edge of a bounce is taken
+// at once and the level is checked again when SENSOR_DEBOUNCE expires, so a press is seen
+// without delay and a pulse shorter than the debounce time is still one tap.
+class SensorInput
+{
+  public:
+    void begin()
+    {
+      m_level = m_raw = sensorSampled = digitalRead(PIN_SENSOR);
+      m_holding = m_level;    // already pressed at boot: not a gesture
+      if (PIN_SENSOR == 16) sensorTicker.attach_ms(SENSOR_SAMPLE, sensorSample);
+      else attachInterrupt(digitalPinToInterrupt(PIN_SENSOR), sensorInterrupt, CHANGE);
+    }
+    bool pending() const { return sensorHead != sensorTail; }
+    void update(unsigned long currentTime)
+    {
+      while (sensorHead != sensorTail) {
+        uint8_t tail = sensorTail;
+        uint32_t time = sensorEdges[tail % SENSOR_QUEUE].time;
+        uint8_t level = sensorEdges[tail % SENSOR_QUEUE].level;
+        sensorTail = tail + 1;
+        input(time, level);
+      }
+      if (sensorOverflow) {
+        // edges were lost, start again from the current level
+        sensorOverflow = false;
+        input(currentTime, digitalRead(PIN_SENSOR));
+      }
+      advance(currentTime);
+    }
+    // Time (ms) until update() has something to do
+    unsigned long nextUpdate(unsigned long currentTime) const
+    {
+      unsigned long next = IDLE_MAX_SLEEP;
+      if (m_locked && m_raw != m_level) next = MIN(next, until(m_lockUntil, currentTime));
+      if (m_level && !m_holding) next = MIN(next, until(m_pressedAt + SENSOR_HOLD_TIME, currentTime));
+      if (!m_level && m_taps) next = MIN(next, until(m_releasedAt + SENSOR_TAP_GAP, currentTime));
+      if (!m_level && m_absent) next = MIN(next, until(m_releasedAt + sensorTimeout, currentTime));
+      return next;
+    }
+  protected:
+    static unsigned long until(uint32_t deadline, unsigned long currentTime)
+    {
+      return (unsigned long)MAX(0, (int32_t)(deadline - currentTime));
+    }
+    static bool reached(uint32_t deadline, uint32_t time) { return (int32_t)(time - deadline) >= 0; }
+    void input(uint32_t time, uint8_t level)
+    {
+      advance(time);
+      m_raw = level;
+      if (!m_locked && level != m_level) accept(time, level);
+    }
+    // Expire the debounce and gesture timers up to 'time'
+    void advance(uint32_t time)
+    {
+      if (m_locked && reached(m_lockUntil, time)) {
+        m_locked = false;
+        if (m_raw != m_level) accept(m_lockUntil, m_raw);
+      }
+      if (m_level && !m_holding && reached(m_pressedAt + SENSOR_HOLD_TIME, time)) {
+        m_holding = true;
+        m_taps = 0;
+        runSensorAction(SENSOR_HOLD);
+      }
+      if (!m_level && m_taps && reached(m_releasedAt + SENSOR_TAP_GAP, time)) {
+        m_taps = 0;
+        runSensorAction(SENSOR_TAP);
+      }
+      if (!m_level && m_absent && reached(m_releasedAt + sensorTimeout, time)) {
+        m_absent = false;
+        runSensorAction(SENSOR_ABSENT);
+      }
+    }
+    void accept(uint32_t time, uint8_t level)
+    {
+      m_level = level;
+      m_locked = true;
+      m_lockUntil = time + SENSOR_DEBOUNCE;
+      if (level) {
+        m_pressedAt = time;
+        m_holding = false;
+        m_absent = false;
+        runSensorAction(SENSOR_PRESENT);
+        return;
+      }
+      m_releasedAt = time;
+      if (m_holding) {
+        m_holding = false;
+        releaseSensorAction();
+      }
+      else if (++m_taps == 2) {
+        m_taps = 0;
+        runSensorAction(SENSOR_DOUBLE_TAP);
+      }
+      else if (sensorActions[SENSOR_DOUBLE_TAP].type == ACTION_NONE) {
+        // no need to wait for a second tap
+        m_taps = 0;
+        runSensorAction(SENSOR_TAP);
+      }
+      m_absent = true;
+      advance(time);
+    }
+
+    uint8_t m_level = LOW;        // debounced
+    uint8_t m_raw = LOW;          // last edge
+    bool m_locked = false;
+    bool m_holding = false;
+    bool m_absent = false;        // SENSOR_ABSENT pending
+    uint8_t m_taps = 0;           // taps waiting for a possible second one
+    uint32_t m_lockUntil = 0;
+    uint32_t m_pressedAt = 0;
+    uint32_t m_releasedAt = 0;
+};
+static SensorInput sensor;
+
+static const char SENSOR_EVENT_NAMES[SENSOR_EVENTS][8] PROGMEM = { "tap", "double", "hold", "present", "absent" };
+static const char SENSOR_ACTION_NAMES[ACTION_SCENE][8] PROGMEM = { "none", "on", "off", "toggle", "dim" };
+
+// <action>[:<channel or group>] (all lights by default) or <scene>
+static bool parseSensorAction(const char* value, SensorAction& action)
+{
+  const char* colon = strchr(value, ':');
+  size_t length = colon ? colon - value : strlen(value);
+  uint8_t lights = colon ? findLights(colon + 1) : groupLights(GROUP_ALL);
+  for (uint8_t type = 0; type < ACTION_SCENE && length < 8 && lights; ++type) {
+    if (strncmp_P(value, SENSOR_ACTION_NAMES[type], length) == 0 && pgm_read_byte(&SENSOR_ACTION_NAMES[type][length]) == 0) {
+      action.type = type;
+      action.target = lights;
+      return true;
+    }
+  }
+  uint8_t scene = colon ? SCENE_NONE : findScene(value);
+  if (scene == SCENE_NONE) return false;
+  action.type = ACTION_SCENE;
+  action.target = scene;
+  return true;
+}
+
+// "_<event>", "_timeout", or "" for the present event (the sensor=<scene> of version 1.02)
+static void setSensor(const char* suffix, const char* value)
+{
+  if (strcmp(suffix, "_timeout") == 0) {
+    sensorTimeout = atol(value);
+    return;
+  }
+  int event = *suffix ? -1 : SENSOR_PRESENT;
+  for (int i = 0; i < SENSOR_EVENTS && event < 0; ++i) {
+    if (suffix[0] == '_' && strcmp_P(suffix + 1, SENSOR_EVENT_NAMES[i]) == 0) event = i;
+  }
+  SensorAction action;
+  if (event >= 0 && parseSensorAction(value, action)) sensorActions[event] = action;
+}
+
+#ifdef ENABLE_MQTT
+static void setMqttBroker(const char* broker);   // below, with the MQTT client
+#endif
+
+// <channel>[_rampOn|_rampOff|_delay]=value, sensor_<event>=<action>, mqtt=host[:port], power_latency=ms,
+// pwm_frequency=Hz and power_on=default|last|off, read in one pass
+static void default_handler() {
+  bool current = false;
+  for (int i = 0; i < server.args(); ++i) {
+    const char* name = server.argName(i).c_str();
+    const char* value = server.arg(i).c_str();
+    if (strcmp(name, "all") == 0) {
+      current |= strcmp(value, "current") == 0;
+      continue;
+    }
+    if (strncmp(name, "sensor", 6) == 0) {
+      setSensor(name + 6, value);
+      continue;
+    }
+#ifdef ENABLE_MQTT
+    if (strcmp(name, "mqtt") == 0) {
+      setMqttBroker(value);
+      continue;
+    }
+#endif
+    if (strcmp(name, "power_latency") == 0) {
+      powerLatency = MIN(strtoul(value, NULL, 10), 65535UL);
+      continue;
+    }
+    if (strcmp(name, "pwm_frequency") == 0) {
+      if (*value) setPwmFrequency(strtoul(value, NULL, 10));
+      continue;
+    }
+    if (strcmp(name, "power_on") == 0) {
+      for (uint8_t mode = 0; mode < POWER_ON_COUNT; ++mode) {
+        if (strcmp(value, POWER_ON_NAMES[mode]) == 0) powerOn = mode;
+      }
+      continue;
+    }
+    const char* suffix = strchr(name, '_');
+    int channel = findChannel(name, suffix ? suffix - name : strlen(name));
+    if (channel < 0 || !*value) continue;
+    Light& l = Lights[channel];
+    if (!suffix) l.setDefault(atoi(value));
+    else if (strcmp(suffix, "_rampOn") == 0) l.setDefaultRampOn(atoi(value));
+    else if (strcmp(suffix, "_rampOff") == 0) l.setDefaultRampOff(atoi(value));
+    else if (strcmp(suffix, "_delay") == 0) l.setDefaultDelay(atol(value));
+  }
+  if (current) {
+    for (Light& l : Lights) {
+      l.setDefault(l.currentValue());
+    }
+  }
+  settingsModified();
+  server.send(200);
+}
+
+// Binary snapshot of the settings, to back a device up or provision others in one round trip:
+// GET returns it, POST (a file upload) validates it whole, applies it and writes it as one
+// settings record. The payload is the record, of any version up to SETTINGS_VERSION, so that
+// snapshots of older firmwares still apply; little endian, as the ESP8266.
+#define SNAPSHOT_MAGIC 0x31534841   // "AHS1"
+#define SNAPSHOT_HEADER 8           // bytes - magic, version, length
+struct Snapshot
+{
+  uint32_t magic;
+  uint16_t version;                 // of the settings record
+  uint16_t length;                  // bytes of the record, followed by the CRC-32 of what precedes it
+  Settings settings;
+  uint32_t crc;                     // where a record of this version ends
+};
+static_assert(offsetof(Snapshot, settings) == SNAPSHOT_HEADER && offsetof(Snapshot, crc) == SNAPSHOT_HEADER + sizeof(Settings),
+              "a snapshot is a header, the record and its CRC");
+static Snapshot snapshot;
+static size_t snapshotReceived = 0;   // bytes, more than sizeof(snapshot) once too large
+
+static void snapshot_handler() {
+  snapshot.magic = SNAPSHOT_MAGIC;
+  snapshot.version = SETTINGS_VERSION;
+  snapshot.length = sizeof(Settings);
+  currentSettings(snapshot.settings);
+  snapshot.crc = crc32(&snapshot, offsetof(Snapshot, crc));
+  server.send(200, "application/octet-stream", (const char*)&snapshot, sizeof(snapshot));
+}
+
+static void snapshotUpload() {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) snapshotReceived = 0;
+  else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (snapshotReceived + upload.currentSize <= sizeof(snapshot)) {
+      memcpy((uint8_t*)&snapshot + snapshotReceived, upload.buf, upload.currentSize);
+    }
+    snapshotReceived += upload.currentSize;
+  }
+}
+
+static void snapshotRestore() {
+  const char* error = NULL;
+  uint32_t crc;
+  if (snapshotReceived < SNAPSHOT_HEADER + sizeof(crc) || snapshotReceived > sizeof(snapshot) || snapshot.magic != SNAPSHOT_MAGIC) {
+    error = "not a snapshot";
+  }
+  else if (snapshot.version > SETTINGS_VERSION || snapshot.length > sizeof(Settings)) error = "newer version";
+  else if (snapshotReceived != SNAPSHOT_HEADER + snapshot.length + sizeof(crc)) error = "truncated";
+  else {
+    memcpy(&crc, (uint8_t*)&snapshot + SNAPSHOT_HEADER + snapshot.length, sizeof(crc));
+    if (crc != crc32(&snapshot, SNAPSHOT_HEADER + snapshot.length)) error = "CRC mismatch";
+  }
+  if (error) {
+    server.send(400, "text/plain", error);
+    return;
+  }
+  applySettings(snapshot.settings, snapshot.length);
+#ifdef ENABLE_MQTT
+  char broker[MQTT_HOST_SIZE + 6];
+  snprintf(broker, sizeof(broker), "%s:%u", mqttHost, mqttPort);
+  setMqttBroker(broker);   // reconnects
+#endif
+  saveSettings();
+  server.send(200);
+}
+
+// Deadlines are millis() values, 0 for none, compared by their signed distance to survive the rollover
+static unsigned long deadlineIn(unsigned long ms)
+{
+  unsigned long deadline = millis() + ms;
+  return deadline != 0 ? deadline : 1;
+}
+
+static unsigned long untilDeadline(unsigned long deadline, unsigned long currentTime)
+{
+  return deadline != 0 ? (unsigned long)MAX(0, (int32_t)(deadline - currentTime)) : 0;
+}
+
+static void requestReboot(int timer = REBOOT_TIMER)
+{
+  if (timer == 0) {
+    if (settingsDirty) saveSettings();
+    ESP.restart();
+  }
+  else {
+    rebootRequested = deadlineIn(timer * 1000);
+  }
+}
+
+#ifdef ENABLE_MQTT
+// MQTT client: the bulb and the RGBW channels are two Home Assistant lights (JSON schema), discovered
+// from retained configs under MQTT_DISCOVERY. Their state is published retained on
+// MQTT_PREFIX/<chip id>/<entity> when it changes, at most every MQTT_PUBLISH_PERIOD while a ramp
+// runs (the value it ends on always goes out), and commands on .../<entity>/set run through setDimming():
+//   {"state":"ON"|"OFF","brightness":0-255,"color":{"r":..,"g":..,"b":..,"w":..},"transition":seconds}
+// "ON" alone is the light defaults. Availability is the will, on MQTT_PREFIX/<chip id>/status.
+// A lost broker is retried with exponential backoff. Its name is resolved by lwIP in the background,
+// given up after MQTT_RESOLVE_TIMEOUT, and looked up again when its address refuses a connection;
+// only the TCP connect blocks, for MQTT_CONNECT_TIMEOUT at most, and ramps keep running meanwhile.
+#define MQTT_PREFIX          "annahand"
+#define MQTT_DISCOVERY       "homeassistant"
+#define MQTT_BUFFER          256     // bytes - largest packet received, a command is far smaller
+#define MQTT_PAYLOAD         400     // bytes - largest message sent, the discovery config
+#define MQTT_TOPIC           64      // bytes
+#define MQTT_KEEPALIVE       30      // s
+#define MQTT_CONNECT_TIMEOUT 200     // ms - TCP connection to the broker
+#define MQTT_RESOLVE_TIMEOUT 2000    // ms - DNS lookup of its name
+#define MQTT_RETRY_MIN       1000    // ms - first retry after a failure, doubled up to MQTT_RETRY_MAX
+#define MQTT_RETRY_MAX       60000   // ms
+#define MQTT_PUBLISH_PERIOD  500     // ms - shortest interval between two states of an entity
+#define MQTT_TRANSITION_MAX  600000  // ms
+
+// Lights published as one Home Assistant light, the colour keys map to its channels in Lights order
+struct MqttEntity
+{
+  char name[CHANNEL_NAME_SIZE];
+  uint8_t lights;
+};
+static constexpr MqttEntity MQTT_ENTITIES[] PROGMEM = {
+  { "bulb", 1 << 0 },
+  { "rgbw", groupLights(GROUP_RGBW) },
+};
+#define MQTT_ENTITY_COUNT (sizeof(MQTT_ENTITIES) / sizeof(MQTT_ENTITIES[0]))
+static const char MQTT_COLOR_KEYS[] = "rgbw";
+
+struct MqttState
+{
+  uint8_t values[LIGHT_COUNT];   // published, in Lights order
+  bool valid;                    // published on this connection
+  unsigned long time;            // millis() of the last attempt
+};
+
+typedef MqttClient<MQTT_BUFFER> Mqtt;
+static Mqtt mqtt(MQTT_CONNECT_TIMEOUT);
+static char mqttBase[24];                          // MQTT_PREFIX "/<chip id>"
+static bool mqttReady = false;                     // discovery sent and commands subscribed on this connection
+static unsigned long mqttRetry = 0;                // deadline of the next connection attempt, 0 for now
+static unsigned long mqttBackoff = MQTT_RETRY_MIN; // ms
+static IPAddress mqttAddress;                      // of mqttHost, unset until resolved
+static enum { MQTT_LOOKUP_NONE, MQTT_LOOKUP_PENDING, MQTT_LOOKUP_FOUND, MQTT_LOOKUP_FAILED } mqttLookup = MQTT_LOOKUP_NONE;
+static uintptr_t mqttLookupId = 0;                 // of the latest lookup, older answers are ignored
+static unsigned long mqttLookupTimeout;            // deadline of the pending lookup
+static MqttState mqttStates[MQTT_ENTITY_COUNT];
+static uint8_t mqttColor[LIGHT_COUNT] = { 255, 255, 255, 255, 255 };   // last colour, for a brightness alone
+
+static uint8_t mqttLights(size_t entity) { return pgm_read_byte(&MQTT_ENTITIES[entity].lights); }
+static bool mqttColored(size_t entity) { return (mqttLights(entity) & (mqttLights(entity) - 1)) != 0; }
+
+// MQTT_PREFIX/<chip id>/<entity><suffix>, or .../status when entity is out of range
+static const char* mqttTopic(char (&topic)[MQTT_TOPIC], size_t entity, const char* suffix = "")
+{
+  char name[CHANNEL_NAME_SIZE];
+  if (entity < MQTT_ENTITY_COUNT) memcpy_P(name, MQTT_ENTITIES[entity].name, sizeof(name));
+  else strcpy(name, "status");
+  snprintf(topic, sizeof(topic), "%s/%s%s", mqttBase, name, suffix);
+  return topic;
+}
+
+// Brightness of an entity, its maximum channel, and the colour of each channel scaled to it
+static uint8_t mqttBrightness(size_t entity, uint8_t* color)
+{
+  uint8_t lights = mqttLights(entity), brightness = 0;
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (lights & (1 << i)) brightness = MAX(brightness, Lights[i].currentValue());
+  }
+  for (size_t i = 0; i < LIGHT_COUNT && brightness; ++i) {
+    if (lights & (1 << i)) color[i] = Lights[i].currentValue() * 255 / brightness;
+  }
+  return brightness;
+}
+
+static bool mqttPublishState(size_t entity)
+{
+  char topic[MQTT_TOPIC], payload[MQTT_BUFFER];
+  uint8_t brightness = mqttBrightness(entity, mqttColor);
+  int length = snprintf(payload, sizeof(payload), "{\"state\":\"%s\",\"brightness\":%u", brightness ? "ON" : "OFF", brightness);
+  if (mqttColored(entity)) {
+    const char* separator = ",\"color_mode\":\"rgbw\",\"color\":{";
+    for (size_t i = 0, key = 0; i < LIGHT_COUNT; ++i) {
+      if (!(mqttLights(entity) & (1 << i))) continue;
+      length += snprintf(payload + length, sizeof(payload) - length, "%s\"%c\":%u", separator, MQTT_COLOR_KEYS[key++], mqttColor[i]);
+      separator = ",";
+    }
+    length += snprintf(payload + length, sizeof(payload) - length, "}");
+  }
+  snprintf(payload + length, sizeof(payload) - length, "}");
+  return mqtt.publish(mqttTopic(topic, entity), payload, true);
+}
+
+// Availability, discovery configs and command subscriptions, once per connection
+static bool mqttAnnounce()
+{
+  char topic[MQTT_TOPIC], payload[MQTT_PAYLOAD], name[CHANNEL_NAME_SIZE];
+  const char* id = mqttBase + sizeof(MQTT_PREFIX);
+  if (!mqtt.publish(mqttTopic(topic, MQTT_ENTITY_COUNT), "online", true)) return false;
+  for (size_t entity = 0; entity < MQTT_ENTITY_COUNT; ++entity) {
+    memcpy_P(name, MQTT_ENTITIES[entity].name, sizeof(name));
+    snprintf(payload, sizeof(payload),
+             "{\"~\":\"%s\",\"name\":\"%s\",\"uniq_id\":\"" MQTT_PREFIX "_%s_%s\",\"schema\":\"json\","
+             "\"stat_t\":\"~/%s\",\"cmd_t\":\"~/%s/set\",\"avty_t\":\"~/status\",\"brightness\":true,"
+             "\"sup_clrm\":[\"%s\"],\"dev\":{\"ids\":[\"" MQTT_PREFIX "_%s\"],\"name\":\"" TAG " %s\","
+             "\"mdl\":\"" TAG "\",\"sw\":\"" VERSION "\"}}",
+             mqttBase, name, id, name, name, name, mqttColored(entity) ? "rgbw" : "brightness", id, id);
+    snprintf(topic, sizeof(topic), MQTT_DISCOVERY "/light/" MQTT_PREFIX "_%s/%s/config", id, name);
+    if (!mqtt.publish(topic, payload, true) || !mqtt.subscribe(mqttTopic(topic, entity, "/set"))) return false;
+  }
+  return true;
+}
 
-ESP8266WebServer server ( WEB_SERVER_PORT );
+// Value of "key" in a flat JSON object, NULL if absent
+static const char* jsonField(const char* json, const char* key)
+{
+  size_t length = strlen(key);
+  for (const char* quote = strchr(json, '"'); quote; quote = strchr(quote + 1, '"')) {
+    if (strncmp(quote + 1, key, length) != 0 || quote[length + 1] != '"') continue;
+    const char* value = quote + length + 2;
+    while (*value == ' ') ++value;
+    if (*value != ':') continue;
+    for (++value; *value == ' '; ++value) {}
+    return value;
+  }
+  return NULL;
+}
 
-#define OTA_TIMER (10*60)
-#define FLASH_TIMER (10)
-#define REBOOT_TIMER (3)
-#define OTA_REBOOT_TIMER (1)
+static void mqttCommand(size_t entity, const char* json)
+{
+  uint8_t lights = mqttLights(entity);
+  const char* state = jsonField(json, "state");
+  const char* brightness = jsonField(json, "brightness");
+  const char* color = jsonField(json, "color");
+  const char* transition = jsonField(json, "transition");
+  int ramp = transition ? MIN(MAX(0, (int)(atof(transition) * 1000)), MQTT_TRANSITION_MAX) : -1;
+  scenes.stop(lights);
+  bool off = state && strncmp(state, "\"OFF\"", 5) == 0;
+  if (off || (!brightness && !color)) {
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+      if (lights & (1 << i)) Lights[i].setDimming(!off, ramp);
+    }
+    ramps.blend(lights);
+    return;
+  }
+  uint8_t current = mqttBrightness(entity, mqttColor);
+  int level = brightness ? MIN(MAX(0, atoi(brightness)), 255) : current ? current : 255;
+  for (size_t i = 0, key = 0; i < LIGHT_COUNT; ++i) {
+    if (!(lights & (1 << i))) continue;
+    char name[2] = { MQTT_COLOR_KEYS[key++], '\0' };
+    const char* component = color ? jsonField(color, name) : NULL;
+    if (component) mqttColor[i] = MIN(MAX(0, atoi(component)), 255);
+    Lights[i].setDimming((unsigned short)(mqttColored(entity) ? mqttColor[i] * level / 255 : level), ramp);
+  }
+  ramps.blend(lights);
+}
 
-int64_t rebootRequested = 0;
-int64_t otaOnTimer = 0;
+static void mqttReceived(const char* topic, const char* payload, size_t)
+{
+  char command[MQTT_TOPIC];
+  for (size_t entity = 0; entity < MQTT_ENTITY_COUNT; ++entity) {
+    if (strcmp(topic, mqttTopic(command, entity, "/set")) == 0) mqttCommand(entity, payload);
+  }
+}
 
-#define PIN_SENSOR          D0  // GPIO16
-#define PIN_LED_HAND_LIGHT  D5  // GPIO14
-#define PIN_LED_HAND_RGBW_R D4  // GPIO2 (builtin led)
-#define PIN_LED_HAND_RGBW_G D3  // GPIO0
-#define PIN_LED_HAND_RGBW_B D2  // GPIO4
-#define PIN_LED_HAND_RGBW_W D1  // GPIO5
+static void mqttFailed()
+{
+  mqttRetry = deadlineIn(mqttBackoff);
+  mqttBackoff = MIN(2 * mqttBackoff, MQTT_RETRY_MAX);
+}
 
-class Light
+// lwIP answer to the lookup of mqttHost, from its context: wakes loop() up to connect
+static void mqttResolved(const char*, const ip_addr_t* address, void* id)
 {
-  public:
-    enum { EEPROM_SIZE = 64 };
-    Light(String name, int pin, int baseEEPROM): m_name(name), m_pin(pin), m_baseAddr(baseEEPROM)
-    {
-      pinMode(pin, OUTPUT);
-      // read EEPROM
-      if (EEPROM.read(m_baseAddr) != 0) {
-        EEPROM.put<unsigned char>(m_baseAddr, 0);
-        EEPROM.put<unsigned short>(m_baseAddr+sizeof(unsigned char), m_defaultValue);
-        EEPROM.put<unsigned short>(m_baseAddr+2*sizeof(unsigned char), m_defaultRampOn);
-        EEPROM.put<unsigned short>(m_baseAddr+2*sizeof(unsigned char)+sizeof(unsigned short), m_defaultRampOff);
-        EEPROM.put<unsigned int>(m_baseAddr+2*sizeof(unsigned char)+2*sizeof(unsigned short), m_defaultDelay);
-        EEPROM.commit();
-      }
-      EEPROM.get<unsigned short>(m_baseAddr+sizeof(unsigned char), m_defaultValue);
-      EEPROM.get<unsigned short>(m_baseAddr+2*sizeof(unsigned char), m_defaultRampOn);
-      EEPROM.get<unsigned short>(m_baseAddr+2*sizeof(unsigned char)+sizeof(unsigned short), m_defaultRampOff);
-      EEPROM.get<unsigned int>(m_baseAddr+2*sizeof(unsigned char)+2*sizeof(unsigned short), m_defaultDelay);
-    }
-    String name() const { return m_name; }
-    int currentValue() const { return m_currentValue; }
-    int currentProgression() const { return m_ramp>0?m_currentProgression*100/m_ramp:100; }
-    int currentTarget() const { return m_targetValue; }
-    void setDefault(unsigned short value) { m_defaultValue = value; EEPROM.put<unsigned short>(m_baseAddr+sizeof(unsigned char), value); }
-    void setDefaultRampOn(unsigned short rampOn) { m_defaultRampOn = rampOn; EEPROM.put<unsigned short>(m_baseAddr+2*sizeof(unsigned char), rampOn); }
-    void setDefaultRampOff(unsigned short rampOff) { m_defaultRampOff = rampOff; EEPROM.put<unsigned short>(m_baseAddr+2*sizeof(unsigned char)+sizeof(unsigned short), rampOff); }
-    void setDefaultDelay(unsigned int value) { m_defaultDelay = value; EEPROM.put<unsigned int>(m_baseAddr+2*sizeof(unsigned char)+2*sizeof(unsigned short), value); }
-    void defaultValues(unsigned short &value, unsigned short &rampOn, unsigned short &rampOff, unsigned int &delay)
-    {
-      value = m_defaultValue;
-      rampOn = m_defaultRampOn;
-      rampOff = m_defaultRampOff;
-      delay = m_defaultDelay;
-    }
-    void setDimming(bool on, int ramp = -1) {
-      if (on) setDimming(m_defaultValue, ramp);
-      else setDimming((unsigned short)0, ramp);
-    }
-    void setDimming(unsigned short value, int ramp = -1)
-    {
-      m_originalValue = m_currentValue;
-      m_targetValue = value;
-      m_ramp = ramp>=0?ramp:(value?m_defaultRampOn:m_defaultRampOff);
-      m_lastUpdate = millis();
-      m_delayTimeout = m_lastUpdate + m_defaultDelay;
-    }
-    void update()
-    {
-      unsigned long currentUpdate = millis();
-      if (m_defaultDelay > 0 && m_targetValue > 0 && m_delayTimeout > currentUpdate) {
-        setDimming(false);
-      }
-      if (m_currentValue != m_targetValue) {
-        if (m_ramp > 0) {
-          m_currentProgression += ((int64_t)currentUpdate - m_lastUpdate);
-          if (m_currentProgression >= m_ramp) {
-            m_currentValue = m_targetValue;
-            m_ramp = 0;
-            m_lastUpdate = 0;
-            m_currentProgression = 0;
-          }
-          else {
-            m_currentValue = m_originalValue + ((int64_t)m_targetValue - m_originalValue) * MIN(m_ramp, m_currentProgression) / (m_ramp);          
-            m_lastUpdate = currentUpdate;
-          }
-        }
-        else {
-          m_currentValue = m_targetValue;
-        }
-        analogWrite(m_pin, PWMRANGE * m_currentValue / 256);
-      }
-    }
-  protected:
-    String m_name;
-    int m_pin;
-    int m_baseAddr;
-    unsigned short m_currentValue = 0;
-    unsigned short m_originalValue = 0;
-    unsigned short m_targetValue = 0;
-    unsigned short m_ramp = 0;
-    unsigned long m_currentProgression = 0;
-    unsigned long m_lastUpdate = 0;
-    unsigned long m_delayTimeout = 0;
-    unsigned short m_defaultValue = 255;
-    unsigned short m_defaultRampOn = 3000;
-    unsigned short m_defaultRampOff = 3000;
-    unsigned int m_defaultDelay = 0;
-};
-static std::vector<Light> Lights;
+  if ((uintptr_t)id != mqttLookupId || mqttLookup != MQTT_LOOKUP_PENDING) return;   // given up, or another broker
+  if (address) mqttAddress = IPAddress(address);
+  mqttLookup = address ? MQTT_LOOKUP_FOUND : MQTT_LOOKUP_FAILED;
+  esp_schedule();
+}
 
-static void default_handler() {
-  EEPROM.begin(Lights.size() * Light::EEPROM_SIZE);
-  for (Light& l : Lights) {
-    String arg;
-    if ((arg = server.arg(l.name())) != "") {
-      l.setDefault(arg.toInt());
-    }
-    if ((arg = server.arg(l.name()+"_rampOn")) != "") {
-      l.setDefaultRampOn(arg.toInt());
-    }
-    if ((arg = server.arg(l.name()+"_rampOn")) != "") {
-      l.setDefaultRampOff(arg.toInt());
-    }
-    if ((arg = server.arg(l.name()+"_delay")) != "") {
-      l.setDefaultDelay(arg.toInt());
+// True once mqttAddress is known; else starts the lookup of mqttHost, or backs off when it failed
+static bool mqttResolve(unsigned long currentTime)
+{
+  if (mqttLookup == MQTT_LOOKUP_FOUND) mqttLookup = MQTT_LOOKUP_NONE;
+  if (mqttAddress.isSet()) return true;
+  if (mqttLookup == MQTT_LOOKUP_PENDING && untilDeadline(mqttLookupTimeout, currentTime) > 0) return false;
+  if (mqttLookup != MQTT_LOOKUP_NONE) {
+    mqttLookup = MQTT_LOOKUP_NONE;
+    ++mqttLookupId;
+    mqttFailed();
+    return false;
+  }
+  ip_addr_t address;
+  switch (dns_gethostbyname(mqttHost, &address, mqttResolved, (void*)++mqttLookupId)) {
+    case ERR_OK:
+      mqttAddress = IPAddress(&address);
+      return true;
+    case ERR_INPROGRESS:
+      mqttLookup = MQTT_LOOKUP_PENDING;
+      mqttLookupTimeout = deadlineIn(MQTT_RESOLVE_TIMEOUT);
+      return false;
+    default:
+      mqttFailed();
+      return false;
+  }
+}
+
+// The lights of an entity differ from its last published state
+static bool mqttChanged(size_t entity)
+{
+  const MqttState& state = mqttStates[entity];
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if ((mqttLights(entity) & (1 << i)) && state.values[i] != Lights[i].currentValue()) return true;
+  }
+  return !state.valid;
+}
+
+// Connect when due, handle commands, publish the states that changed
+static void mqttUpdate(unsigned long currentTime)
+{
+  if (!mqttHost[0] || !WiFi.isConnected()) return;   // after the station connected at boot
+  if (mqtt.state() == Mqtt::DISCONNECTED) {
+    if (untilDeadline(mqttRetry, currentTime) > 0 || !mqttResolve(currentTime)) return;
+    char will[MQTT_TOPIC], clientId[sizeof(mqttBase)];
+    snprintf(clientId, sizeof(clientId), MQTT_PREFIX "-%s", mqttBase + sizeof(MQTT_PREFIX));
+    ++metrics.mqttConnects;
+    mqttReady = false;
+    if (!mqtt.connect(mqttAddress, mqttPort, clientId, mqttTopic(will, MQTT_ENTITY_COUNT), "offline", MQTT_KEEPALIVE, currentTime)) {
+      mqttAddress = IPAddress();   // the name may have moved
+      mqttFailed();
+      return;
     }
   }
-  if (server.arg("all") == "current") {
-    for (Light& l : Lights) {
-      l.setDefault(l.currentValue());
+  if (!mqtt.poll(currentTime, mqttReceived)) {
+    mqttFailed();
+    return;
+  }
+  if (mqtt.state() != Mqtt::CONNECTED) return;
+  if (!mqttReady) {
+    if (!(mqttReady = mqttAnnounce())) return;
+    mqttBackoff = MQTT_RETRY_MIN;
+    for (MqttState& state : mqttStates) {
+      state.valid = false;
+      state.time = currentTime - MQTT_PUBLISH_PERIOD;
     }
   }
+  for (size_t entity = 0; entity < MQTT_ENTITY_COUNT; ++entity) {
+    MqttState& state = mqttStates[entity];
+    if (!mqttChanged(entity) || (uint32_t)(currentTime - state.time) < MQTT_PUBLISH_PERIOD) continue;
+    state.time = currentTime;
+    if (!mqttPublishState(entity)) continue;
+    for (size_t i = 0; i < LIGHT_COUNT; ++i) state.values[i] = Lights[i].currentValue();
+    state.valid = true;
+    ++metrics.mqttPublishes;
+  }
+}
 
-  EEPROM.commit();
-  EEPROM.end();
-  server.send(200);
+// Time (ms) until mqttUpdate() has something to do besides reading commands
+static unsigned long mqttNextUpdate(unsigned long currentTime)
+{
+  if (!mqttHost[0] || !WiFi.isConnected()) return IDLE_MAX_SLEEP;   // see wifiUpdate()
+  if (mqtt.state() == Mqtt::DISCONNECTED) {
+    if (mqttLookup == MQTT_LOOKUP_PENDING) return untilDeadline(mqttLookupTimeout, currentTime);   // or its answer
+    return mqttLookup != MQTT_LOOKUP_NONE ? 0 : untilDeadline(mqttRetry, currentTime);   // answered
+  }
+  unsigned long next = mqtt.nextUpdate(currentTime);
+  if (mqtt.state() != Mqtt::CONNECTED) return next;
+  if (!mqttReady) return MIN(next, RAMP_TICK);   // the socket had no room for the announce
+  for (size_t entity = 0; entity < MQTT_ENTITY_COUNT; ++entity) {
+    const MqttState& state = mqttStates[entity];
+    unsigned long due = MQTT_PUBLISH_PERIOD - MIN(MQTT_PUBLISH_PERIOD, (uint32_t)(currentTime - state.time));
+    if (mqttChanged(entity)) next = MIN(next, due);
+    else if (ramps.running & mqttLights(entity)) next = MIN(next, MAX(due, RAMP_TICK));   // its next step
+  }
+  return next;
 }
 
-static int hex2int(String hex)
+// host[:port], empty to disable; the availability goes offline on the previous broker
+static void setMqttBroker(const char* broker)
 {
-  int result = 0;
-  for (unsigned int i = 0; i < hex.length(); ++i) {
-    unsigned char ch = hex.charAt(i);
-    int num;
-    switch(ch) {
-      case 'A': case 'a': num=10; break;
-      case 'B': case 'b': num=11; break;
-      case 'C': case 'c': num=12; break;
-      case 'D': case 'd': num=13; break;
-      case 'E': case 'e': num=14; break;
-      case 'F': case 'f': num=15; break;
-      default: num=(ch>='0' && ch<='9')?ch-'0':0; break;
-    }
-    result = result * 16 + num;
+  const char* colon = strchr(broker, ':');
+  size_t length = colon ? colon - broker : strlen(broker);
+  if (length >= sizeof(mqttHost)) return;
+  if (mqtt.state() == Mqtt::CONNECTED) {
+    char topic[MQTT_TOPIC];
+    mqtt.publish(mqttTopic(topic, MQTT_ENTITY_COUNT), "offline", true);
   }
-  return result;
+  mqtt.disconnect();
+  memcpy(mqttHost, broker, length);
+  mqttHost[length] = '\0';
+  mqttPort = colon ? atoi(colon + 1) : MQTT_PORT;
+  mqttRetry = 0;
+  mqttBackoff = MQTT_RETRY_MIN;
+  mqttAddress = IPAddress();
+  mqttLookup = MQTT_LOOKUP_NONE;
+  ++mqttLookupId;
 }
+#endif
 
-static String int2hex(int value, unsigned int fillWidth = 2)
+// Power - while every light is dark and still, the radio sleeps (modem sleep) and wakes up every
+// listen interval, a multiple of the beacon interval, for the frames the AP buffered meanwhile: a
+// request waits powerLatency at most. The sensor is sampled as before and wakes loop() at once.
+// Dark channels are written 0, which stops their PWM waveform (and timer1 after the last one).
+// Lit, the radio stays awake so that slider drags and music sync are not delayed. Light sleep would
+// stop the CPU too, but GPIO16 cannot wake it and its sensor would go unsampled.
+// The duty cycle and the wake-ups, of loop() and of the socket polls in idle(), are measured over
+// POWER_WINDOW, the module current estimated from the radio.
+#ifdef ENABLE_POWER_SAVE
+#define POWER_BEACON     102    // ms - beacon interval (100 TU)
+#define POWER_LISTEN_MAX 10     // beacons - longest listen interval the SDK takes
+#define POWER_WINDOW     10000  // ms - duty cycle measure period
+#define POWER_AWAKE_MA   70     // mA - radio receiving
+#define POWER_MODEM_MA   15     // mA - CPU running, radio off (modem sleep)
+#define POWER_LISTEN_MS  3      // ms - radio on at each listen, beacon and buffered frames
+
+enum PowerMode { POWER_DEFAULT, POWER_AWAKE, POWER_SLEEP };
+
+static struct Power
 {
+  uint8_t mode;            // PowerMode
+  uint8_t listen;          // beacons, POWER_SLEEP
+  unsigned long since;     // millis() at the start of the window
+  uint32_t busy;           // us - awake in the window: loop() without its sleep, and the socket polls
+  uint32_t woken;          // wake-ups in the window: loop() calls and socket polls
+  uint16_t duty;           // 1/10000 - last window
+  uint16_t wakeups;        // per second, last window
+} power;
 
-  String result(value, HEX);
-  while (result.length() < fillWidth) result = "0" + result;
-  return result;
+static const char* powerModeName(uint8_t mode)
+{
+  static const char* const names[] = { "default", "awake", "sleep" };
+  return names[mode];
 }
 
-static void light_handler() {
-  int ramp = server.hasArg("ramp")?server.arg("ramp").toInt():-1;
-  for (Light& l : Lights) {
-    String param = server.arg(l.name());
-    if (param == "") continue;
-    else if (param == "on") {
-      l.setDimming(true, ramp);
-    }
-    else if (param == "off") {
-      l.setDimming(false, ramp);
-    }
-    else if (param == "toggle") {
-      l.setDimming(l.currentValue()?false:true, ramp);
-    }
-    else {
-      l.setDimming((unsigned short)param.toInt(), ramp);
-    }
-  }
-  String param = server.arg("all");
-  if (param != "") {
-    if (param == "toggle") {
-      bool isOn = Lights[0].currentValue() || Lights[1].currentValue() || Lights[2].currentValue() || Lights[3].currentValue() || Lights[4].currentValue();
-      Lights[0].setDimming(isOn?false:true, ramp);
-      Lights[1].setDimming(isOn?false:true, ramp);
-      Lights[2].setDimming(isOn?false:true, ramp);
-      Lights[3].setDimming(isOn?false:true, ramp);
-      Lights[4].setDimming(isOn?false:true, ramp);
-    }
-    else if (param == "on") {
-      Lights[0].setDimming(true, ramp);
-      Lights[1].setDimming(true, ramp);
-      Lights[2].setDimming(true, ramp);
-      Lights[3].setDimming(true, ramp);
-      Lights[4].setDimming(true, ramp);
-    }
-    else if (param == "off") {
-      Lights[0].setDimming(false, ramp);
-      Lights[1].setDimming(false, ramp);
-      Lights[2].setDimming(false, ramp);
-      Lights[3].setDimming(false, ramp);
-      Lights[4].setDimming(false, ramp);
-    }
-    else if (param.startsWith("#")) {
-      Lights[0].setDimming((unsigned short)(hex2int(param.substring(1,3))), ramp);
-      Lights[1].setDimming((unsigned short)(hex2int(param.substring(3,5))), ramp);
-      Lights[2].setDimming((unsigned short)(hex2int(param.substring(5,7))), ramp);
-      Lights[3].setDimming((unsigned short)(hex2int(param.substring(7,9))), ramp);
-      Lights[4].setDimming((unsigned short)(hex2int(param.substring(9,11))), ramp);
-    }
-  }
-  param = server.arg("rgbw");
-  if (param != "") {
-    if (param == "toggle") {
-      bool isOn = Lights[1].currentValue() || Lights[2].currentValue() || Lights[3].currentValue() || Lights[4].currentValue();
-      Lights[1].setDimming(isOn?false:true, ramp);
-      Lights[2].setDimming(isOn?false:true, ramp);
-      Lights[3].setDimming(isOn?false:true, ramp);
-      Lights[4].setDimming(isOn?false:true, ramp);
-    }
-    else if (param == "on") {
-      Lights[1].setDimming(true, ramp);
-      Lights[2].setDimming(true, ramp);
-      Lights[3].setDimming(true, ramp);
-      Lights[4].setDimming(true, ramp);
-    }
-    else if (param == "off") {
-      Lights[1].setDimming(false, ramp);
-      Lights[2].setDimming(false, ramp);
-      Lights[3].setDimming(false, ramp);
-      Lights[4].setDimming(false, ramp);
-    }
-    else if (param.startsWith("#")) {
-      Lights[1].setDimming((unsigned short)(hex2int(param.substring(1,3))), ramp);
-      Lights[2].setDimming((unsigned short)(hex2int(param.substring(3,5))), ramp);
-      Lights[3].setDimming((unsigned short)(hex2int(param.substring(5,7))), ramp);
-      Lights[4].setDimming((unsigned short)(hex2int(param.substring(7,9))), ramp);
-    }
-  }
-  param = server.arg("rgb");
-  if (param != "") {
-    if (param == "toggle") {
-      bool isOn = Lights[1].currentValue() || Lights[2].currentValue() || Lights[3].currentValue();
-      Lights[1].setDimming(isOn?false:true, ramp);
-      Lights[2].setDimming(isOn?false:true, ramp);
-      Lights[3].setDimming(isOn?false:true, ramp);
-    }
-    else if (param == "on") {
-      Lights[1].setDimming(true, ramp);
-      Lights[2].setDimming(true, ramp);
-      Lights[3].setDimming(true, ramp);
-    }
-    else if (param == "off") {
-      Lights[1].setDimming(false, ramp);
-      Lights[2].setDimming(false, ramp);
-      Lights[3].setDimming(false, ramp);
-    }
-    else if (param.startsWith("#")) {
-      Lights[1].setDimming((unsigned short)(hex2int(param.substring(1,3))), ramp);
-      Lights[2].setDimming((unsigned short)(hex2int(param.substring(3,5))), ramp);
-      Lights[3].setDimming((unsigned short)(hex2int(param.substring(5,7))), ramp);
-    }
+// Module current, mA x 10: the SDK default is modem sleep listening at every DTIM (1 beacon)
+static unsigned powerCurrent()
+{
+  if (power.mode == POWER_AWAKE) return POWER_AWAKE_MA * 10;
+  unsigned listen = power.mode == POWER_SLEEP ? power.listen : 1;
+  return POWER_MODEM_MA * 10 + (POWER_AWAKE_MA - POWER_MODEM_MA) * 10 * POWER_LISTEN_MS / (listen * POWER_BEACON);
+}
+
+static bool powerDark()
+{
+  if (ramps.running || scenes.scene() != SCENE_NONE || firmware.state() == FirmwareUpdate::RECEIVING) return false;
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (ramps.duty[i] > 0) return false;
   }
-  server.send(200);
+  return true;
 }
 
-static void requestReboot(int timer = REBOOT_TIMER)
+// A wake-up of loop() or idle(), awake 'busy' us
+static void powerWake(uint32_t busy)
 {
-  if (timer == 0) {
-    ESP.restart();
+  power.busy += busy;
+  ++power.woken;
+}
+
+// Radio mode for the lights, once per loop(); 'busy': us - this loop() so far
+static void powerUpdate(unsigned long currentTime, uint32_t busy)
+{
+  uint8_t listen = MIN(powerLatency / POWER_BEACON, POWER_LISTEN_MAX);
+  uint8_t mode = !powerLatency ? POWER_DEFAULT : (listen && powerDark()) ? POWER_SLEEP : POWER_AWAKE;
+  if (mode != power.mode || (mode == POWER_SLEEP && listen != power.listen)) {
+    if (mode == POWER_SLEEP) WiFi.setSleepMode(WIFI_MODEM_SLEEP, listen);
+    else WiFi.setSleepMode(mode == POWER_AWAKE ? WIFI_NONE_SLEEP : WIFI_MODEM_SLEEP);
+    power.mode = mode;
+    power.listen = listen;
   }
-  else {
-    rebootRequested = millis() + timer * 1000;    
+  powerWake(busy);
+  unsigned long elapsed = (uint32_t)(currentTime - power.since);
+  if (elapsed >= POWER_WINDOW) {
+    power.duty = MIN((uint64_t)power.busy * 10 / elapsed, 10000);
+    power.wakeups = MIN(power.woken * 1000 / elapsed, 65535);
+    power.since = currentTime;
+    power.busy = 0;
+    power.woken = 0;
   }
 }
 
+// Period (ms) of the socket polls while loop() sleeps, 'poll' with the radio awake. Asleep, the
+// radio only receives frames once per listen interval: the polls take half of what it leaves of the
+// latency budget, the other half is margin for late beacons.
+static unsigned long powerPoll(unsigned long poll)
+{
+  if (power.mode != POWER_SLEEP) return poll;
+  return MAX(IDLE_POLL, (powerLatency - power.listen * POWER_BEACON) / 2);
+}
+#endif
+
 static void wifi_handler() {
   server.send(200);
   system_restore();
@@ -325,6 +2151,8 @@ static void reboot_handler() {
   server.send(200);
 }
 
+static unsigned long pushEvents(unsigned long currentTime);   // below, with the events; reports update progress
+
 #ifdef ENABLE_ARDUINOOTA
 ArduinoOTAClass * OTA = NULL;
 static void enableOTA(bool enable, bool forceCommit = false)
@@ -334,9 +2162,15 @@ static void enableOTA(bool enable, bool forceCommit = false)
       OTA = new ArduinoOTAClass();
       OTA->setHostname(TAG);
       OTA->setPasswordHash("913f9c49dcb544e2087cee284f4a00b7");   // MD5("device")
+      OTA->onStart([]() {
+        if (settingsDirty) saveSettings();
+        firmware.started();
+      });
+      OTA->onProgress([](unsigned int progress, unsigned int size) { firmware.progress(progress, size); pushEvents(millis()); });
+      OTA->onEnd([]() { firmware.installed(); });   // ArduinoOTA restarts by itself
+      OTA->onError([](ota_error_t) { firmware.failed("ArduinoOTA transfer failed"); });
       OTA->begin();
-      int64_t fr_start = millis();
-      otaOnTimer = fr_start + OTA_TIMER * 1000; // 10 minutes
+      otaOnTimer = deadlineIn(OTA_TIMER * 1000); // 10 minutes
     }
   }
   else {
@@ -347,7 +2181,7 @@ static void enableOTA(bool enable, bool forceCommit = false)
         otaOnTimer = 0;
       }
       else {
-        otaOnTimer = 1; // to be disabled on next loop
+        otaOnTimer = deadlineIn(0); // to be disabled on next loop
       }
     }
   }
@@ -367,244 +2201,674 @@ static void ota_handler() {
 #endif
 
 #ifdef ENABLE_UPDATE
+// POST /update?sha256=<64 hex digits>: the image (raw or gzip) is hashed while it is written and
+// only committed when the digest matches
 static void update_handler() {
   HTTPUpload& upload = server.upload();
   if (upload.status == UPLOAD_FILE_START) {
+    if (settingsDirty) saveSettings();
     Serial.setDebugOutput(true);
-    WiFiUDP::stopAll();
     Serial.printf("Update: %s\n", upload.filename.c_str());
-    uint32_t maxSketchSpace = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
-    if (!Update.begin(maxSketchSpace)) { //start with max available size
-      Update.printError(Serial);
-    }
+    firmware.start(server.arg("sha256").c_str());
   } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-      Update.printError(Serial);
-    }
+    firmware.write(upload.buf, upload.currentSize);
+    pushEvents(millis());
   } else if (upload.status == UPLOAD_FILE_END) {
-    if (Update.end(true)) { //true to set the size to the current progress
+    if (firmware.end()) {
       Serial.printf("Update Success: %u\nRebooting...\n", upload.totalSize);
     } else {
-      Update.printError(Serial);
+      Serial.printf("Update failed: %s\n", firmware.error());
     }
     Serial.setDebugOutput(false);
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    firmware.abort("upload aborted");
+    Serial.setDebugOutput(false);
   }
   yield();
 }
 #endif
 
+// Page compressed at build time by tools/web_assets.py, revalidated by the browser with its ETag
+static void sendPage(const uint8_t* page, size_t length, const char* etag)
+{
+  server.sendHeader(F("ETag"), etag);
+  server.sendHeader(F("Cache-Control"), F("no-cache"));
+  if (server.header(F("If-None-Match")) == etag) {
+    server.send(304);
+    return;
+  }
+  server.sendHeader(F("Content-Encoding"), F("gzip"));
+  server.send_P(200, PSTR("text/html"), (PGM_P)page, length);
+}
+
 static void usage_handler() {
-  String info =
-    "<html>"
-      "<head>"
-        "<title>" TAG " - API</title>"
-        "<style>"
-        "</style>"
-      "</head>"
-      "<body>"
-        "<h1>" TAG "<span id=\"version\"> (v" VERSION ") - API Usage</span></h1>"
-          "<ul>"
-            "<li>Reboot: " URI_REBOOT "</li>"
-            "<li>Reset Wifi: " URI_WIFI "</li>"
-#ifdef ENABLE_ARDUINOOTA
-            "<li>OTA on/off/toggle: " URI_OTA "?action=[on|off|toggle]</li>"
-#endif
-            "<li>LED on/off/toggle/value (0-255): " URI_LIGHT "?([bulb|red|green|blue|white|rgbw|all]=[on|off|toggle]&ramp=[0-9]*)+</li>"
-            "<li>LED set default values (value (0-255)- rampOn - rampOff: " URI_DEFAULT "?([bulb|red|green|blue][|_rampOn|_rampOff|_delay]=[0-9]*)+|all=current</li>"
-            "<li>Status (JSON): " URI_STATUS "</li>"
-        "</ul>"
-      "</body>"
-    "</html>";
-  server.send(200, "text/html", info);
+  sendPage(WEB_HELP, sizeof(WEB_HELP), WEB_HELP_ETAG);
 }
 
-static void status_handler() {
-  String lights;
-  for (size_t i = 0; i < Lights.size(); ++i) {
+// Appends formatted text to a fixed buffer, without heap allocation
+class JsonBuffer
+{
+  public:
+    JsonBuffer(char* buffer, size_t size): m_buffer(buffer), m_size(size) { m_buffer[0] = '\0'; }
+    void print(const char* format, ...) __attribute__ ((format (printf, 2, 3)))
+    {
+      if (m_length >= m_size) return;
+      va_list args;
+      va_start(args, format);
+      int len = vsnprintf(m_buffer + m_length, m_size - m_length, format, args);
+      va_end(args);
+      m_length = len < 0 ? m_size : MIN(m_size, m_length + len);
+    }
+    // JSON string content, stops at maxLength or at the first NUL
+    void printEscaped(const char* str, size_t maxLength)
+    {
+      for (size_t i = 0; i < maxLength && str[i]; ++i) {
+        unsigned char ch = str[i];
+        if (ch == '"' || ch == '\\') print("\\%c", ch);
+        else if (ch < 0x20) print("\\u%04x", ch);
+        else print("%c", ch);
+      }
+    }
+    const char* c_str() const { return m_buffer; }
+    size_t length() const { return m_length; }
+    size_t capacity() const { return m_size; }
+    bool overflow() const { return m_length >= m_size; }
+    void clear()
+    {
+      m_length = 0;
+      m_buffer[0] = '\0';
+    }
+  protected:
+    char* m_buffer;
+    size_t m_size;
+    size_t m_length = 0;
+};
+
+static void renderColors(JsonBuffer& json)
+{
+  json.print("\"rgb\":{\"value\":\"#%02x%02x%02x\"},",
+             Lights[1].currentValue(), Lights[2].currentValue(), Lights[3].currentValue());
+  json.print("\"rgbw\":{\"value\":\"#%02x%02x%02x%02x\"},",
+             Lights[1].currentValue(), Lights[2].currentValue(), Lights[3].currentValue(), Lights[4].currentValue());
+  json.print("\"Lrgbw\":{\"value\":\"#%02x%02x%02x%02x%02x\"},",
+             Lights[0].currentValue(), Lights[1].currentValue(), Lights[2].currentValue(), Lights[3].currentValue(), Lights[4].currentValue());
+  uint16_t rgb[3] = { uint16_t(Lights[1].currentValue() << 8), uint16_t(Lights[2].currentValue() << 8), uint16_t(Lights[3].currentValue() << 8) };
+  uint16_t hue, value;
+  uint8_t saturation;
+  ColorSpace::rgbToHsv(rgb, hue, saturation, value);
+  json.print("\"hsv\":{\"value\":\"%u,%u,%u\"}", (unsigned)((hue * 360UL + ColorSpace::HUE_RANGE / 2) / ColorSpace::HUE_RANGE) % 360,
+             saturation, value >> 8);
+}
+
+// Name of a channel or group from its mask of Lights indices
+static const char* lightsName(uint8_t lights, char (&name)[CHANNEL_NAME_SIZE])
+{
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    if (lights == 1 << i) return channelName(i, name);
+  }
+  name[0] = '\0';
+  for (const LightGroup& group : LIGHT_GROUPS) {
+    if (pgm_read_byte(&group.lights) == lights) memcpy_P(name, group.name, CHANNEL_NAME_SIZE);
+  }
+  return name;
+}
+
+// "sensor":{"<event>":"<action>[:<lights>]",...,"timeout":ms}
+static void renderSensor(JsonBuffer& json, const SensorAction* actions, uint32_t timeout)
+{
+  json.print("\"sensor\":{");
+  for (int i = 0; i < SENSOR_EVENTS; ++i) {
+    char event[8], type[8], target[CHANNEL_NAME_SIZE];
+    memcpy_P(event, SENSOR_EVENT_NAMES[i], sizeof(event));
+    if (actions[i].type == ACTION_SCENE) {
+      json.print("\"%s\":\"%s\",", event, sceneName(actions[i].target, target));
+    }
+    else {
+      memcpy_P(type, SENSOR_ACTION_NAMES[actions[i].type], sizeof(type));
+      if (actions[i].type == ACTION_NONE) json.print("\"%s\":\"%s\",", event, type);
+      else json.print("\"%s\":\"%s:%s\",", event, type, lightsName(actions[i].target, target));
+    }
+  }
+  json.print("\"timeout\":%u}", (unsigned)timeout);
+}
+
+static void renderUpdate(JsonBuffer& json, FirmwareUpdate::State state, size_t progress, size_t size, FirmwareUpdate::Boot boot)
+{
+  json.print("\"update\":{\"state\":\"%s\",\"progress\":%u,\"size\":%u,\"error\":\"%s\",\"boot\":\"%s\"}",
+             FirmwareUpdate::stateName(state), (unsigned)progress, (unsigned)size, state == FirmwareUpdate::FAILED ? firmware.error() : "",
+             FirmwareUpdate::bootName(boot));
+}
+
+static void renderStatus(JsonBuffer& json)
+{
+  struct station_config config;
+  uint8_t mac[6];
+  IPAddress ip = WiFi.localIP();
+  unsigned long currentTimer = millis();
+
+  wifi_station_get_config(&config);
+  WiFi.macAddress(mac);
+  json.print("{\"version\":\"" VERSION "\",\"ssid\":\"");
+  json.printEscaped((const char*)config.ssid, sizeof(config.ssid));
+  json.print("\",\"rssi\":\"%d\",\"ip\":\"%u.%u.%u.%u\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"chipId\":\"%u\",\"lights\":{",
+             (int)WiFi.RSSI(), ip[0], ip[1], ip[2], ip[3], mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], (unsigned)ESP.getChipId());
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
     unsigned short defaultValue, defaultRampOn, defaultRampOff; unsigned int defaultDelay;
+    char name[CHANNEL_NAME_SIZE];
     Lights[i].defaultValues(defaultValue, defaultRampOn, defaultRampOff, defaultDelay);
-    lights+= "\"" + Lights[i].name() + "\":{\"value\":"+String(Lights[i].currentValue()) + ",\"default\":"+String(defaultValue) + ",\"rampOn\":"+String(defaultRampOn) + ",\"rampOff\":"+String(defaultRampOff) + ",\"delay\":"+String(defaultDelay) + "},";
+    json.print("\"%s\":{\"value\":%d,\"default\":%u,\"rampOn\":%u,\"rampOff\":%u,\"delay\":%u},",
+               channelName(i, name), Lights[i].currentValue(), defaultValue, defaultRampOn, defaultRampOff, defaultDelay);
   }
-  lights+= "\"rgb\":{\"value\":\"#"+int2hex(Lights[1].currentValue())+int2hex(Lights[2].currentValue())+int2hex(Lights[3].currentValue())+"\"},";
-  lights+= "\"rgbw\":{\"value\":\"#"+int2hex(Lights[1].currentValue())+int2hex(Lights[2].currentValue())+int2hex(Lights[3].currentValue())+int2hex(Lights[4].currentValue())+"\"},";
-  lights+= "\"Lrgbw\":{\"value\":\"#"+int2hex(Lights[0].currentValue())+int2hex(Lights[1].currentValue())+int2hex(Lights[2].currentValue())+int2hex(Lights[3].currentValue())+int2hex(Lights[4].currentValue())+"\"}";
-  unsigned long currentTimer = millis();
-  String info = "{"
-                "\"version\":\"" VERSION "\","
-                "\"ssid\":\"" + WiFi.SSID() + "\","
-                "\"rssi\":\"" + String(WiFi.RSSI()) + "\","
-                "\"ip\":\"" + WiFi.localIP().toString() + "\","
-                "\"mac\":\"" + WiFi.macAddress() + "\","
-                "\"chipId\":\"" + ESP.getChipId() + "\","
-                "\"lights\":{" + lights + "},"
+  renderColors(json);
+  char scene[CHANNEL_NAME_SIZE];
+  json.print("},\"scene\":\"%s\",\"pwmFrequency\":%u,\"powerOn\":\"%s\",", sceneName(scenes.scene(), scene), pwmFrequency,
+             POWER_ON_NAMES[powerOn]);
+  // ms after setup() started, -1 until then
+  json.print("\"startup\":{\"light\":%ld,\"wifi\":%ld},", metrics.bootLight ? (long)(metrics.bootLight / 1000) : -1L,
+             metrics.bootWifi ? (long)metrics.bootWifi : -1L);
+  renderSensor(json, sensorActions, sensorTimeout);
+  json.print(",");
+  renderUpdate(json, firmware.state(), firmware.progress(), firmware.size(), firmware.boot());
+  json.print(",\"sync\":{\"role\":\"%s\",\"master\":%u,\"clock\":%u},", syncRole(), (unsigned)syncMaster,
+             (unsigned)syncClock(currentTimer));
+#ifdef ENABLE_MQTT
+  json.print("\"mqtt\":{\"broker\":\"");
+  json.printEscaped(mqttHost, sizeof(mqttHost));
+  json.print("\",\"port\":%u,\"state\":\"%s\"},", mqttPort, Mqtt::stateName(mqtt.state()));
+#endif
+#ifdef ENABLE_POWER_SAVE
+  unsigned current = powerCurrent();
+  json.print("\"power\":{\"latency\":%u,\"mode\":\"%s\",\"listen\":%u,\"duty\":%u.%02u,\"wakeups\":%u,\"current\":%u.%u},",
+             powerLatency, powerModeName(power.mode), power.mode == POWER_SLEEP ? power.listen : 0, power.duty / 100,
+             power.duty % 100, power.wakeups, current / 10, current % 10);
+#endif
 #ifdef ENABLE_ARDUINOOTA
-                "\"ota\":\"" + String(OTA ? "true" : "false") + "\","
-                "\"otaTimer\":" + String(MAX(0, int((otaOnTimer - currentTimer) / 1000))) + ","
+  json.print("\"ota\":\"%s\",\"otaTimer\":%lu,", OTA ? "true" : "false", untilDeadline(otaOnTimer, currentTimer) / 1000);
 #endif
-                "\"reboot\":\"" + String(rebootRequested > 0 ? "true" : "false") + "\","
-                "\"rebootTimer\":" + String(MAX(0, int((rebootRequested - currentTimer) / 1000))) + ""
-                "}";
-  server.send(200, "application/json", info);
+  json.print("\"reboot\":\"%s\",\"rebootTimer\":%lu}", rebootRequested > 0 ? "true" : "false", untilDeadline(rebootRequested, currentTimer) / 1000);
 }
 
-static void info_handler() {
-  static const __FlashStringHelper* info =
-    F("<html>"
-      "<head>"
-        "<title>" TAG "</title>"
-        "<script type=\"text/javascript\">"
-          "function invoke(url)"
-          "{"
-            "var xhr = new XMLHttpRequest();"
-            "xhr.open(\"GET\", url, true);"
-            "xhr.send(null);"
-          "};"
-          "function update()"
-          "{"
-            "var xhr = new XMLHttpRequest();"
-            "xhr.open(\"GET\", \"" URI_STATUS "\", true);"
-            "xhr.onload = function (e) {"
-              "if (xhr.readyState === 4) {"
-                "if (xhr.status === 200) {"
-                  "var obj = JSON.parse(xhr.responseText);"
-                  "document.getElementById(\"ssid\").innerHTML = obj.ssid;"
-                  "document.getElementById(\"rssi\").innerHTML = obj.rssi;"
-                  "document.getElementById(\"ip\").innerHTML = obj.ip;"
-                  "document.getElementById(\"mac\").innerHTML = obj.mac;"
-                  "document.getElementById(\"bulb\").value = obj.lights.bulb.value;"
-                  "document.getElementById(\"lights\").innerHTML = obj.lights.Lrgbw.value;"
-                  "document.getElementById(\"white\").value= obj.lights.white.value;"
-                  "document.getElementById(\"rgb\").value = obj.lights.rgb.value;"
-                  "document.getElementById(\"reboot\").innerHTML = obj.rebootTimer>0?\" - \"+obj.rebootTimer:\"\";"
-#ifdef ENABLE_ARDUINOOTA
-                  "document.getElementById(\"ota\").innerHTML = obj.ota==\"true\"?\" - On (\"+Math.round(obj.otaTimer/60)+\"min)\":\" - Off\";"
+static char jsonBuffer[1280];
+
+static void status_handler() {
+  JsonBuffer json(jsonBuffer, sizeof(jsonBuffer));
+  renderStatus(json);
+  if (json.overflow()) {
+    server.send(500);
+    return;
+  }
+  server.send_P(200, PSTR("application/json"), json.c_str(), json.length());   // send_P also reads from RAM
+}
+
+// Prometheus text format, streamed in chunks of jsonBuffer
+#define METRIC_LINE 128   // bytes - longest line, a chunk is sent when less room is left
+
+static void sendMetrics(JsonBuffer& out, bool last = false)
+{
+  if (!last && out.length() + METRIC_LINE < out.capacity()) return;
+  server.sendContent(out.c_str(), out.length());
+  out.clear();
+  if (last) server.sendContent("");
+}
+
+static void printSeconds(JsonBuffer& out, uint64_t us)
+{
+  out.print("%lu.%06lu\n", (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+}
+
+static void renderHistogram(JsonBuffer& out, const char* name, const Histogram& histogram)
+{
+  out.print("# TYPE annahand_%s_seconds histogram\n", name);
+  unsigned long count = 0;
+  for (size_t i = 0; i < METRIC_BUCKETS; ++i) {
+    count += histogram.counts[i];
+    if (i < METRIC_BUCKETS - 1) out.print("annahand_%s_seconds_bucket{le=\"0.%06lu\"} %lu\n", name, 16UL << (2 * i), count);
+    else out.print("annahand_%s_seconds_bucket{le=\"+Inf\"} %lu\n", name, count);
+    sendMetrics(out);
+  }
+  out.print("annahand_%s_seconds_sum ", name);
+  printSeconds(out, histogram.sum);
+  out.print("annahand_%s_seconds_count %lu\n# TYPE annahand_%s_max_seconds gauge\nannahand_%s_max_seconds ", name, count, name, name);
+  printSeconds(out, histogram.max);
+  sendMetrics(out);
+}
+
+static void renderGauge(JsonBuffer& out, const char* name, const char* type, unsigned long value)
+{
+  out.print("# TYPE annahand_%s %s\nannahand_%s %lu\n", name, type, name, value);
+  sendMetrics(out);
+}
+
+static void metrics_handler() {
+  JsonBuffer out(jsonBuffer, sizeof(jsonBuffer));
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4");
+  renderGauge(out, "uptime_seconds", "counter", millis() / 1000);
+  if (metrics.bootLight) {
+    out.print("# TYPE annahand_boot_light_seconds gauge\nannahand_boot_light_seconds ");
+    printSeconds(out, metrics.bootLight);
+  }
+  if (metrics.bootWifi) {
+    out.print("# TYPE annahand_boot_wifi_seconds gauge\nannahand_boot_wifi_seconds ");
+    printSeconds(out, metrics.bootWifi * 1000ULL);
+  }
+  renderHistogram(out, "loop", metrics.loop);
+  renderHistogram(out, "ramp_jitter", metrics.rampJitter);
+  out.print("# TYPE annahand_http_handler_seconds summary\n");
+  for (size_t i = 0; i <= METRIC_URI_COUNT; ++i) {
+    const UriMetrics& uri = metrics.uris[i];
+    if (!uri.requests) continue;
+    const char* name = i < METRIC_URI_COUNT ? METRIC_URIS[i] : "other";
+    out.print("annahand_http_handler_seconds_count{uri=\"%s\"} %lu\nannahand_http_handler_seconds_sum{uri=\"%s\"} ",
+              name, (unsigned long)uri.requests, name);
+    printSeconds(out, uri.sum);
+    sendMetrics(out);
+  }
+  out.print("# TYPE annahand_http_handler_max_seconds gauge\n");
+  for (size_t i = 0; i <= METRIC_URI_COUNT; ++i) {
+    const UriMetrics& uri = metrics.uris[i];
+    if (!uri.requests) continue;
+    out.print("annahand_http_handler_max_seconds{uri=\"%s\"} ", i < METRIC_URI_COUNT ? METRIC_URIS[i] : "other");
+    printSeconds(out, uri.max);
+    sendMetrics(out);
+  }
+  renderGauge(out, "http_timeouts_total", "counter", metrics.httpTimeouts);
+  renderGauge(out, "udp_datagrams_total", "counter", metrics.udpDatagrams);
+  renderGauge(out, "heap_free_bytes", "gauge", ESP.getFreeHeap());
+  renderGauge(out, "heap_free_min_bytes", "gauge", metrics.heapFreeMin);
+  renderGauge(out, "heap_max_block_bytes", "gauge", ESP.getMaxFreeBlockSize());
+  renderGauge(out, "heap_fragmentation_percent", "gauge", ESP.getHeapFragmentation());
+  renderGauge(out, "settings_writes_total", "counter", settingsLog.writes());
+  renderGauge(out, "settings_erases_total", "counter", settingsLog.erases());
+  renderGauge(out, "wifi_disconnects_total", "counter", metrics.wifiDisconnects);
+#ifdef ENABLE_MQTT
+  renderGauge(out, "mqtt_connects_total", "counter", metrics.mqttConnects);
+  renderGauge(out, "mqtt_publishes_total", "counter", metrics.mqttPublishes);
+  renderGauge(out, "mqtt_connected", "gauge", mqtt.state() == Mqtt::CONNECTED);
 #endif
-                "}"
-              "}"
-            "};"
-            "xhr.send(null);"
-          "};"
-          "update();"
-          "setInterval(update, 1000);"
-        "</script>"
-      "</head>"
-      "<body>"
-        "<h1>" TAG "<span id=\"version\"> (v" VERSION ")</span></h1>"
-          "<table style=\"height: 60px;\" width=\"100%\">"
-          "<tbody>"
-            "<tr>"
-              "<td style=\"width: 50%;\">"
-                "<span class=\"info\">SSID: </span><span id=\"ssid\"></span>"
-                "<br/>"
-                "<span class=\"info\">RSSI: </span><span id=\"rssi\"></span>"
-                "<br/>"
-                "<span class=\"info\">IP: </span><span id=\"ip\"></span>"
-                "<br/>"
-                "<span class=\"info\">MAC: </span><span id=\"mac\"></span>"
-                "<br/>"
-                "<span class=\"info\">Lights: </span><span id=\"lights\"></span><input type=\"range\" id=\"bulb\" min=\"0\" max=\"255\" onchange=\"invoke('" URI_LIGHT "?bulb='+this.value)\"/><input type=\"color\" id=\"rgb\" onchange=\"invoke('" URI_LIGHT "?rgb='+this.value.replace('#','%23'))\"/><input type=\"range\" id=\"white\" min=\"0\" max=\"255\"/ onchange=\"invoke('" URI_LIGHT "?white='+this.value)\"><a class=\"link\" href=\"\" onclick=\"invoke(\'" URI_DEFAULT "?all=current\');return false;\">Memorize</a>"
-              "</td>"
-            "</tr>"
-            "<tr>"
-              "<td style=\"width: 50%;\">"
-                "<a class=\"link\" href=\"\" onclick=\"invoke(\'" URI_LIGHT "?all=toggle\');return false;\">Toggle Lights</a></span>"
-                "<br/>"
-                "<a class=\"link\" href=\"\" onclick=\"invoke(\'" URI_REBOOT "\');return false;\">Reboot Device</a><span id=\"reboot\"></span>"
-                "<br/>"
-                "<a class=\"link\" href=\"\" onclick=\"invoke(\'" URI_WIFI "\');return false;\">Reset Device</a>"
-                "<br/>"
+  out.print("# TYPE annahand_wifi_rssi_dbm gauge\nannahand_wifi_rssi_dbm %d\n", (int)WiFi.RSSI());
+  sendMetrics(out, true);
+}
+
+// Server-Sent Events: the fields of the status that changed are pushed to subscribers,
+// the first event of a stream is the full status
+#define EVENT_CLIENTS    4      // concurrent subscribers
+#define EVENT_PERIOD     100    // ms - minimum interval between two events, coalesces ramp steps
+#define EVENT_KEEPALIVE  15000  // ms - a comment is sent on silent streams to detect dead clients
+
+struct PushState
+{
+  struct {
+    unsigned short value, defaultValue, rampOn, rampOff;
+    unsigned int delay;
+  } lights[LIGHT_COUNT];
+  uint8_t scene;
+  SensorAction sensorActions[SENSOR_EVENTS];
+  uint32_t sensorTimeout;
+  FirmwareUpdate::State update;
+  size_t updateProgress, updateSize;
+  FirmwareUpdate::Boot boot;
+  bool ota;
+  unsigned long otaTimer;
+  bool reboot;
+  unsigned long rebootTimer;
+};
+
+static WiFiClient eventClients[EVENT_CLIENTS];
+static bool eventActive[EVENT_CLIENTS];
+static bool eventResync[EVENT_CLIENTS];   // the client missed an event or just subscribed: send the full status
+static PushState pushedState;
+static unsigned long lastPush = 0;
+
+static void captureState(PushState& state, unsigned long currentTime)
+{
+  memset(&state, 0, sizeof(state));
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    state.lights[i].value = Lights[i].currentValue();
+    Lights[i].defaultValues(state.lights[i].defaultValue, state.lights[i].rampOn, state.lights[i].rampOff, state.lights[i].delay);
+  }
+  state.scene = scenes.scene();
+  memcpy(state.sensorActions, sensorActions, sizeof(sensorActions));
+  state.sensorTimeout = sensorTimeout;
+  state.update = firmware.state();
+  state.updateProgress = firmware.progress();
+  state.updateSize = firmware.size();
+  state.boot = firmware.boot();
 #ifdef ENABLE_ARDUINOOTA
-                "<a class=\"link\"  href=\"\" onclick=\"invoke(\'" URI_OTA "?action=toggle\');return false;\">Toggle OTA</a><span id=\"ota\"></span>"
-                "<br/>"
-#endif
-#ifdef ENABLE_UPDATE
-                "<form id=\"upgradeForm\" method=\"post\" enctype=\"multipart/form-data\" action=\"" URI_UPDATE "\"><span class=\"action\">Upgrade Firmware: </span><input type=\"file\" name=\"fileToUpload\" id=\"upgradeFile\" /><input type=\"submit\" value=\"Upgrade\" id=\"upgradeSubmit\"/></form>"
-                "<br/>"
+  state.ota = OTA != NULL;
+  state.otaTimer = untilDeadline(otaOnTimer, currentTime) / 1000;
 #endif
-              "</td>"
-            "</tr>"
-          "</tbody>"
-        "</table>"
-        "<a href=\"" URI_USAGE "\">API Usage</a>"
-      "</body>"
-    "</html>");
-  server.send(200, "text/html", info);
+  state.reboot = rebootRequested > 0;
+  state.rebootTimer = untilDeadline(rebootRequested, currentTime) / 1000;
 }
 
+// JSON object with the fields that differ between the two states, false when none does
+static bool renderChanges(JsonBuffer& json, const PushState& from, const PushState& to)
+{
+  const char* separator = "";
+  bool values = false;
+  json.print("{\"lights\":{");
+  for (size_t i = 0; i < LIGHT_COUNT; ++i) {
+    bool valueChanged = from.lights[i].value != to.lights[i].value;
+    bool defaultsChanged = from.lights[i].defaultValue != to.lights[i].defaultValue || from.lights[i].rampOn != to.lights[i].rampOn ||
+                           from.lights[i].rampOff != to.lights[i].rampOff || from.lights[i].delay != to.lights[i].delay;
+    if (!valueChanged && !defaultsChanged) continue;
+    char name[CHANNEL_NAME_SIZE];
+    json.print("%s\"%s\":{\"value\":%u", separator, channelName(i, name), to.lights[i].value);
+    if (defaultsChanged) {
+      json.print(",\"default\":%u,\"rampOn\":%u,\"rampOff\":%u,\"delay\":%u",
+                 to.lights[i].defaultValue, to.lights[i].rampOn, to.lights[i].rampOff, to.lights[i].delay);
+    }
+    json.print("}");
+    separator = ",";
+    values |= valueChanged;
+  }
+  if (values) {
+    json.print(",");
+    renderColors(json);
+  }
+  json.print("}");
+  bool changed = *separator != '\0';
+  if (from.scene != to.scene) {
+    char scene[CHANNEL_NAME_SIZE];
+    json.print(",\"scene\":\"%s\"", sceneName(to.scene, scene));
+    changed = true;
+  }
+  if (memcmp(from.sensorActions, to.sensorActions, sizeof(to.sensorActions)) != 0 || from.sensorTimeout != to.sensorTimeout) {
+    json.print(",");
+    renderSensor(json, to.sensorActions, to.sensorTimeout);
+    changed = true;
+  }
+  if (from.update != to.update || from.updateProgress != to.updateProgress || from.updateSize != to.updateSize || from.boot != to.boot) {
+    json.print(",");
+    renderUpdate(json, to.update, to.updateProgress, to.updateSize, to.boot);
+    changed = true;
+  }
+  if (from.ota != to.ota || from.otaTimer != to.otaTimer) {
+    json.print(",\"ota\":\"%s\",\"otaTimer\":%lu", to.ota ? "true" : "false", to.otaTimer);
+    changed = true;
+  }
+  if (from.reboot != to.reboot || from.rebootTimer != to.rebootTimer) {
+    json.print(",\"reboot\":\"%s\",\"rebootTimer\":%lu", to.reboot ? "true" : "false", to.rebootTimer);
+    changed = true;
+  }
+  json.print("}");
+  return changed;
+}
+
+// Never blocks: a client without room for the whole event skips it and is resynchronized later
+static void sendEvent(int client, const JsonBuffer& json)
+{
+  if (json.overflow() || eventClients[client].availableForWrite() < (int)json.length()) {
+    eventResync[client] = true;
+    return;
+  }
+  eventClients[client].write((const uint8_t*)json.c_str(), json.length());
+}
+
+static void events_handler() {
+  for (int i = 0; i < EVENT_CLIENTS; ++i) {
+    if (eventClients[i].connected()) continue;
+    eventClients[i] = server.client();
+    eventClients[i].setNoDelay(true);
+    eventActive[i] = true;
+    eventResync[i] = true;
+    lastPush = millis() - EVENT_PERIOD;
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.sendContent_P(PSTR("HTTP/1.1 200 OK\r\n"
+                              "Content-Type: text/event-stream\r\n"
+                              "Cache-Control: no-cache\r\n"
+                              "Connection: keep-alive\r\n"
+                              "Access-Control-Allow-Origin: *\r\n"
+                              "\r\n"));
+    return;
+  }
+  server.send(503);
+}
+
+// Push pending changes, returns the time (ms) until the next push may be needed
+static unsigned long pushEvents(unsigned long currentTime)
+{
+  bool subscribed = false;
+  for (int i = 0; i < EVENT_CLIENTS; ++i) {
+    if (!eventActive[i]) continue;
+    if (eventClients[i].connected()) {
+      subscribed = true;
+    }
+    else {
+      eventClients[i] = WiFiClient();   // release the connection
+      eventActive[i] = false;
+    }
+  }
+  if (!subscribed) return IDLE_MAX_SLEEP;
+  if ((uint32_t)(currentTime - lastPush) < EVENT_PERIOD) return EVENT_PERIOD - (uint32_t)(currentTime - lastPush);
+
+  PushState state;
+  captureState(state, currentTime);
+  JsonBuffer json(jsonBuffer, sizeof(jsonBuffer));
+  json.print("data: ");
+  bool changed = renderChanges(json, pushedState, state);
+  json.print("\n\n");
+  bool keepAlive = (uint32_t)(currentTime - lastPush) >= EVENT_KEEPALIVE;
+  bool resync = false;
+  for (int i = 0; i < EVENT_CLIENTS; ++i) {
+    if (!eventClients[i].connected()) continue;
+    if (eventResync[i]) resync = true;
+    else if (changed) sendEvent(i, json);
+    else if (keepAlive) eventClients[i].write(": \n\n");
+  }
+  if (resync) {
+    JsonBuffer full(jsonBuffer, sizeof(jsonBuffer));
+    full.print("data: ");
+    renderStatus(full);
+    full.print("\n\n");
+    for (int i = 0; i < EVENT_CLIENTS; ++i) {
+      if (!eventClients[i].connected() || !eventResync[i]) continue;
+      eventResync[i] = false;
+      sendEvent(i, full);
+    }
+  }
+  pushedState = state;
+  if (changed || resync || keepAlive) lastPush = currentTime;
+  return (changed || ramps.running || scenes.scene() != SCENE_NONE) ? EVENT_PERIOD : IDLE_MAX_SLEEP;
+}
+
+static void info_handler() {
+  sendPage(WEB_INFO, sizeof(WEB_INFO), WEB_INFO_ETAG);
+}
 static void startServer() {
+  static const char* headers[] = { "If-None-Match" };
+  server.collectHeaders(headers, 1);
   server.on ( URI_ROOT, info_handler );
   server.on ( URI_INFO, info_handler );
   server.on ( URI_USAGE, usage_handler );
   server.on ( URI_STATUS, status_handler );
+  server.on ( URI_EVENTS, events_handler );
+  server.on ( URI_METRICS, metrics_handler );
   server.on ( URI_WIFI, wifi_handler );
   server.on ( URI_REBOOT, reboot_handler );
   server.on ( URI_LIGHT, light_handler );
   server.on ( URI_DEFAULT, default_handler );
+  server.on ( URI_SNAPSHOT, HTTP_GET, snapshot_handler );
+  server.on ( URI_SNAPSHOT, HTTP_POST, snapshotRestore, snapshotUpload );
 #ifdef ENABLE_ARDUINOOTA
   server.on ( URI_OTA, ota_handler );
 #endif
 #ifdef ENABLE_UPDATE
   server.on ( URI_UPDATE, HTTP_POST, []() {
-        String html = "<html>"
-                        "<head>"
-                        "<title>" TAG " - OTA</title>" +
-                        (!Update.hasError() ? "<meta http-equiv=\"refresh\" content=\"" + String(OTA_REBOOT_TIMER + 1) + "; url=/\">" : "") +
-                        "</head>"
-                        "<body>Update " + (Update.hasError() ? "failed" : "succeeded") + "</body>"
-                    "</html>";
+    bool installed = firmware.state() == FirmwareUpdate::INSTALLED;
+    String html = "<html>"
+                    "<head>"
+                    "<title>" TAG " - OTA</title>" +
+                    (installed ? "<meta http-equiv=\"refresh\" content=\"" + String(OTA_REBOOT_TIMER + 1) + "; url=/\">" : "") +
+                    "</head>"
+                    "<body>Update " + (installed ? String("succeeded") : String("failed: ") + firmware.error()) + "</body>"
+                  "</html>";
     server.sendHeader("Connection", "close");
-    server.send(200, "text/html", html);
-    requestReboot();
+    server.send(installed ? 200 : 400, "text/html", html);
+    if (installed) requestReboot(OTA_REBOOT_TIMER);
   }, update_handler );
 #endif
   server.begin();
 }
 
+// Wi-Fi - the station connects in the background with the credentials saved by the SDK, the lights
+// already on and loop() running. Still not connected after WIFI_CONNECT_TIMEOUT, it begins again,
+// loop() running on: an unreachable AP does not take the switches and the sensor away. Only
+// without credentials does the WiFiManager portal open: it blocks loop() for WIFI_PORTAL_TIMEOUT at
+// most (the ramps and the sensor sampling go on, on their tickers), then again every
+// WIFI_CONNECT_TIMEOUT until configured.
+#define WIFI_CONNECT_TIMEOUT 30000  // ms
+#define WIFI_PORTAL_TIMEOUT  180    // s
+#define WIFI_POLL            20     // ms - until connected once
+static WiFiEventHandler wifiDisconnected;
+static unsigned long wifiRetryDue = 0;  // deadline (see deadlineIn()) of the next attempt
+static bool wifiJoined = false;         // connected once, the sync group joined
+
+static void wifiPortal()
+{
+  char name[sizeof(TAG) + 7];
+  snprintf(name, sizeof(name), TAG "-%06x", (unsigned)ESP.getChipId());
+  WiFiManager manager;
+  manager.setConfigPortalTimeout(WIFI_PORTAL_TIMEOUT);
+  if (!manager.startConfigPortal(name, "")) {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin();
+  }
+  wifiRetryDue = deadlineIn(WIFI_CONNECT_TIMEOUT);
+}
+
+static void wifiUpdate(unsigned long currentTime)
+{
+  if (wifiJoined) return;
+  if (WiFi.isConnected()) {
+    wifiJoined = true;
+    metrics.bootWifi = MAX(1, (uint32_t)(currentTime - bootTime));
+    udp.beginMulticast(WiFi.localIP(), IPAddress(SYNC_GROUP), UDP_PORT);   // unicast datagrams too
+    syncHeard = currentTime;   // listen for a master before becoming one
+  }
+  else if (untilDeadline(wifiRetryDue, currentTime) == 0) {
+    if (WiFi.SSID() == "") wifiPortal();   // still not configured
+    else {
+      WiFi.begin();
+      wifiRetryDue = deadlineIn(WIFI_CONNECT_TIMEOUT);
+    }
+  }
+}
+
 void setup() {
   Serial.begin(115200);
   Serial.setDebugOutput(SERIAL_DEBUG);
+  firmware.begin();   // may restart into the previous image
+  bootTime = millis();
+  metrics.bootStart = micros();
+  metrics.bootLight = metrics.bootWifi = 0;
 
-  // Wi-Fi connection - Connecte le module au réseau Wi-Fi
-  // attempt to connect; should it fail, fall back to AP
-  WiFiManager().autoConnect(TAG + ESP.getChipId(), "");
-
-  // Setup PWM mode and Sensor Pin
-  analogWriteRange(PWMRANGE);
-  analogWriteFreq(1000);
+  // Lights first, written through the waveform generator (Ramps), then the sensor pin. The
+  // default generator ignores the phase offsets between the channels.
+  enablePhaseLockedWaveform();
+  for (Light& l : Lights) l.begin();
+  loadSettings();
+  powerOnLights();
   pinMode(PIN_SENSOR, PIN_SENSOR==16?INPUT_PULLDOWN_16:INPUT);
 
-  EEPROM.begin(5 * Light::EEPROM_SIZE);
-  Lights.push_back(Light("bulb", PIN_LED_HAND_LIGHT, 0));
-  Lights.push_back(Light("red", PIN_LED_HAND_RGBW_R, 64));
-  Lights.push_back(Light("green", PIN_LED_HAND_RGBW_G, 128));
-  Lights.push_back(Light("blue", PIN_LED_HAND_RGBW_B, 192));
-  Lights.push_back(Light("white", PIN_LED_HAND_RGBW_W, 256));
-  EEPROM.end();
-
-  for (Light& l : Lights) l.setDimming(true);
+  // Wi-Fi connection in the background, see wifiUpdate()
+  wifiJoined = false;
+  WiFi.mode(WIFI_STA);
+  WiFi.begin();
+  wifiRetryDue = deadlineIn(WIFI_CONNECT_TIMEOUT);
+  metrics.heapFreeMin = ESP.getFreeHeap();
+  wifiDisconnected = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected&) { ++metrics.wifiDisconnects; });
+  sensor.begin();
   startServer();
+  if (WiFi.SSID() == "") wifiPortal();   // never configured
+#ifdef ENABLE_MQTT
+  snprintf(mqttBase, sizeof(mqttBase), MQTT_PREFIX "/%06x", (unsigned)ESP.getChipId());
+#endif
+}
+
+// Sleep up to 'duration' ms, returning as soon as a sensor edge, a client or an MQTT message needs
+// loop(); the sockets are checked every 'poll' ms, UDP commands are run meanwhile
+// Socket poll period of idle(): IDLE_POLL while a connection waits, an /events subscriber is
+// served, the lights move or a client sent something in the last IDLE_ACTIVE ms, else
+// IDLE_POLL_QUIET
+static unsigned long idlePoll(unsigned long currentTime)
+{
+  bool active = server.active() || ramps.running || scenes.scene() != SCENE_NONE ||
+                (uint32_t)(currentTime - idleClientSeen) < IDLE_ACTIVE;
+  for (int i = 0; i < EVENT_CLIENTS && !active; ++i) active = eventActive[i];
+  return active ? IDLE_POLL : IDLE_POLL_QUIET;
+}
+
+static void idle(unsigned long duration, unsigned long poll)
+{
+  esp_delay(duration, []() {
+#ifdef ENABLE_POWER_SAVE
+    uint32_t start = micros();
+#endif
+    bool wanted = sensor.pending() || server.busy() || handleUdp();
+#ifdef ENABLE_MQTT
+    wanted = wanted || mqtt.available() || mqttLookup > MQTT_LOOKUP_PENDING;   // or the broker name resolved
+#endif
+#ifdef ENABLE_POWER_SAVE
+    powerWake(micros() - start);
+#endif
+    return !wanted;
+  }, poll);
 }
 
 void loop() {
-  server.handleClient();
+  uint32_t loopStart = micros();
+  server.poll();
+  handleUdp();
   unsigned long currentTime = millis();
-  if (rebootRequested != 0 && currentTime > rebootRequested) {
+  if (rebootRequested != 0 && untilDeadline(rebootRequested, currentTime) == 0) {
     rebootRequested = 0;
     requestReboot(0);
   }
+  if (firmware.boot() == FirmwareUpdate::TRIAL) {
+    uint32_t uptime = currentTime - bootTime;
+    if ((WiFi.isConnected() && uptime >= UPDATE_CONFIRM_TIME) || uptime >= UPDATE_CONFIRM_OFFLINE) firmware.confirm();
+  }
 #ifdef ENABLE_ARDUINOOTA
   if (OTA)  OTA->handle();
-  if (otaOnTimer != 0 && currentTime > otaOnTimer) {
+  if (otaOnTimer != 0 && untilDeadline(otaOnTimer, currentTime) == 0) {
     enableOTA(false, true);
   }
 #endif
-  // read sensor
-  static bool lastState = false;
-  bool sensorState = digitalRead(PIN_SENSOR);
-  if (sensorState != lastState) {
-    for (Light& l : Lights) l.setDimming(sensorState);
-    lastState = sensorState;
-  }
+  sensor.update(currentTime);
+  wifiUpdate(currentTime);
+  if (wifiJoined) syncUpdate(currentTime);
+#ifdef ENABLE_MQTT
+  mqttUpdate(currentTime);
+#endif
   for (Light& l : Lights) l.update();
-  delay(50);
+  if (!settingsDirty && powerOnChanged()) settingsModified();
+  if (settingsDirty && (uint32_t)(millis() - settingsChanged) >= SETTINGS_QUIET) saveSettings();
+
+  // sleep until the earliest deadline
+  currentTime = millis();
+  unsigned long sleep = pushEvents(currentTime);
+  for (Light& l : Lights) sleep = MIN(sleep, l.nextUpdate(currentTime));
+  sleep = MIN(sleep, sensor.nextUpdate(currentTime));
+  sleep = MIN(sleep, wifiJoined ? syncNextUpdate(currentTime) : WIFI_POLL);
+#ifdef ENABLE_MQTT
+  sleep = MIN(sleep, mqttNextUpdate(currentTime));
+#endif
+  sleep = MIN(sleep, server.nextUpdate(currentTime));
+  if (rebootRequested != 0) sleep = MIN(sleep, untilDeadline(rebootRequested, currentTime));
+  if (settingsDirty) sleep = MIN(sleep, SETTINGS_QUIET - MIN(SETTINGS_QUIET, (uint32_t)(currentTime - settingsChanged)));
+#ifdef ENABLE_ARDUINOOTA
+  if (OTA) sleep = MIN(sleep, OTA_POLL_PERIOD);
+  if (otaOnTimer != 0) sleep = MIN(sleep, untilDeadline(otaOnTimer, currentTime));
+#endif
+  metrics.heapFreeMin = MIN(metrics.heapFreeMin, ESP.getFreeHeap());
+  metrics.loop.add(micros() - loopStart);
+  unsigned long poll = idlePoll(currentTime);
+#ifdef ENABLE_POWER_SAVE
+  powerUpdate(currentTime, micros() - loopStart);
+  poll = powerPoll(poll);
+#endif
+  if (wifiJoined && syncListening(currentTime)) poll = 1;
+  idle(sleep, poll);
 }
@@ -0,0 +1,79 @@
+# Compress the pages of web/ into include/WebAssets.h (PROGMEM arrays + ETag), before each build.
+#
+# Pages are written like the sketch strings used to be: "{{NAME}}" is replaced by the string or
+# number #define NAME of src/AnnaHand.cpp, "#ifdef X" / "#endif" lines keep their block when X is
+# defined in the sketch or the build flags, and lines are stripped and joined.
+#
+#   PlatformIO: extra_scripts = pre:tools/web_assets.py
+#   by hand:    python3 tools/web_assets.py
+
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")   # noqa: F821 - PlatformIO (SCons) build
+    ROOT = env.subst("$PROJECT_DIR")   # noqa: F821
+    FLAGS = [d if isinstance(d, str) else d[0] for d in env.get("CPPDEFINES", [])]   # noqa: F821
+except NameError:
+    ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    FLAGS = []
+
+SKETCH = os.path.join(ROOT, "src", "AnnaHand.cpp")
+PAGES = os.path.join(ROOT, "web")
+OUTPUT = os.path.join(ROOT, "include", "WebAssets.h")
+
+
+def sketch_defines():
+    strings, flags = {}, set(FLAGS)
+    with open(SKETCH, encoding="utf-8") as sketch:
+        for line in sketch:
+            match = re.match(r'#define\s+(\w+)\s+(?:"([^"]*)"|(\d+)\b)', line)
+            if match:
+                strings[match.group(1)] = match.group(2) if match.group(2) is not None else match.group(3)
+            match = re.match(r'#define\s+(\w+)\s*$', line)
+            if match:
+                flags.add(match.group(1))
+    return strings, flags
+
+
+def render(path, strings, flags):
+    out, keep = [], [True]
+    with open(path, encoding="utf-8") as page:
+        for line in page:
+            line = line.strip()
+            if line.startswith("#ifdef "):
+                keep.append(keep[-1] and line[7:].strip() in flags)
+            elif line == "#endif":
+                keep.pop()
+            elif keep[-1]:
+                out.append(re.sub(r"\{\{(\w+)\}\}", lambda m: strings[m.group(1)], line))
+    return "".join(out).encode("utf-8")
+
+
+def main():
+    strings, flags = sketch_defines()
+    lines = ["// Generated by tools/web_assets.py from web/ - do not edit", "",
+             "#ifndef WEBASSETS_H", "#define WEBASSETS_H", ""]
+    for name in sorted(os.listdir(PAGES)):
+        raw = render(os.path.join(PAGES, name), strings, flags)
+        packed = gzip.compress(raw, 9, mtime=0)
+        symbol = "WEB_" + re.sub(r"\W", "_", os.path.splitext(name)[0]).upper()
+        print("web_assets: %-12s %6d -> %5d bytes gzip" % (name, len(raw), len(packed)))
+        lines.append("// %s: %d bytes, %d gzipped" % (name, len(raw), len(packed)))
+        lines.append('#define %s_ETAG "\\"%s\\""' % (symbol, hashlib.sha1(packed).hexdigest()[:16]))
+        lines.append("static const uint8_t %s[] PROGMEM = {" % symbol)
+        for offset in range(0, len(packed), 16):
+            lines.append("  " + ", ".join("0x%02x" % b for b in packed[offset:offset + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+    lines.append("#endif")
+    content = "\n".join(lines) + "\n"
+    # only touch the header when a page changed, so the sketch is not rebuilt for nothing
+    if not os.path.exists(OUTPUT) or open(OUTPUT, encoding="utf-8").read() != content:
+        with open(OUTPUT, "w", encoding="utf-8") as header:
+            header.write(content)
+
+
+main()